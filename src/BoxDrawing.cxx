@@ -0,0 +1,510 @@
+// C++
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <utility>
+
+// nst
+#include "BoxDrawing.hxx"
+#include "DrawBatch.hxx"
+
+namespace nst {
+
+namespace {
+
+	/// Line weight of one of the four arms of a box drawing character.
+	enum class LineWeight : uint8_t {
+		NONE,
+		LIGHT,
+		HEAVY,
+		DOUBLE
+	};
+
+	/// Properties of box drawing characters that can't be expressed via arms.
+	enum class Special : uint8_t {
+		NONE,
+		ARC,          ///< rounded corner (drawn like a square corner)
+		DIAG_RISING,  ///< diagonal from upper right to lower left
+		DIAG_FALLING, ///< diagonal from upper left to lower right
+		DIAG_CROSS    ///< both diagonals
+	};
+
+	/// Describes the appearance of a box drawing character.
+	struct BoxSpec {
+		LineWeight left;
+		LineWeight right;
+		LineWeight up;
+		LineWeight down;
+		uint8_t dashes; ///< number of dashes if this is a dashed line
+		Special special;
+	};
+
+	constexpr auto NO = LineWeight::NONE;
+	constexpr auto LT = LineWeight::LIGHT;
+	constexpr auto HV = LineWeight::HEAVY;
+	constexpr auto DB = LineWeight::DOUBLE;
+	constexpr auto NONE = Special::NONE;
+	constexpr auto ARC = Special::ARC;
+	constexpr auto DIAG_RISING = Special::DIAG_RISING;
+	constexpr auto DIAG_FALLING = Special::DIAG_FALLING;
+	constexpr auto DIAG_CROSS = Special::DIAG_CROSS;
+
+	/// Box drawing specifications for U+2500 - U+257F in order.
+	constexpr BoxSpec BOX_SPECS[] = {
+		{LT, LT, NO, NO, 0, NONE}, // U+2500 ─
+		{HV, HV, NO, NO, 0, NONE}, // U+2501 ━
+		{NO, NO, LT, LT, 0, NONE}, // U+2502 │
+		{NO, NO, HV, HV, 0, NONE}, // U+2503 ┃
+		{LT, LT, NO, NO, 3, NONE}, // U+2504 ┄
+		{HV, HV, NO, NO, 3, NONE}, // U+2505 ┅
+		{NO, NO, LT, LT, 3, NONE}, // U+2506 ┆
+		{NO, NO, HV, HV, 3, NONE}, // U+2507 ┇
+		{LT, LT, NO, NO, 4, NONE}, // U+2508 ┈
+		{HV, HV, NO, NO, 4, NONE}, // U+2509 ┉
+		{NO, NO, LT, LT, 4, NONE}, // U+250A ┊
+		{NO, NO, HV, HV, 4, NONE}, // U+250B ┋
+		{NO, LT, NO, LT, 0, NONE}, // U+250C ┌
+		{NO, HV, NO, LT, 0, NONE}, // U+250D ┍
+		{NO, LT, NO, HV, 0, NONE}, // U+250E ┎
+		{NO, HV, NO, HV, 0, NONE}, // U+250F ┏
+		{LT, NO, NO, LT, 0, NONE}, // U+2510 ┐
+		{HV, NO, NO, LT, 0, NONE}, // U+2511 ┑
+		{LT, NO, NO, HV, 0, NONE}, // U+2512 ┒
+		{HV, NO, NO, HV, 0, NONE}, // U+2513 ┓
+		{NO, LT, LT, NO, 0, NONE}, // U+2514 └
+		{NO, HV, LT, NO, 0, NONE}, // U+2515 ┕
+		{NO, LT, HV, NO, 0, NONE}, // U+2516 ┖
+		{NO, HV, HV, NO, 0, NONE}, // U+2517 ┗
+		{LT, NO, LT, NO, 0, NONE}, // U+2518 ┘
+		{HV, NO, LT, NO, 0, NONE}, // U+2519 ┙
+		{LT, NO, HV, NO, 0, NONE}, // U+251A ┚
+		{HV, NO, HV, NO, 0, NONE}, // U+251B ┛
+		{NO, LT, LT, LT, 0, NONE}, // U+251C ├
+		{NO, HV, LT, LT, 0, NONE}, // U+251D ┝
+		{NO, LT, HV, LT, 0, NONE}, // U+251E ┞
+		{NO, LT, LT, HV, 0, NONE}, // U+251F ┟
+		{NO, LT, HV, HV, 0, NONE}, // U+2520 ┠
+		{NO, HV, HV, LT, 0, NONE}, // U+2521 ┡
+		{NO, HV, LT, HV, 0, NONE}, // U+2522 ┢
+		{NO, HV, HV, HV, 0, NONE}, // U+2523 ┣
+		{LT, NO, LT, LT, 0, NONE}, // U+2524 ┤
+		{HV, NO, LT, LT, 0, NONE}, // U+2525 ┥
+		{LT, NO, HV, LT, 0, NONE}, // U+2526 ┦
+		{LT, NO, LT, HV, 0, NONE}, // U+2527 ┧
+		{LT, NO, HV, HV, 0, NONE}, // U+2528 ┨
+		{HV, NO, HV, LT, 0, NONE}, // U+2529 ┩
+		{HV, NO, LT, HV, 0, NONE}, // U+252A ┪
+		{HV, NO, HV, HV, 0, NONE}, // U+252B ┫
+		{LT, LT, NO, LT, 0, NONE}, // U+252C ┬
+		{HV, LT, NO, LT, 0, NONE}, // U+252D ┭
+		{LT, HV, NO, LT, 0, NONE}, // U+252E ┮
+		{HV, HV, NO, LT, 0, NONE}, // U+252F ┯
+		{LT, LT, NO, HV, 0, NONE}, // U+2530 ┰
+		{HV, LT, NO, HV, 0, NONE}, // U+2531 ┱
+		{LT, HV, NO, HV, 0, NONE}, // U+2532 ┲
+		{HV, HV, NO, HV, 0, NONE}, // U+2533 ┳
+		{LT, LT, LT, NO, 0, NONE}, // U+2534 ┴
+		{HV, LT, LT, NO, 0, NONE}, // U+2535 ┵
+		{LT, HV, LT, NO, 0, NONE}, // U+2536 ┶
+		{HV, HV, LT, NO, 0, NONE}, // U+2537 ┷
+		{LT, LT, HV, NO, 0, NONE}, // U+2538 ┸
+		{HV, LT, HV, NO, 0, NONE}, // U+2539 ┹
+		{LT, HV, HV, NO, 0, NONE}, // U+253A ┺
+		{HV, HV, HV, NO, 0, NONE}, // U+253B ┻
+		{LT, LT, LT, LT, 0, NONE}, // U+253C ┼
+		{HV, LT, LT, LT, 0, NONE}, // U+253D ┽
+		{LT, HV, LT, LT, 0, NONE}, // U+253E ┾
+		{HV, HV, LT, LT, 0, NONE}, // U+253F ┿
+		{LT, LT, HV, LT, 0, NONE}, // U+2540 ╀
+		{LT, LT, LT, HV, 0, NONE}, // U+2541 ╁
+		{LT, LT, HV, HV, 0, NONE}, // U+2542 ╂
+		{HV, LT, HV, LT, 0, NONE}, // U+2543 ╃
+		{LT, HV, HV, LT, 0, NONE}, // U+2544 ╄
+		{HV, LT, LT, HV, 0, NONE}, // U+2545 ╅
+		{LT, HV, LT, HV, 0, NONE}, // U+2546 ╆
+		{HV, HV, HV, LT, 0, NONE}, // U+2547 ╇
+		{HV, HV, LT, HV, 0, NONE}, // U+2548 ╈
+		{HV, LT, HV, HV, 0, NONE}, // U+2549 ╉
+		{LT, HV, HV, HV, 0, NONE}, // U+254A ╊
+		{HV, HV, HV, HV, 0, NONE}, // U+254B ╋
+		{LT, LT, NO, NO, 2, NONE}, // U+254C ╌
+		{HV, HV, NO, NO, 2, NONE}, // U+254D ╍
+		{NO, NO, LT, LT, 2, NONE}, // U+254E ╎
+		{NO, NO, HV, HV, 2, NONE}, // U+254F ╏
+		{DB, DB, NO, NO, 0, NONE}, // U+2550 ═
+		{NO, NO, DB, DB, 0, NONE}, // U+2551 ║
+		{NO, DB, NO, LT, 0, NONE}, // U+2552 ╒
+		{NO, LT, NO, DB, 0, NONE}, // U+2553 ╓
+		{NO, DB, NO, DB, 0, NONE}, // U+2554 ╔
+		{DB, NO, NO, LT, 0, NONE}, // U+2555 ╕
+		{LT, NO, NO, DB, 0, NONE}, // U+2556 ╖
+		{DB, NO, NO, DB, 0, NONE}, // U+2557 ╗
+		{NO, DB, LT, NO, 0, NONE}, // U+2558 ╘
+		{NO, LT, DB, NO, 0, NONE}, // U+2559 ╙
+		{NO, DB, DB, NO, 0, NONE}, // U+255A ╚
+		{DB, NO, LT, NO, 0, NONE}, // U+255B ╛
+		{LT, NO, DB, NO, 0, NONE}, // U+255C ╜
+		{DB, NO, DB, NO, 0, NONE}, // U+255D ╝
+		{NO, DB, LT, LT, 0, NONE}, // U+255E ╞
+		{NO, LT, DB, DB, 0, NONE}, // U+255F ╟
+		{NO, DB, DB, DB, 0, NONE}, // U+2560 ╠
+		{DB, NO, LT, LT, 0, NONE}, // U+2561 ╡
+		{LT, NO, DB, DB, 0, NONE}, // U+2562 ╢
+		{DB, NO, DB, DB, 0, NONE}, // U+2563 ╣
+		{DB, DB, NO, LT, 0, NONE}, // U+2564 ╤
+		{LT, LT, NO, DB, 0, NONE}, // U+2565 ╥
+		{DB, DB, NO, DB, 0, NONE}, // U+2566 ╦
+		{DB, DB, LT, NO, 0, NONE}, // U+2567 ╧
+		{LT, LT, DB, NO, 0, NONE}, // U+2568 ╨
+		{DB, DB, DB, NO, 0, NONE}, // U+2569 ╩
+		{DB, DB, LT, LT, 0, NONE}, // U+256A ╪
+		{LT, LT, DB, DB, 0, NONE}, // U+256B ╫
+		{DB, DB, DB, DB, 0, NONE}, // U+256C ╬
+		{NO, LT, NO, LT, 0, ARC}, // U+256D ╭
+		{LT, NO, NO, LT, 0, ARC}, // U+256E ╮
+		{LT, NO, LT, NO, 0, ARC}, // U+256F ╯
+		{NO, LT, LT, NO, 0, ARC}, // U+2570 ╰
+		{NO, NO, NO, NO, 0, DIAG_RISING}, // U+2571 ╱
+		{NO, NO, NO, NO, 0, DIAG_FALLING}, // U+2572 ╲
+		{NO, NO, NO, NO, 0, DIAG_CROSS}, // U+2573 ╳
+		{LT, NO, NO, NO, 0, NONE}, // U+2574 ╴
+		{NO, NO, LT, NO, 0, NONE}, // U+2575 ╵
+		{NO, LT, NO, NO, 0, NONE}, // U+2576 ╶
+		{NO, NO, NO, LT, 0, NONE}, // U+2577 ╷
+		{HV, NO, NO, NO, 0, NONE}, // U+2578 ╸
+		{NO, NO, HV, NO, 0, NONE}, // U+2579 ╹
+		{NO, HV, NO, NO, 0, NONE}, // U+257A ╺
+		{NO, NO, NO, HV, 0, NONE}, // U+257B ╻
+		{LT, HV, NO, NO, 0, NONE}, // U+257C ╼
+		{NO, NO, LT, HV, 0, NONE}, // U+257D ╽
+		{HV, LT, NO, NO, 0, NONE}, // U+257E ╾
+		{NO, NO, HV, LT, 0, NONE}, // U+257F ╿
+	};
+
+	static_assert(std::size(BOX_SPECS) == 0x80);
+
+	/// Metrics of the lines drawn in a cell.
+	struct LineMetrics {
+		int light;
+		int heavy;
+		int double_offset;
+
+		int thickness(const LineWeight weight) const {
+			return weight == LineWeight::HEAVY ? heavy : light;
+		}
+
+		/// Returns the first pixel of a stroke of the given thickness centered at `offset`.
+		static int bandBegin(const int offset, const int thickness) {
+			return offset - thickness / 2;
+		}
+
+		/// Returns the pixel following a stroke of the given thickness centered at `offset`.
+		static int bandEnd(const int offset, const int thickness) {
+			return bandBegin(offset, thickness) + thickness;
+		}
+
+		/// Returns where an arm starts along its axis relative to the cell center.
+		/**
+		 * This is for arms pointing into the positive direction (right
+		 * or down).
+		 *
+		 * \param[in] offset The offset of the arm's stroke
+		 * perpendicular to the arm's axis.
+		 * \param[in] neg The weight of the perpendicular arm on the
+		 * negative side (left or up).
+		 * \param[in] pos The weight of the perpendicular arm on the
+		 * positive side (right or down).
+		 **/
+		int armStart(const int offset, const LineWeight weight, const LineWeight neg, const LineWeight pos) const {
+			const auto d = double_offset;
+
+			if (weight == LineWeight::DOUBLE && (neg == LineWeight::DOUBLE || pos == LineWeight::DOUBLE)) {
+				// double lines meeting each other, keep the
+				// inner area of the joint free
+				if (neg == pos)
+					return bandBegin(d, light);
+				else if (pos == LineWeight::DOUBLE)
+					return bandBegin(offset, light);
+				else
+					return bandBegin(-offset, light);
+			} else if (neg != LineWeight::NONE || pos != LineWeight::NONE) {
+				// cover the perpendicular lines completely
+				int ret = 0;
+				for (const auto perp: {neg, pos}) {
+					if (perp == LineWeight::DOUBLE)
+						ret = std::min(ret, bandBegin(-d, light));
+					else if (perp != LineWeight::NONE)
+						ret = std::min(ret, bandBegin(0, thickness(perp)));
+				}
+				return ret;
+			}
+
+			return 0;
+		}
+
+		/// Returns where an arm ends along its axis relative to the cell center.
+		/**
+		 * This is the counterpart of armStart() for arms pointing
+		 * into the negative direction (left or up).
+		 **/
+		int armEnd(const int offset, const LineWeight weight, const LineWeight neg, const LineWeight pos) const {
+			const auto d = double_offset;
+
+			if (weight == LineWeight::DOUBLE && (neg == LineWeight::DOUBLE || pos == LineWeight::DOUBLE)) {
+				if (neg == pos)
+					return bandEnd(-d, light);
+				else if (pos == LineWeight::DOUBLE)
+					return bandEnd(-offset, light);
+				else
+					return bandEnd(offset, light);
+			} else if (neg != LineWeight::NONE || pos != LineWeight::NONE) {
+				int ret = 0;
+				for (const auto perp: {neg, pos}) {
+					if (perp == LineWeight::DOUBLE)
+						ret = std::max(ret, bandEnd(d, light));
+					else if (perp != LineWeight::NONE)
+						ret = std::max(ret, bandEnd(0, thickness(perp)));
+				}
+				return ret;
+			}
+
+			return 0;
+		}
+	};
+
+	/// Returns a color `alpha` / 4 between `back` and `front`.
+	XftColor blend(const XftColor &front, const XftColor &back, const unsigned alpha) {
+		auto mix = [alpha](const unsigned short f, const unsigned short b) {
+			return static_cast<unsigned short>((f * alpha + b * (4 - alpha)) / 4);
+		};
+
+		XftColor ret = front;
+		ret.color.red   = mix(front.color.red,   back.color.red);
+		ret.color.green = mix(front.color.green, back.color.green);
+		ret.color.blue  = mix(front.color.blue,  back.color.blue);
+		return ret;
+	}
+
+} // end anon ns
+
+void BoxDrawing::draw(DrawBatch &batch, const Rune rune, const DrawPos pos, const Extent cell,
+		const XftColor &fg, const XftColor &bg) {
+	m_batch = &batch;
+	m_front = &fg;
+	m_back = &bg;
+	m_origin = pos;
+
+	if (cell != m_cell) {
+		m_cell = cell;
+		m_light = std::max(1, (std::min(cell.width, cell.height) + 4) / 8);
+		m_heavy = m_light * 2;
+		m_double_offset = m_light;
+	}
+
+	if (rune < 0x2580) {
+		drawBox(rune);
+	} else if (rune < 0x25A0) {
+		drawBlock(rune);
+	} else if (rune >= 0x2800 && rune < 0x2900) {
+		drawBraille(rune);
+	} else {
+		drawPowerline(rune);
+	}
+}
+
+void BoxDrawing::rect(const int x, const int y, const int width, const int height) {
+	rect(*m_front, x, y, width, height);
+}
+
+void BoxDrawing::rect(const XftColor &color, const int x, const int y, const int width, const int height) {
+	m_batch->addForeground(color, m_origin.atRight(x).atBelow(y), Extent{width, height});
+}
+
+void BoxDrawing::drawBox(const Rune rune) {
+	const auto &spec = BOX_SPECS[rune - 0x2500];
+	const LineMetrics lm{m_light, m_heavy, m_double_offset};
+	const int w = m_cell.width;
+	const int h = m_cell.height;
+	// the cell center
+	const int cx = w / 2;
+	const int cy = h / 2;
+
+	switch (spec.special) {
+		case Special::DIAG_RISING:
+			return drawDiagonal(true);
+		case Special::DIAG_FALLING:
+			return drawDiagonal(false);
+		case Special::DIAG_CROSS:
+			drawDiagonal(true);
+			return drawDiagonal(false);
+		default:
+			break;
+	}
+
+	if (spec.dashes != 0) {
+		const int num = spec.dashes;
+
+		if (spec.left != LineWeight::NONE) {
+			const int t = lm.thickness(spec.left);
+			const int gap = std::max(1, w / num / 3);
+			for (int i = 0; i < num; i++) {
+				const int x1 = i * w / num;
+				const int x2 = (i + 1) * w / num - gap;
+				rect(x1, cy + lm.bandBegin(0, t), x2 - x1, t);
+			}
+		} else {
+			const int t = lm.thickness(spec.up);
+			const int gap = std::max(1, h / num / 3);
+			for (int i = 0; i < num; i++) {
+				const int y1 = i * h / num;
+				const int y2 = (i + 1) * h / num - gap;
+				rect(cx + lm.bandBegin(0, t), y1, t, y2 - y1);
+			}
+		}
+
+		return;
+	}
+
+	// draws all strokes of an arm of the given weight, `fn` is called
+	// for each stroke offset and thickness.
+	auto forStrokes = [&lm](const LineWeight weight, auto fn) {
+		if (weight == LineWeight::NONE) {
+			return;
+		} else if (weight == LineWeight::DOUBLE) {
+			fn(-lm.double_offset, lm.light);
+			fn( lm.double_offset, lm.light);
+		} else {
+			fn(0, lm.thickness(weight));
+		}
+	};
+
+	forStrokes(spec.left, [&](const int offset, const int t) {
+		const int end = cx + lm.armEnd(offset, spec.left, spec.up, spec.down);
+		rect(0, cy + lm.bandBegin(offset, t), end, t);
+	});
+
+	forStrokes(spec.right, [&](const int offset, const int t) {
+		const int start = cx + lm.armStart(offset, spec.right, spec.up, spec.down);
+		rect(start, cy + lm.bandBegin(offset, t), w - start, t);
+	});
+
+	forStrokes(spec.up, [&](const int offset, const int t) {
+		const int end = cy + lm.armEnd(offset, spec.up, spec.left, spec.right);
+		rect(cx + lm.bandBegin(offset, t), 0, t, end);
+	});
+
+	forStrokes(spec.down, [&](const int offset, const int t) {
+		const int start = cy + lm.armStart(offset, spec.down, spec.left, spec.right);
+		rect(cx + lm.bandBegin(offset, t), start, t, h - start);
+	});
+}
+
+void BoxDrawing::drawDiagonal(const bool rising) {
+	const int w = m_cell.width;
+	const int h = m_cell.height;
+	// make sure the line is continuous for steep angles
+	const int stroke = std::max(m_light, (w + h - 1) / h);
+
+	for (int y = 0; y < h; y++) {
+		const int x = (rising ? h - 1 - y : y) * w / h;
+		rect(std::min(x, w - stroke), y, stroke, 1);
+	}
+}
+
+void BoxDrawing::drawBlock(const Rune rune) {
+	const int w = m_cell.width;
+	const int h = m_cell.height;
+
+	if (rune == 0x2580) { // upper half block
+		rect(0, 0, w, h / 2);
+	} else if (rune <= 0x2588) { // lower one eighth block ... full block
+		const int height = std::max(1, h * static_cast<int>(rune - 0x2580) / 8);
+		rect(0, h - height, w, height);
+	} else if (rune <= 0x258F) { // left seven eighths block ... left one eighth block
+		const int width = std::max(1, w * static_cast<int>(0x2590 - rune) / 8);
+		rect(0, 0, width, h);
+	} else if (rune == 0x2590) { // right half block
+		rect(w / 2, 0, w - w / 2, h);
+	} else if (rune <= 0x2593) { // light, medium and dark shade
+		rect(blend(*m_front, *m_back, rune - 0x2590), 0, 0, w, h);
+	} else if (rune == 0x2594) { // upper one eighth block
+		rect(0, 0, w, std::max(1, h / 8));
+	} else if (rune == 0x2595) { // right one eighth block
+		const int width = std::max(1, w / 8);
+		rect(w - width, 0, width, h);
+	} else { // quadrants
+		enum : unsigned { UL = 1, UR = 2, LL = 4, LR = 8 };
+		constexpr unsigned QUADRANTS[] = {
+			LL,           // U+2596 ▖
+			LR,           // U+2597 ▗
+			UL,           // U+2598 ▘
+			UL | LL | LR, // U+2599 ▙
+			UL | LR,      // U+259A ▚
+			UL | UR | LL, // U+259B ▛
+			UL | UR | LR, // U+259C ▜
+			UR,           // U+259D ▝
+			UR | LL,      // U+259E ▞
+			UR | LL | LR, // U+259F ▟
+		};
+		const auto quadrants = QUADRANTS[rune - 0x2596];
+		const int cx = w / 2;
+		const int cy = h / 2;
+
+		if (quadrants & UL)
+			rect(0, 0, cx, cy);
+		if (quadrants & UR)
+			rect(cx, 0, w - cx, cy);
+		if (quadrants & LL)
+			rect(0, cy, cx, h - cy);
+		if (quadrants & LR)
+			rect(cx, cy, w - cx, h - cy);
+	}
+}
+
+void BoxDrawing::drawBraille(const Rune rune) {
+	// (column, row) of the dots for the individual pattern bits
+	constexpr std::pair<int, int> DOTS[8] = {
+		{0, 0}, {0, 1}, {0, 2}, {1, 0}, {1, 1}, {1, 2}, {0, 3}, {1, 3}
+	};
+	const int w = m_cell.width;
+	const int h = m_cell.height;
+	const int grid_width = w / 2;
+	const int grid_height = h / 4;
+	const int size = std::max(1, (std::min(grid_width, grid_height) + 1) / 2);
+	const auto pattern = rune - 0x2800;
+
+	for (size_t bit = 0; bit < std::size(DOTS); bit++) {
+		if ((pattern & (1 << bit)) == 0)
+			continue;
+
+		const auto [col, row] = DOTS[bit];
+		rect(
+			col * w / 2 + (grid_width - size) / 2,
+			row * h / 4 + (grid_height - size) / 2,
+			size, size);
+	}
+}
+
+void BoxDrawing::drawPowerline(const Rune rune) {
+	const int w = m_cell.width;
+	const int h = m_cell.height;
+	const bool solid = rune == 0xE0B0 || rune == 0xE0B2;
+	const bool points_right = rune == 0xE0B0 || rune == 0xE0B1;
+	// make sure the outline is continuous for steep angles
+	const int stroke = std::max(m_light, (2 * w + h - 1) / h);
+
+	for (int y = 0; y < h; y++) {
+		// distance from the tip row in half pixels
+		const int dist = std::abs(2 * y + 1 - h);
+		const int width = std::max(1, w * (h - dist) / h);
+
+		if (solid) {
+			rect(points_right ? 0 : w - width, y, width, 1);
+		} else {
+			const int x = points_right ? width - stroke : w - width;
+			rect(std::clamp(x, 0, w - stroke), y, stroke, 1);
+		}
+	}
+}
+
+} // end ns
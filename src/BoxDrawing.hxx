@@ -0,0 +1,88 @@
+#pragma once
+
+// C++
+#include <cstdint>
+
+// X11
+#include <X11/Xft/Xft.h>
+
+// nst
+#include "fwd.hxx"
+#include "types.hxx"
+
+/**
+ * @file
+ *
+ * Procedural rendering of box drawing and related glyphs.
+ **/
+
+namespace nst {
+
+class DrawBatch;
+
+/// Draws box drawing, block element, braille and Powerline glyphs using plain rectangles.
+/**
+ * These characters are commonly used by text user interfaces and shell
+ * prompts to render borders, bars and graphs. When they are rendered via
+ * fonts then often fontconfig fallback fonts need to be looked up for them,
+ * whose metrics don't match the terminal cell size, causing gaps between
+ * adjacent cells.
+ *
+ * This type instead generates pixel exact rectangles for these characters,
+ * sized to the terminal cell extent. The rectangles are recorded in the
+ * frame's DrawBatch, thus they are drawn together with all other foreground
+ * rectangles.
+ *
+ * Supported are the Unicode blocks "Box Drawing" (U+2500 - U+257F, arcs are
+ * drawn as square corners), "Block Elements" (U+2580 - U+259F), "Braille
+ * Patterns" (U+2800 - U+28FF) and the Powerline arrow symbols (U+E0B0 -
+ * U+E0B3).
+ **/
+class BoxDrawing {
+public: // functions
+
+	/// Returns whether the given Rune is drawn procedurally.
+	static bool handles(const Rune rune) {
+		return (rune >= 0x2500 && rune <= 0x259F) ||
+			(rune >= 0x2800 && rune <= 0x28FF) ||
+			(rune >= 0xE0B0 && rune <= 0xE0B3);
+	}
+
+	/// Record the rectangles making up `rune` in the cell at `pos` into `batch`.
+	/**
+	 * \param[in] cell The extent of the cell the rune is drawn into.
+	 * \param[in] fg The color used for drawing.
+	 * \param[in] bg The background color of the cell, used for blending
+	 * shade characters.
+	 **/
+	void draw(DrawBatch &batch, const Rune rune, const DrawPos pos, const Extent cell,
+			const XftColor &fg, const XftColor &bg);
+
+protected: // functions
+
+	/// Adds a rectangle relative to the current cell origin.
+	void rect(const int x, const int y, const int width, const int height);
+
+	/// Adds a rectangle using the given color relative to the current cell origin.
+	void rect(const XftColor &color, const int x, const int y, const int width, const int height);
+
+	/// Draw a character from the "Box Drawing" block.
+	void drawBox(const Rune rune);
+	void drawDiagonal(const bool rising);
+	void drawBlock(const Rune rune);
+	void drawBraille(const Rune rune);
+	void drawPowerline(const Rune rune);
+
+protected: // data
+
+	DrawBatch *m_batch = nullptr;
+	const XftColor *m_front = nullptr;
+	const XftColor *m_back = nullptr;
+	DrawPos m_origin;
+	Extent m_cell;
+	int m_light = 1; ///< thickness of light lines
+	int m_heavy = 2; ///< thickness of heavy lines
+	int m_double_offset = 1; ///< distance of double line strokes from the center
+};
+
+} // end ns
@@ -0,0 +1,55 @@
+// nst
+#include "ClusterTable.hxx"
+#include "codecs.hxx"
+
+namespace nst {
+
+std::optional<Rune> ClusterTable::intern(const Sequence &seq) {
+	if (auto it = m_ids.find(seq); it != m_ids.end()) {
+		return it->second;
+	}
+
+	size_t index;
+
+	if (!m_free_ids.empty()) {
+		index = m_free_ids.back();
+		m_free_ids.pop_back();
+		m_clusters[index] = seq;
+		m_is_free[index] = false;
+	} else if (m_clusters.size() < MAX_CLUSTERS) {
+		index = m_clusters.size();
+		m_clusters.push_back(seq);
+		m_is_free.push_back(false);
+	} else {
+		return std::nullopt;
+	}
+
+	const auto rune = static_cast<Rune>(FIRST_RUNE + index);
+	m_ids[seq] = rune;
+	return rune;
+}
+
+void ClusterTable::encode(const Glyph &glyph, std::string &out) const {
+	if (!glyph.isCluster()) {
+		utf8::encode(glyph.rune, out);
+		return;
+	}
+
+	for (const auto cp: (*this)[glyph.rune]) {
+		utf8::encode(static_cast<Rune>(cp), out);
+	}
+}
+
+void ClusterTable::collect(const std::vector<bool> &in_use) {
+	for (size_t index = 0; index < m_clusters.size(); index++) {
+		if (in_use[index] || m_is_free[index])
+			continue;
+
+		m_ids.erase(m_clusters[index]);
+		m_clusters[index].clear();
+		m_is_free[index] = true;
+		m_free_ids.push_back(index);
+	}
+}
+
+} // end ns
@@ -0,0 +1,104 @@
+#pragma once
+
+// C++
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// nst
+#include "Glyph.hxx"
+
+namespace nst {
+
+/// Per-terminal table of grapheme clusters displayed in a single cell.
+/**
+ * A Glyph only has room for a single code point. Combining marks, variation
+ * selectors, emoji ZWJ sequences and regional indicator pairs need to be
+ * displayed together with a base character in the same cell, though. Such
+ * sequences are rare, so instead of widening every Glyph the complete
+ * sequence is interned in this table and the Glyph carries the CLUSTER flag
+ * and a handle to the table entry in its `rune` field.
+ *
+ * Handles are taken from Unicode plane 15 (Supplementary Private Use
+ * Area-A). This way they can be stored in CompressedLines and the
+ * HistoryArchive like any other code point, and code that only looks at
+ * `Glyph::rune` without knowing about clusters (e.g. word snapping) treats
+ * them like an opaque printable character.
+ *
+ * Like the StyleTable entries are not reference counted, instead unused
+ * entries are garbage collected via Term::collectClusters() once
+ * needsCollection() returns true. If the table is exhausted then further
+ * combining characters are dropped.
+ **/
+class ClusterTable {
+public: // types
+
+	using Sequence = std::u32string;
+
+public: // data
+
+	/// The rune used as handle for the first table entry.
+	static constexpr Rune FIRST_RUNE = 0xF0000;
+
+	/// The maximum number of clusters, limited by the size of the private use plane.
+	static constexpr size_t MAX_CLUSTERS = 0xFFFE;
+
+	/// The maximum number of code points stored for a single cell, excess ones are dropped.
+	static constexpr size_t MAX_LENGTH = 16;
+
+	/// The number of allocated clusters after which a collection should be performed.
+	static constexpr size_t COLLECT_THRESHOLD = MAX_CLUSTERS / 4 * 3;
+
+public: // functions
+
+	/// Returns the handle for `seq`, adding a new entry if necessary.
+	/**
+	 * If the table is exhausted then std::nullopt is returned.
+	 **/
+	std::optional<Rune> intern(const Sequence &seq);
+
+	/// Returns the code points for a handle previously returned from intern().
+	const Sequence& operator[](const Rune rune) const {
+		return m_clusters[toIndex(rune)];
+	}
+
+	/// Returns the table index for the given handle.
+	static size_t toIndex(const Rune rune) {
+		return rune - FIRST_RUNE;
+	}
+
+	/// Appends the UTF-8 encoded code points displayed by `glyph` to `out`.
+	void encode(const Glyph &glyph, std::string &out) const;
+
+	/// Returns the number of clusters currently allocated.
+	size_t size() const {
+		return m_clusters.size() - m_free_ids.size();
+	}
+
+	/// Returns the number of handles currently addressable, including unused ones.
+	size_t capacity() const {
+		return m_clusters.size();
+	}
+
+	/// Returns whether a garbage collection run should be performed.
+	bool needsCollection() const {
+		return size() >= COLLECT_THRESHOLD;
+	}
+
+	/// Release all entries that are not marked in `in_use`.
+	/**
+	 * `in_use` needs to be sized according to capacity() and is indexed
+	 * via toIndex().
+	 **/
+	void collect(const std::vector<bool> &in_use);
+
+protected: // data
+
+	std::vector<Sequence> m_clusters; ///< the code point sequences indexed by toIndex()
+	std::vector<bool> m_is_free; ///< marks entries in m_clusters that are currently unused
+	std::vector<size_t> m_free_ids; ///< released indices available for reuse
+	std::unordered_map<Sequence, Rune> m_ids; ///< reverse lookup of allocated clusters
+};
+
+} // end ns
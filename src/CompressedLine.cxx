@@ -0,0 +1,154 @@
+// C++
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+// nst
+#include "CompressedLine.hxx"
+#include "codecs.hxx"
+
+namespace nst {
+
+std::unique_ptr<CompressedLine> CompressedLine::encode(const GlyphVector &glyphs) {
+	auto ret = std::make_unique<CompressedLine>();
+	ret->m_size = static_cast<uint32_t>(glyphs.size());
+
+	size_t stored = glyphs.size();
+
+	// trim trailing blanks that look like the very last Glyph
+	if (!glyphs.empty() && glyphs.back().isEmpty()) {
+		const auto &last = glyphs.back();
+		ret->m_fill = last;
+
+		while (stored > 0) {
+			const auto &g = glyphs[stored - 1];
+			if (!g.isEmpty() || g.featuresDiffer(last))
+				break;
+			stored--;
+		}
+	}
+
+	ret->m_stored = static_cast<uint32_t>(stored);
+	ret->m_text.reserve(stored);
+
+	for (auto it = glyphs.begin(); it < glyphs.begin() + stored; it++) {
+		const auto &g = *it;
+
+		if (!isEncodable(g.rune))
+			return nullptr;
+
+		utf8::encode(g.rune, ret->m_text);
+
+		if (ret->m_spans.empty() || !ret->m_spans.back().matches(g)) {
+			ret->m_spans.push_back(AttrSpan{0, g.style, g.flags});
+		}
+
+		ret->m_spans.back().count++;
+	}
+
+	ret->m_text.shrink_to_fit();
+	ret->m_spans.shrink_to_fit();
+
+	return ret;
+}
+
+void CompressedLine::decode(GlyphVector &glyphs) const {
+	glyphs.resize(m_size);
+
+	const std::string_view text{m_text};
+	size_t text_pos = 0;
+	auto span = m_spans.begin();
+	uint32_t span_left = span != m_spans.end() ? span->count : 0;
+
+	for (auto it = glyphs.begin(); it < glyphs.begin() + m_stored; it++) {
+		auto &g = *it;
+
+		while (span_left == 0) {
+			span++;
+			span_left = span->count;
+		}
+
+		if (const auto byte = static_cast<unsigned char>(text[text_pos]); byte < 0x80) {
+			// fast path for plain ASCII
+			g.rune = byte;
+			text_pos++;
+		} else {
+			text_pos += utf8::decode(text.substr(text_pos), g.rune);
+		}
+
+		g.style = span->style;
+		g.flags = span->flags;
+		span_left--;
+	}
+
+	std::fill(glyphs.begin() + m_stored, glyphs.end(), m_fill);
+}
+
+void CompressedLine::serialize(std::string &out) const {
+	const SerialHeader header{m_size, m_stored,
+		static_cast<uint32_t>(m_text.size()),
+		static_cast<uint32_t>(m_spans.size()),
+		m_fill};
+
+	out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.append(m_text);
+	out.append(reinterpret_cast<const char*>(m_spans.data()), m_spans.size() * sizeof(AttrSpan));
+}
+
+std::unique_ptr<CompressedLine> CompressedLine::deserialize(const std::string_view data) {
+	SerialHeader header;
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	auto ret = std::make_unique<CompressedLine>();
+	ret->m_size = header.size;
+	ret->m_stored = header.stored;
+	ret->m_fill = header.fill;
+
+	auto pos = sizeof(header);
+	ret->m_text.assign(data.substr(pos, header.text_len));
+	pos += header.text_len;
+
+	ret->m_spans.resize(header.num_spans);
+	std::memcpy(ret->m_spans.data(), data.data() + pos, header.num_spans * sizeof(AttrSpan));
+
+	return ret;
+}
+
+void CompressedLine::collectRunes(const Glyph::Attr flag, std::vector<Rune> &out) const {
+	const auto has_flag = std::any_of(m_spans.begin(), m_spans.end(),
+			[flag](const AttrSpan &span) { return span.flags[flag]; });
+
+	if (!has_flag)
+		return;
+
+	const std::string_view text{m_text};
+	size_t text_pos = 0;
+
+	for (const auto &span: m_spans) {
+		for (uint32_t i = 0; i < span.count; i++) {
+			Rune rune;
+			text_pos += utf8::decode(text.substr(text_pos), rune);
+
+			if (span.flags[flag]) {
+				out.push_back(rune);
+			}
+		}
+	}
+}
+
+Glyph::AttrBitMask CompressedLine::flagsAt(const size_t index) const {
+	if (index >= m_stored)
+		return m_fill.flags;
+
+	size_t start = 0;
+
+	for (const auto &span: m_spans) {
+		start += span.count;
+		if (index < start)
+			return span.flags;
+	}
+
+	return m_fill.flags;
+}
+
+} // end ns
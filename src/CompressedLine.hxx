@@ -0,0 +1,132 @@
+#pragma once
+
+// C++
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// nst
+#include "Glyph.hxx"
+#include "GlyphPool.hxx"
+
+namespace nst {
+
+/// Compact representation of the Glyphs of a Line that is part of the scrollback history.
+/**
+ * A regular Line stores a full width vector of Glyphs, including trailing
+ * blanks and hidden columns (see Line). With large history sizes this
+ * consumes a lot of memory, although most of it are spaces using default
+ * attributes.
+ *
+ * This type stores the runes of a Line as UTF-8 encoded text and the
+ * rendering attributes as a list of run length encoded spans. Trailing
+ * blank Glyphs that are identical to the last Glyph of the Line are not
+ * stored at all but recreated from a template Glyph during decoding.
+ *
+ * Lines are compressed by the Screen once they leave the visible area and
+ * are decompressed on demand when they are accessed again.
+ **/
+class CompressedLine {
+public: // types
+
+	/// A series of consecutive Glyphs sharing the same attributes.
+	struct AttrSpan {
+		uint32_t count = 0; ///< number of Glyphs covered by this span
+		StyleID style = Glyph::DEFAULT_STYLE;
+		Glyph::AttrBitMask flags;
+
+		bool matches(const Glyph &g) const {
+			return g.style == style && g.flags == flags;
+		}
+	};
+
+public: // functions
+
+	/// Encode the given Glyphs into a new CompressedLine.
+	/**
+	 * If the Glyphs cannot be represented losslessly (e.g. due to runes
+	 * that cannot be encoded in UTF-8) then nullptr is returned and the
+	 * Line needs to stay uncompressed.
+	 **/
+	static std::unique_ptr<CompressedLine> encode(const GlyphVector &glyphs);
+
+	/// Returns whether the given rune survives a round trip through the UTF-8 codec.
+	static bool isEncodable(const Rune rune) {
+		return rune <= 0x10FFFF && !(rune >= 0xD800 && rune <= 0xDFFF);
+	}
+
+	/// Restore the original Glyphs into `glyphs`, replacing its previous content.
+	void decode(GlyphVector &glyphs) const;
+
+	/// Appends a flat binary representation of this object to `out`.
+	/**
+	 * This is used for storing lines outside of the process's heap, see
+	 * HistoryArchive. The format is only meant to be read back by the
+	 * same process via deserialize().
+	 **/
+	void serialize(std::string &out) const;
+
+	/// Recreates a CompressedLine from data previously produced by serialize().
+	static std::unique_ptr<CompressedLine> deserialize(const std::string_view data);
+
+	/// Returns the number of Glyphs originally encoded.
+	size_t size() const { return m_size; }
+
+	/// Returns the per-cell flags of the Glyph at the given index.
+	Glyph::AttrBitMask flagsAt(const size_t index) const;
+
+	/// Returns the UTF-8 encoded runes of all Glyphs apart from trimmed trailing blanks.
+	const std::string& text() const { return m_text; }
+
+	/// Returns the number of bytes occupied by this object including heap allocations.
+	size_t memoryUsage() const {
+		return sizeof(*this) + m_text.capacity() + m_spans.capacity() * sizeof(AttrSpan);
+	}
+
+	/// Invokes `func` for each StyleID referenced by this line, possibly repeatedly for the same ID.
+	template <typename FUNC>
+	void forEachStyle(FUNC func) const {
+		for (const auto &span: m_spans) {
+			func(span.style);
+		}
+
+		func(m_fill.style);
+	}
+
+	/// Marks all StyleIDs referenced by this line in `in_use`.
+	void markStyles(std::vector<bool> &in_use) const {
+		forEachStyle([&in_use](const StyleID id) {
+			in_use[id] = true;
+		});
+	}
+
+	/// Appends the runes of all Glyphs carrying `flag` to `out`.
+	/**
+	 * This is used for finding the ClusterTable entries referenced by
+	 * the line without expanding it.
+	 **/
+	void collectRunes(const Glyph::Attr flag, std::vector<Rune> &out) const;
+
+protected: // types
+
+	/// Fixed size header of the serialized representation.
+	struct SerialHeader {
+		uint32_t size;
+		uint32_t stored;
+		uint32_t text_len;
+		uint32_t num_spans;
+		Glyph fill;
+	};
+
+protected: // data
+
+	std::string m_text; ///< UTF-8 encoded runes of the stored Glyphs
+	std::vector<AttrSpan> m_spans; ///< run length encoded attributes of the stored Glyphs
+	Glyph m_fill; ///< template for the trimmed trailing Glyphs
+	uint32_t m_stored = 0; ///< number of Glyphs represented in m_text and m_spans
+	uint32_t m_size = 0; ///< total number of encoded Glyphs, including the trimmed ones
+};
+
+} // end ns
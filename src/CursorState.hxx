@@ -38,7 +38,7 @@ protected: // data
 	static ColorIndex m_def_fg;
 	static ColorIndex m_def_bg;
 	CharPos pos;   ///< current cursor position (not yet rendered)
-	Glyph m_attrs; ///< contains the currently active font attributes for newly input characters
+	GlyphStyle m_attrs; ///< contains the currently active font attributes for newly input characters
 	StateBitMask m_state;
 
 public: // functions
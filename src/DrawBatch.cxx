@@ -0,0 +1,134 @@
+// C++
+#include <algorithm>
+#include <iterator>
+
+// nst
+#include "DrawBatch.hxx"
+
+namespace nst {
+
+namespace {
+
+	XRectangle to_rect(const DrawPos pos, const Extent ext) {
+		return XRectangle{
+			static_cast<short>(pos.x),
+			static_cast<short>(pos.y),
+			static_cast<unsigned short>(ext.width),
+			static_cast<unsigned short>(ext.height)
+		};
+	}
+
+} // end anon ns
+
+void DrawBatch::RectGroup::add(const DrawPos pos, const Extent ext) {
+	if (ext.width <= 0 || ext.height <= 0)
+		return;
+
+	rects.push_back(to_rect(pos, ext));
+}
+
+template <typename GROUP>
+GROUP& DrawBatch::groupFor(std::vector<GROUP> &groups, const XftColor &color) {
+	GROUP *unused = nullptr;
+
+	for (auto &group: groups) {
+		if (sameColor(group.color, color)) {
+			return group;
+		} else if (!unused && group.empty()) {
+			unused = &group;
+		}
+	}
+
+	if (unused) {
+		// recycle a group that was used by a different color in an
+		// earlier frame
+		unused->color = color;
+		return *unused;
+	}
+
+	auto &ret = groups.emplace_back();
+	ret.color = color;
+	return ret;
+}
+
+void DrawBatch::addBackground(const XftColor &color, const DrawPos pos, const Extent ext) {
+	groupFor(m_backgrounds, color).add(pos, ext);
+	m_pending = true;
+}
+
+void DrawBatch::addForeground(const XftColor &color, const DrawPos pos, const Extent ext) {
+	groupFor(m_foregrounds, color).add(pos, ext);
+	m_pending = true;
+}
+
+void DrawBatch::addSpecs(const XftColor &color,
+		GlyphFontSpecVector::const_iterator start,
+		GlyphFontSpecVector::const_iterator end) {
+	auto &specs = groupFor(m_specs, color).specs;
+	// specs without font are procedurally drawn glyphs, see BoxDrawing
+	std::copy_if(start, end, std::back_inserter(specs),
+			[](const GlyphFontSpec &spec) { return spec.font != nullptr; });
+	m_pending = true;
+}
+
+void DrawBatch::addClip(const DrawPos pos, const Extent ext) {
+	if (!m_clip.empty()) {
+		// merge horizontally adjacent areas on the same row, this is
+		// the common case when a line is drawn run by run.
+		auto &last = m_clip.back();
+		if (last.y == pos.y && last.height == ext.height && last.x + last.width == pos.x) {
+			last.width += static_cast<unsigned short>(ext.width);
+			m_pending = true;
+			return;
+		}
+	}
+
+	m_clip.push_back(to_rect(pos, ext));
+	m_pending = true;
+}
+
+void DrawBatch::flush(FontDrawContext &ctx) {
+	if (!m_pending)
+		return;
+
+	// backgrounds also cover border areas, thus draw them without clipping
+	for (auto &group: m_backgrounds) {
+		ctx.fillRects(group.color, group.rects);
+	}
+
+	// Set the clip region because Xft is sometimes dirty.
+	if (!m_clip.empty()) {
+		ctx.setClipRectangles(m_clip);
+	}
+
+	for (auto &group: m_specs) {
+		ctx.drawSpecs(group.color, group.specs);
+	}
+
+	for (auto &group: m_foregrounds) {
+		ctx.fillRects(group.color, group.rects);
+	}
+
+	if (!m_clip.empty()) {
+		ctx.resetClip();
+	}
+
+	clear();
+}
+
+void DrawBatch::clear() {
+	for (auto &group: m_backgrounds) {
+		group.clear();
+	}
+	for (auto &group: m_specs) {
+		group.clear();
+	}
+	for (auto &group: m_foregrounds) {
+		group.clear();
+	}
+
+	m_clip.clear();
+	m_pending = false;
+}
+
+} // end ns
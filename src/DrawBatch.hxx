@@ -0,0 +1,126 @@
+#pragma once
+
+// C++
+#include <vector>
+
+// X11
+#include <X11/Xft/Xft.h>
+
+// nst
+#include "font.hxx"
+#include "types.hxx"
+
+/**
+ * @file
+ *
+ * Frame level collection of X drawing requests.
+ **/
+
+namespace nst {
+
+/// Collects the drawing operations of a frame and issues them in few X requests.
+/**
+ * Drawing a frame used to result in a handful of X requests for each run of
+ * equally attributed Glyphs: background rectangle, clip setup, glyph
+ * rendering, underline and strike through rectangles and clip reset, as well as window border cleanup.
+ * On busy screens this amounts to thousands of requests per frame.
+ *
+ * This type instead records the operations of a frame grouped by color and
+ * flushes them in a fixed order:
+ *
+ * - all background rectangles, one XRender FillRectangles request per color.
+ * - the union of all drawn cell areas as a single clip region.
+ * - all glyph specs, one XftDrawGlyphFontSpec call per color (Xft batches
+ *   the different fonts internally).
+ * - all foreground rectangles (underline, strike through, procedurally
+ *   drawn glyphs) per color.
+ *
+ * Since the cell areas drawn during a frame never overlap each other the
+ * reordering doesn't change the visible result, apart from glyph overhang
+ * into neighbouring cells that are redrawn in the same frame.
+ *
+ * Colors are recorded by value. The XftColor pixel values stay valid until
+ * the flush on TrueColor visuals, which is the only kind of visual nst is
+ * used with in practice.
+ **/
+class DrawBatch {
+public: // functions
+
+	/// Record a background fill of the given area.
+	void addBackground(const XftColor &color, const DrawPos pos, const Extent ext);
+
+	/// Record a foreground rectangle like underline, strike through or procedurally drawn glyphs.
+	void addForeground(const XftColor &color, const DrawPos pos, const Extent ext);
+
+	/// Record glyph specs to be drawn in the given color.
+	/**
+	 * Specs that carry no font are skipped, these are procedurally drawn
+	 * via BoxDrawing.
+	 **/
+	void addSpecs(const XftColor &color,
+			GlyphFontSpecVector::const_iterator start,
+			GlyphFontSpecVector::const_iterator end);
+
+	/// Add the given cell area to the clip region used for glyphs and foreground rectangles.
+	void addClip(const DrawPos pos, const Extent ext);
+
+	/// Returns whether no operations are pending.
+	bool empty() const { return !m_pending; }
+
+	/// Issue all recorded operations on `ctx` and reset the batch.
+	void flush(FontDrawContext &ctx);
+
+	/// Drops all recorded operations without drawing them.
+	void clear();
+
+protected: // types
+
+	/// A group of rectangles to be filled with the same color.
+	struct RectGroup {
+		XftColor color;
+		std::vector<XRectangle> rects;
+
+		bool empty() const { return rects.empty(); }
+		void clear() { rects.clear(); }
+		void add(const DrawPos pos, const Extent ext);
+	};
+
+	/// A group of glyph specs to be drawn in the same color.
+	struct SpecGroup {
+		XftColor color;
+		GlyphFontSpecVector specs;
+
+		bool empty() const { return specs.empty(); }
+		void clear() { specs.clear(); }
+	};
+
+protected: // functions
+
+	/// Returns the group in `groups` matching `color`, creating one if necessary.
+	/**
+	 * Groups are not freed after a flush, only their contents are
+	 * cleared, so that their allocations can be reused during the next
+	 * frame. The number of different colors per frame is typically small,
+	 * thus a linear search is sufficient.
+	 **/
+	template <typename GROUP>
+	GROUP& groupFor(std::vector<GROUP> &groups, const XftColor &color);
+
+	static bool sameColor(const XftColor &a, const XftColor &b) {
+		return a.pixel == b.pixel &&
+			a.color.red == b.color.red &&
+			a.color.green == b.color.green &&
+			a.color.blue == b.color.blue &&
+			a.color.alpha == b.color.alpha;
+	}
+
+protected: // data
+
+	std::vector<RectGroup> m_backgrounds;
+	std::vector<SpecGroup> m_specs;
+	std::vector<RectGroup> m_foregrounds;
+	std::vector<XRectangle> m_clip; ///< union of all drawn cell areas
+	bool m_pending = false; ///< whether any operations have been recorded since the last flush
+};
+
+} // end ns
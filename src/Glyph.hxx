@@ -1,5 +1,8 @@
 #pragma once
 
+// C++
+#include <cstdint>
+
 // cosmos
 #include "cosmos/BitMask.hxx"
 
@@ -8,12 +11,28 @@
 
 namespace nst {
 
-/// Code, color and attribute information for a single character position on the terminal.
+/// Identifier of a GlyphStyle stored in the StyleTable.
+using StyleID = uint16_t;
+
+/// Code, style and per-cell flags for a single character position on the terminal.
+/**
+ * To keep the memory footprint of screen and history lines small, the
+ * rendering attributes (markup and colors) are not stored directly in each
+ * Glyph. Instead they're interned in the terminal's StyleTable and a Glyph
+ * only stores a 16-bit StyleID. Only the attributes that are inherently tied
+ * to an individual cell (WRAP, WIDE, WDUMMY, CLUSTER) are kept inline in
+ * `flags`.
+ *
+ * Cells that display more than one code point (a base character with
+ * combining marks, emoji ZWJ sequences, flags) carry the CLUSTER flag. Their
+ * `rune` then is a handle into the terminal's ClusterTable instead of a
+ * code point.
+ **/
 struct Glyph {
 public: // types
 
 	/// Glyph rendering attributes
-	enum class Attr {
+	enum class Attr : uint16_t {
 		NONE       = 0,
 		BOLD       = 1 << 0,
 		FAINT      = 1 << 1,
@@ -25,29 +44,95 @@ public: // types
 		STRUCK     = 1 << 7,
 		WRAP       = 1 << 8, ///< an automatic line wrap was inserted at this position (can only occur at the end of a line)
 		WIDE       = 1 << 9, ///< whether the Glyph spans multiple columns
-		WDUMMY     = 1 << 10 ///< for wide UTF8 characters this is a dummy placeholder position (a following, blocked column)
+		WDUMMY     = 1 << 10, ///< for wide UTF8 characters this is a dummy placeholder position (a following, blocked column)
+		CLUSTER    = 1 << 11  ///< `rune` refers to a sequence of code points in the ClusterTable
 	};
 
 	using AttrBitMask = cosmos::BitMask<Attr>;
 
+	/// The StyleID of the default GlyphStyle, which is always present in the StyleTable.
+	static constexpr StyleID DEFAULT_STYLE = 0;
+
 public: // data
 
-	Rune rune = 0;    ///< character code
-	AttrBitMask mode; ///< attribute flags
+	Rune rune = 0;                 ///< character code
+	StyleID style = DEFAULT_STYLE; ///< rendering attributes, see StyleTable
+	AttrBitMask flags;             ///< per-cell flags, only WRAP, WIDE, WDUMMY and CLUSTER are used here
+
+public: // functions
+
+	bool featuresDiffer(const Glyph &other) const {
+		return style != other.style || flags != other.flags;
+	}
+
+	/// Turn this Glyph into an empty cell using the given erase style.
+	void clear(const StyleID erase_style) {
+		style = erase_style;
+		flags.reset();
+		rune = ' ';
+	}
+
+	bool isSameRune(const Glyph &other) const {
+		return rune == other.rune;
+	}
+
+	/// Replace all flags by WDUMMY, reset rune
+	void makeDummy() {
+		flags = AttrBitMask{Attr::WDUMMY};
+		rune = '\0';
+	}
+
+	/// returns whether the Glyph is "empty", currently meaning "space"
+	bool isEmpty()         const { return rune == ' '; }
+	bool hasValue()        const { return !isEmpty(); }
+	bool isDummy()         const { return flags[Attr::WDUMMY]; }
+	bool isWide()          const { return flags[Attr::WIDE]; }
+	bool isWrapped()       const { return flags[Attr::WRAP]; }
+	bool isCluster()       const { return flags[Attr::CLUSTER]; }
+
+	void setWrapped()      { flags.set(Attr::WRAP); }
+	void setWide()         { flags.set(Attr::WIDE); }
+	void setCluster()      { flags.set(Attr::CLUSTER); }
+
+	void resetWide()    { flags.reset(Attr::WIDE); }
+	void resetDummy()   { flags.reset(Attr::WDUMMY); }
+	void resetCluster() { flags.reset(Attr::CLUSTER); }
+
+	size_t width() const { return isWide() ? 2 : 1; }
+};
+
+/// Shorthand for attribute queries
+using Attr = Glyph::Attr;
+
+/// Markup and color attributes shared by many Glyphs.
+/**
+ * A screen typically only uses a few dozen different combinations of these
+ * attributes, thus they're interned in the StyleTable and Glyphs only refer
+ * to them via their StyleID.
+ **/
+struct GlyphStyle {
+public: // data
+
+	Glyph::AttrBitMask mode; ///< attribute flags (without the per-cell flags found in Glyph)
 	ColorIndex fg = ColorIndex::INVALID; ///< foreground color
 	ColorIndex bg = ColorIndex::INVALID; ///< background color
 
 public: // functions
 
+	bool operator==(const GlyphStyle &other) const {
+		return mode == other.mode && fg == other.fg && bg == other.bg;
+	}
+
+	bool operator!=(const GlyphStyle &other) const {
+		return !(*this == other);
+	}
+
 	bool isFgTrueColor() const {
 		return is_true_color(fg);
 	}
 	bool isBgTrueColor() const {
 		return is_true_color(bg);
 	}
-	bool featuresDiffer(const Glyph &other) const {
-		return mode != other.mode || fg != other.fg || bg != other.bg;
-	}
 	bool needBrightColor() const {
 		return mode[Attr::BOLD] && !mode[Attr::FAINT];
 	}
@@ -61,45 +146,19 @@ public: // functions
 		return ColorIndex{cosmos::to_integral(fg) + 8};
 	}
 
-	void clear(const Glyph &templ) {
-		fg = templ.fg;
-		bg = templ.bg;
-		mode.reset();
-		rune = ' ';
-	}
-
-	bool isSameRune(const Glyph &other) const {
-		return rune == other.rune;
-	}
-
-	/// Replace all attributes by WDUMMY, reset rune
-	void makeDummy() {
-		mode = AttrBitMask{Attr::WDUMMY};
-		rune = '\0';
+	/// Returns the style to use for erased cells: the same colors but no markup.
+	GlyphStyle eraseStyle() const {
+		GlyphStyle ret{*this};
+		ret.mode.reset();
+		return ret;
 	}
 
-	/// returns whether the Glyph is "empty", currently meaning "space"
-	bool isEmpty()         const { return rune == ' '; }
-	bool hasValue()        const { return !isEmpty(); }
-	bool isDummy()         const { return mode[Attr::WDUMMY]; }
-	bool isWide()          const { return mode[Attr::WIDE]; }
-	bool isWrapped()       const { return mode[Attr::WRAP]; }
 	bool isUnderlined()    const { return mode[Attr::UNDERLINE]; }
 	bool isStruck()        const { return mode[Attr::STRUCK]; }
 	bool isBlinking()      const { return mode[Attr::BLINK]; }
 	bool useReverseColor() const { return mode[Attr::REVERSE]; }
 
-	void setWrapped()      { mode.set(Attr::WRAP); }
-	void setWide()         { mode.set(Attr::WIDE); }
 	void setReverseColor() { mode.set(Attr::REVERSE); }
-
-	void resetWide()    { mode.reset(Attr::WIDE); }
-	void resetDummy()   { mode.reset(Attr::WDUMMY); }
-
-	size_t width() const { return isWide() ? 2 : 1; }
 };
 
-/// Shorthand for attribute queries
-using Attr = Glyph::Attr;
-
 } // end ns
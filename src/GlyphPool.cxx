@@ -0,0 +1,70 @@
+// C++
+#include <new>
+
+// nst
+#include "GlyphPool.hxx"
+
+namespace nst {
+
+GlyphPool& GlyphPool::instance() {
+	// intentionally never destroyed, Lines may still release their
+	// storage during static destruction
+	static auto pool = new GlyphPool{};
+	return *pool;
+}
+
+GlyphPool::GlyphPool() :
+		m_free_lists(sizeClass(MAX_BLOCK) + 1, nullptr) {
+}
+
+void* GlyphPool::allocate(const size_t bytes) {
+	if (bytes > MAX_BLOCK) {
+		return ::operator new(bytes);
+	} else if (bytes == 0) {
+		return nullptr;
+	}
+
+	const auto cls = sizeClass(bytes);
+	std::lock_guard<std::mutex> guard{m_lock};
+
+	if (auto block = m_free_lists[cls]; block) {
+		m_free_lists[cls] = block->next;
+		return block;
+	}
+
+	const auto block_size = (cls + 1) * SLAB_SIZE;
+
+	if (static_cast<size_t>(m_chunk_end - m_chunk_pos) < block_size) {
+		newChunk();
+	}
+
+	auto ret = m_chunk_pos;
+	m_chunk_pos += block_size;
+	return ret;
+}
+
+void GlyphPool::deallocate(void *ptr, const size_t bytes) {
+	if (bytes > MAX_BLOCK) {
+		::operator delete(ptr);
+		return;
+	} else if (!ptr) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard{m_lock};
+	pushFree(ptr, sizeClass(bytes));
+}
+
+void GlyphPool::newChunk() {
+	// the chunk size is a multiple of SLAB_SIZE, so the remainder always
+	// fits into a size class
+	if (const auto left = static_cast<size_t>(m_chunk_end - m_chunk_pos); left != 0) {
+		pushFree(m_chunk_pos, sizeClass(left));
+	}
+
+	m_chunks.emplace_back(new char[CHUNK_SIZE]);
+	m_chunk_pos = m_chunks.back().get();
+	m_chunk_end = m_chunk_pos + CHUNK_SIZE;
+}
+
+} // end ns
@@ -0,0 +1,114 @@
+#pragma once
+
+// C++
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// nst
+#include "Glyph.hxx"
+
+namespace nst {
+
+/// Arena for the Glyph storage of Lines.
+/**
+ * Every Line owns a vector of Glyphs. With a large scrollback buffer this
+ * results in a lot of small heap allocations of similar size, which are
+ * released and requested again all the time when lines are compressed,
+ * expanded and reused in the Screen's ring buffer.
+ *
+ * This pool carves blocks out of large chunks of memory. Block sizes are
+ * rounded up to a multiple of SLAB_SIZE, released blocks are kept in a free
+ * list per size class and handed out again for the next request of the same
+ * class. This way the Glyphs of lines allocated in a row are located next
+ * to each other in memory, and a long-lived terminal reuses the same
+ * blocks instead of fragmenting the heap. Requests larger than MAX_BLOCK
+ * are served from the regular heap.
+ *
+ * Memory once acquired by the pool is not returned to the system, the
+ * number of lines in use is bounded by the size of the scrollback buffer
+ * anyway.
+ **/
+class GlyphPool {
+public: // data
+
+	/// Granularity of block sizes in bytes.
+	static constexpr size_t SLAB_SIZE = 256;
+	/// Largest block size served from the pool, in bytes.
+	static constexpr size_t MAX_BLOCK = 64 * SLAB_SIZE;
+	/// Size of the chunks blocks are carved from, in bytes.
+	static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+public: // functions
+
+	/// Returns the process wide pool instance.
+	static GlyphPool& instance();
+
+	void* allocate(const size_t bytes);
+
+	void deallocate(void *ptr, const size_t bytes);
+
+protected: // types
+
+	/// A released block, linked into the free list of its size class.
+	struct FreeBlock {
+		FreeBlock *next = nullptr;
+	};
+
+protected: // functions
+
+	GlyphPool();
+
+	/// Returns the size class for a block of `bytes`, the class `n` holds blocks of `(n + 1) * SLAB_SIZE` bytes.
+	static size_t sizeClass(const size_t bytes) {
+		return (bytes + SLAB_SIZE - 1) / SLAB_SIZE - 1;
+	}
+
+	void pushFree(void *ptr, const size_t cls) {
+		auto block = new (ptr) FreeBlock{m_free_lists[cls]};
+		m_free_lists[cls] = block;
+	}
+
+	/// Acquires a new chunk, the remainder of the current one is added to the free lists.
+	void newChunk();
+
+protected: // data
+
+	/// Protects the pool, Lines are also expanded and released in IPC worker threads, see HistorySnapshot.
+	std::mutex m_lock;
+	std::vector<FreeBlock*> m_free_lists; ///< released blocks per size class
+	std::vector<std::unique_ptr<char[]>> m_chunks; ///< all memory acquired so far
+	char *m_chunk_pos = nullptr; ///< next unused byte in the current chunk
+	char *m_chunk_end = nullptr; ///< end of the current chunk
+};
+
+/// Minimal allocator for standard containers that uses the GlyphPool.
+template <typename T>
+struct PoolAllocator {
+	using value_type = T;
+
+	PoolAllocator() = default;
+
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+
+	T* allocate(const size_t n) {
+		return static_cast<T*>(GlyphPool::instance().allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, const size_t n) {
+		GlyphPool::instance().deallocate(ptr, n * sizeof(T));
+	}
+
+	template <typename U>
+	bool operator==(const PoolAllocator<U>&) const { return true; }
+
+	template <typename U>
+	bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+/// The Glyph storage used in Lines.
+using GlyphVector = std::vector<Glyph, PoolAllocator<Glyph>>;
+
+} // end ns
@@ -0,0 +1,337 @@
+// C++
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// cosmos
+#include "cosmos/error/ApiError.hxx"
+#include "cosmos/proc/process.hxx"
+
+// nst
+#include "ClusterTable.hxx"
+#include "HistoryArchive.hxx"
+
+namespace nst {
+
+namespace {
+
+/// Replacement for runes that cannot be stored in compressed form.
+constexpr Rune REPLACEMENT_CHAR = 0xFFFD;
+
+} // end anon ns
+
+HistoryArchive::HistoryArchive(const size_t budget) :
+		m_num_slots{std::max(budget / SEGMENT_SIZE, size_t{2})} {
+	std::string dir{"/tmp"};
+
+	if (auto runtime_dir = cosmos::proc::get_env_var("XDG_RUNTIME_DIR"); runtime_dir != std::nullopt) {
+		dir = runtime_dir->str();
+	}
+
+	m_fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+
+	if (m_fd == -1) {
+		// not all file systems support O_TMPFILE, fall back to a
+		// regular temporary file that is unlinked right away.
+		auto path = dir + "/nst-history.XXXXXX";
+		m_fd = ::mkostemp(path.data(), O_CLOEXEC);
+
+		if (m_fd == -1) {
+			cosmos_throw (cosmos::ApiError("creating history archive file"));
+		}
+
+		::unlink(path.c_str());
+	}
+
+	const auto file_size = m_num_slots * SEGMENT_SIZE;
+
+	try {
+		if (::ftruncate(m_fd, static_cast<off_t>(file_size)) != 0) {
+			cosmos_throw (cosmos::ApiError("resizing history archive file"));
+		}
+
+		auto addr = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+		if (addr == MAP_FAILED) {
+			cosmos_throw (cosmos::ApiError("mapping history archive file"));
+		}
+
+		m_map = static_cast<const char*>(addr);
+	} catch (...) {
+		::close(m_fd);
+		throw;
+	}
+
+	clear();
+}
+
+HistoryArchive::~HistoryArchive() {
+	for (auto &seg: m_segments) {
+		unpin(seg);
+	}
+
+	::munmap(const_cast<char*>(m_map), m_num_slots * SEGMENT_SIZE);
+	::close(m_fd);
+}
+
+void HistoryArchive::append(const Line &line) {
+	if (m_disabled)
+		return;
+
+	const CompressedLine *compressed = line.compressed();
+	std::unique_ptr<CompressedLine> encoded;
+
+	if (!compressed) {
+		encoded = CompressedLine::encode(line.raw());
+
+		if (!encoded) {
+			m_glyphs = line.raw();
+
+			for (auto &glyph: m_glyphs) {
+				if (!CompressedLine::isEncodable(glyph.rune)) {
+					glyph.rune = REPLACEMENT_CHAR;
+				}
+			}
+
+			encoded = CompressedLine::encode(m_glyphs);
+		}
+
+		compressed = encoded.get();
+	}
+
+	m_buffer.clear();
+	compressed->serialize(m_buffer);
+
+	if (m_buffer.size() > SEGMENT_SIZE) {
+		// this requires a line with tens of thousands of columns.
+		// dropping it would change the index of all older lines,
+		// thus keep as much of it as fits instead.
+		const bool wrapped = line.isWrapped();
+		compressed->decode(m_glyphs);
+
+		while (m_buffer.size() > SEGMENT_SIZE) {
+			m_glyphs.resize(m_glyphs.size() / 2);
+
+			if (wrapped) {
+				m_glyphs.back().setWrapped();
+			}
+
+			encoded = CompressedLine::encode(m_glyphs);
+			m_buffer.clear();
+			encoded->serialize(m_buffer);
+		}
+
+		compressed = encoded.get();
+	}
+
+	auto &seg = reserve(m_buffer.size());
+	const auto offset = seg.slot * SEGMENT_SIZE + seg.used;
+
+	for (size_t written = 0; written < m_buffer.size(); ) {
+		const auto res = ::pwrite(m_fd, m_buffer.data() + written,
+				m_buffer.size() - written, static_cast<off_t>(offset + written));
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			// e.g. ENOSPC on a size limited tmpfs. Throwing here
+			// would tear down the terminal, instead give up on
+			// the archive. Clearing it keeps the numbering of the
+			// remaining history lines intact and releases the
+			// file's storage.
+			std::cerr << "nst: writing history archive file failed: " << std::strerror(errno)
+				<< ". Disabling the history archive.\n";
+			clear();
+			m_disabled = true;
+			return;
+		}
+
+		written += static_cast<size_t>(res);
+	}
+
+	if (seg.offsets.empty()) {
+		seg.first_line = m_next_line;
+	}
+
+	seg.offsets.push_back(static_cast<uint32_t>(seg.used));
+	seg.used += m_buffer.size();
+
+	compressed->forEachStyle([&seg](const StyleID id) {
+		seg.styles.push_back(id);
+	});
+
+	compressed->collectRunes(Attr::CLUSTER, seg.clusters);
+
+	compactIDs(seg.styles);
+	compactIDs(seg.clusters);
+
+	m_next_line++;
+	m_num_lines++;
+}
+
+void HistoryArchive::load(const size_t index, Line &line) const {
+	const auto seqnr = m_next_line - 1 - index;
+
+	// find the segment containing the line, segments are ordered by first_line
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), seqnr,
+			[](const size_t nr, const Segment &seg) {
+				return nr < seg.first_line;
+			});
+
+	const auto &seg = *(--it);
+	const auto entry = seqnr - seg.first_line;
+	const auto start = seg.offsets[entry];
+	const std::string_view data{m_map + seg.slot * SEGMENT_SIZE + start, seg.end(entry) - start};
+
+	line.assignCompressed(CompressedLine::deserialize(data));
+}
+
+HistoryArchive::Pin HistoryArchive::pin(const size_t oldest, const size_t count) const {
+	Pin ret;
+	auto seqnr = m_next_line - 1 - oldest;
+	const auto end = seqnr + count;
+
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), seqnr,
+			[](const size_t nr, const Segment &seg) {
+				return nr < seg.first_line;
+			});
+	it--;
+
+	while (seqnr < end) {
+		const auto &seg = *it++;
+
+		if (!seg.pinned) {
+			seg.pinned = std::make_shared<SegmentData>();
+			seg.pinned->data = m_map + seg.slot * SEGMENT_SIZE;
+		}
+
+		const auto from = seqnr - seg.first_line;
+		const auto to = std::min(seg.offsets.size(), end - seg.first_line);
+		auto &pinned = ret.m_segments.emplace_back(Pin::PinnedSegment{seg.pinned, ret.m_size, {}});
+
+		// the newest segment is still growing, thus copy the offsets
+		pinned.offsets.assign(seg.offsets.begin() + from, seg.offsets.begin() + to);
+		pinned.offsets.push_back(static_cast<uint32_t>(seg.end(to - 1)));
+
+		ret.m_size += to - from;
+		seqnr += to - from;
+	}
+
+	return ret;
+}
+
+void HistoryArchive::Pin::load(const size_t index, Line &line) const {
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), index,
+			[](const size_t nr, const PinnedSegment &seg) {
+				return nr < seg.first;
+			});
+
+	const auto &seg = *(--it);
+	const auto entry = index - seg.first;
+	const auto start = seg.offsets[entry];
+	std::lock_guard guard{seg.data->lock};
+	const std::string_view data{seg.data->data + start, seg.offsets[entry + 1] - start};
+
+	line.assignCompressed(CompressedLine::deserialize(data));
+}
+
+size_t HistoryArchive::bytes() const {
+	size_t ret = 0;
+
+	for (const auto &seg: m_segments) {
+		ret += seg.used;
+	}
+
+	return ret;
+}
+
+void HistoryArchive::clear() {
+	for (auto &seg: m_segments) {
+		unpin(seg);
+	}
+
+	m_segments.clear();
+	m_free_slots.clear();
+	m_num_lines = 0;
+
+	for (size_t slot = m_num_slots; slot > 0; slot--) {
+		m_free_slots.push_back(slot - 1);
+	}
+
+	// return the file's storage to the system, if supported
+	(void)::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			0, static_cast<off_t>(m_num_slots * SEGMENT_SIZE));
+}
+
+void HistoryArchive::markStyles(std::vector<bool> &in_use) const {
+	for (const auto &seg: m_segments) {
+		for (const auto id: seg.styles) {
+			in_use[id] = true;
+		}
+	}
+}
+
+void HistoryArchive::markClusters(std::vector<bool> &in_use) const {
+	for (const auto &seg: m_segments) {
+		for (const auto rune: seg.clusters) {
+			in_use[ClusterTable::toIndex(rune)] = true;
+		}
+	}
+}
+
+HistoryArchive::Segment& HistoryArchive::reserve(const size_t bytes) {
+	if (!m_segments.empty() && m_segments.back().used + bytes <= SEGMENT_SIZE) {
+		return m_segments.back();
+	}
+
+	if (m_free_slots.empty()) {
+		// evict the oldest segment
+		auto &oldest = m_segments.front();
+		unpin(oldest);
+		m_num_lines -= oldest.offsets.size();
+		m_free_slots.push_back(oldest.slot);
+		m_segments.pop_front();
+	}
+
+	auto &seg = m_segments.emplace_back(Segment{});
+	seg.slot = m_free_slots.back();
+	m_free_slots.pop_back();
+	return seg;
+}
+
+void HistoryArchive::unpin(Segment &seg) {
+	if (!seg.pinned)
+		return;
+
+	// only this thread hands out new references, thus if there are none
+	// left besides ours then this can't change anymore
+	if (seg.pinned.use_count() > 1) {
+		std::lock_guard guard{seg.pinned->lock};
+		seg.pinned->copy.assign(seg.pinned->data, seg.used);
+		seg.pinned->data = seg.pinned->copy.data();
+	}
+
+	seg.pinned.reset();
+}
+
+template <typename ID>
+void HistoryArchive::compactIDs(std::vector<ID> &ids) {
+	// typically only a handful of distinct styles or clusters are found
+	// in a segment. only compact before the vector would need to grow,
+	// this keeps the cost amortized.
+	if (ids.size() < 256 || ids.size() < ids.capacity())
+		return;
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+} // end ns
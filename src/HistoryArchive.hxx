@@ -0,0 +1,208 @@
+#pragma once
+
+// C++
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// nst
+#include "Glyph.hxx"
+#include "GlyphPool.hxx"
+#include "Line.hxx"
+
+namespace nst {
+
+/// Storage for scrollback history lines that dropped out of the Screen's ring buffer.
+/**
+ * The in-memory ring buffer of the Screen only holds a fixed number of
+ * history lines. When configured, lines that are about to be overwritten in
+ * the ring buffer are serialized in compressed form (see CompressedLine)
+ * into this archive instead of being lost.
+ *
+ * The archive data is stored in a temporary file which is created in
+ * $XDG_RUNTIME_DIR (or /tmp as a fallback) and which is never linked into
+ * the file system, thus it disappears together with the terminal process.
+ * The file is memory-mapped read-only for accessing archived lines, new
+ * lines are appended using regular write calls.
+ *
+ * The file is organized in fixed size segments that are used like a ring
+ * buffer. The total size is limited by the byte budget passed to the
+ * constructor. Once all segments are in use the oldest segment is evicted
+ * to make room for new lines. Only a small index of line offsets per
+ * segment is kept in memory.
+ *
+ * Lines are addressed by their distance from the newest archived line,
+ * i.e. index 0 is the line that dropped out of the ring buffer most
+ * recently.
+ *
+ * Ranges of archived lines can be pinned via pin() for reading them in
+ * other threads, without deserializing them upfront.
+ **/
+class HistoryArchive {
+protected: // types
+
+	struct SegmentData;
+
+public: // types
+
+	/// A range of archived lines that can be read from other threads.
+	/**
+	 * The lines stay accessible after they have been evicted from the
+	 * archive, or after the archive has been cleared or destroyed. The
+	 * data of a pinned segment is copied into memory before its space in
+	 * the archive file is reused.
+	 **/
+	class Pin {
+		friend class HistoryArchive;
+	public: // functions
+
+		/// Returns the number of pinned lines.
+		size_t size() const { return m_size; }
+
+		/// Restores the pinned line at the given index into `line`.
+		/**
+		 * Pinned lines are indexed oldest first. `line` will be in
+		 * compressed form afterwards. This can be called
+		 * concurrently for the same Pin.
+		 **/
+		void load(const size_t index, Line &line) const;
+
+	protected: // types
+
+		struct PinnedSegment {
+			std::shared_ptr<SegmentData> data;
+			size_t first = 0; ///< the index of the first line of this segment in the Pin
+			std::vector<uint32_t> offsets; ///< start offsets of the pinned lines, followed by the end offset of the last one
+		};
+
+	protected: // data
+
+		std::vector<PinnedSegment> m_segments;
+		size_t m_size = 0;
+	};
+
+public: // data
+
+	/// The size of a single segment in the archive file.
+	static constexpr size_t SEGMENT_SIZE = 256 * 1024;
+
+public: // functions
+
+	/// Creates a new archive file using at most `budget` bytes.
+	/**
+	 * The budget is rounded down to a multiple of SEGMENT_SIZE, but at
+	 * least two segments are used. On error a cosmos::ApiError is thrown.
+	 **/
+	explicit HistoryArchive(const size_t budget);
+
+	~HistoryArchive();
+
+	HistoryArchive(const HistoryArchive&) = delete;
+	HistoryArchive& operator=(const HistoryArchive&) = delete;
+
+	/// Adds `line` as the newest line to the archive.
+	/**
+	 * Lines are stored in compressed form. Runes that cannot be
+	 * compressed are replaced by U+FFFD. Lines that don't fit into a
+	 * single segment are truncated.
+	 *
+	 * If writing to the archive file fails (e.g. the file system is
+	 * full) then the archive is cleared and stays disabled, all further
+	 * lines are dropped.
+	 **/
+	void append(const Line &line);
+
+	/// Restores the archived line at the given index into `line`.
+	/**
+	 * `line` will be in compressed form afterwards. `index` needs to be
+	 * smaller than size().
+	 **/
+	void load(const size_t index, Line &line) const;
+
+	/// Pins `count` archived lines, starting at `oldest` and continuing towards newer lines.
+	/**
+	 * `oldest` is an index as in load(), `count` must not exceed
+	 * `oldest + 1`. Only the line offsets of the affected segments are
+	 * copied, the lines are deserialized on access via Pin::load().
+	 **/
+	Pin pin(const size_t oldest, const size_t count) const;
+
+	/// Returns the number of lines currently stored in the archive.
+	size_t size() const { return m_num_lines; }
+
+	bool empty() const { return m_num_lines == 0; }
+
+	/// Returns the number of bytes currently occupied in the archive file.
+	size_t bytes() const;
+
+	/// Removes all lines from the archive.
+	void clear();
+
+	/// Marks all StyleIDs referenced by archived lines in `in_use`.
+	/**
+	 * This doesn't access the archive file, the StyleIDs of each segment
+	 * are tracked in memory.
+	 **/
+	void markStyles(std::vector<bool> &in_use) const;
+
+	/// Marks all ClusterTable entries referenced by archived lines in `in_use`.
+	/**
+	 * Like with markStyles() the cluster handles are tracked in memory
+	 * per segment.
+	 **/
+	void markClusters(std::vector<bool> &in_use) const;
+
+protected: // types
+
+	/// The data of a segment shared with Pins.
+	struct SegmentData {
+		std::mutex lock; ///< protects `data` from being switched to `copy` while it is read
+		const char *data = nullptr; ///< the segment in the archive file's mapping, or copy.data()
+		std::string copy; ///< the segment's data once it has been evicted while pinned
+	};
+
+	/// In-memory bookkeeping for a segment of the archive file.
+	struct Segment {
+		size_t slot = 0; ///< the position of the segment in the file in units of SEGMENT_SIZE
+		size_t first_line = 0; ///< the sequence number of the first line stored in the segment
+		size_t used = 0; ///< the number of bytes used in the segment
+		std::vector<uint32_t> offsets; ///< start offsets of the lines stored in the segment
+		std::vector<StyleID> styles; ///< StyleIDs referenced by lines in the segment, may contain duplicates
+		std::vector<Rune> clusters; ///< ClusterTable handles referenced by lines in the segment, may contain duplicates
+		mutable std::shared_ptr<SegmentData> pinned; ///< shared with Pins, if any
+
+		size_t end(const size_t index) const {
+			return index + 1 < offsets.size() ? offsets[index + 1] : used;
+		}
+	};
+
+protected: // functions
+
+	/// Makes room for `bytes` of data in the newest segment, evicting old segments as necessary.
+	Segment& reserve(const size_t bytes);
+
+	/// Copies the data of `seg` into memory if it is still pinned, before its slot is reused.
+	void unpin(Segment &seg);
+
+	/// Drops duplicate entries from the per-segment `ids`, if they became large.
+	template <typename ID>
+	static void compactIDs(std::vector<ID> &ids);
+
+protected: // data
+
+	int m_fd = -1; ///< file descriptor of the archive file
+	const char *m_map = nullptr; ///< read-only mapping of the archive file
+	size_t m_num_slots = 0; ///< the number of segments the file can hold
+	std::deque<Segment> m_segments; ///< segments in use, oldest first
+	std::vector<size_t> m_free_slots; ///< slots in the file not used by any segment
+	size_t m_next_line = 0; ///< the sequence number the next appended line will get
+	size_t m_num_lines = 0; ///< the number of lines stored in m_segments
+	bool m_disabled = false; ///< set after writing to the archive file failed
+	std::string m_buffer; ///< scratch buffer for serializing lines
+	GlyphVector m_glyphs; ///< scratch buffer for sanitizing lines that cannot be compressed
+};
+
+} // end ns
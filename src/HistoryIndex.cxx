@@ -0,0 +1,323 @@
+// C++
+#include <algorithm>
+
+// nst
+#include "ClusterTable.hxx"
+#include "HistoryIndex.hxx"
+#include "Screen.hxx"
+
+namespace nst {
+
+namespace {
+
+/// Approximate memory used for a posting list, apart from its entries.
+constexpr size_t POSTING_OVERHEAD = sizeof(uint32_t) + sizeof(std::vector<size_t>) + 2 * sizeof(void*);
+
+/// Minimum number of stale entries before sweep() bothers to go through all posting lists.
+constexpr size_t MIN_SWEEP_ENTRIES = 64 * 1024;
+
+void to_lower_ascii(std::string &text, const size_t from) {
+	for (auto it = text.begin() + from; it != text.end(); it++) {
+		if (*it >= 'A' && *it <= 'Z') {
+			*it = static_cast<char>(*it - 'A' + 'a');
+		}
+	}
+}
+
+uint32_t trigram_at(const std::string &text, const size_t pos) {
+	return static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16 |
+		static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8 |
+		static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+}
+
+} // end anon ns
+
+void HistoryIndex::update(const Screen &screen, const ClusterTable &clusters) {
+	// lines that can still be renumbered by scrolling back into not yet
+	// rewrapped history lines must not be in the index, otherwise
+	// candidates() would report wrong sequence numbers.
+	dropBefore(screen.stableSeq());
+
+	if (m_next_seq < m_min_seq) {
+		// lines have been dropped before we saw them, e.g. the
+		// history has been cleared
+		m_next_seq = m_min_seq;
+		m_continued = false;
+	}
+
+	for (const auto end = screen.screenSeq(); m_next_seq < end; m_next_seq++) {
+		addRow(m_next_seq, screen.lineAtSeq(m_next_seq, m_buffer), clusters);
+	}
+
+	if (bytesFor(m_entries - m_stale_entries) > m_budget) {
+		// drop a larger batch at once, to avoid sweeping all posting
+		// lists for every new line
+		shrinkTo(m_budget / 4 * 3);
+	} else {
+		sweep();
+	}
+}
+
+void HistoryIndex::reset(const size_t next_seq) {
+	m_postings.clear();
+	m_lines.clear();
+	m_entries = 0;
+	m_stale_entries = 0;
+	m_min_seq = m_next_seq = m_open_seq = next_seq;
+	m_continued = false;
+	m_text.clear();
+}
+
+void HistoryIndex::addRow(const size_t seq, const Line &line, const ClusterTable &clusters) {
+	if (!m_continued) {
+		m_open_seq = seq;
+		m_text.clear();
+	} else if (m_open_seq < m_min_seq) {
+		// the beginning of this logical line has already been dropped
+		// from the index, searches cover it completely anyway
+		m_continued = line.isWrapped();
+		return;
+	}
+
+	if (line.isCompressed()) {
+		m_expanded.assignExpanded(line);
+	}
+
+	const auto &row = line.isCompressed() ? m_expanded : line;
+	const auto start = m_text.size();
+	const size_t used = row.empty() ? 0 : row.usedLength();
+
+	// this needs to match the text HistorySearch sees
+	for (size_t col = 0; col < used; col++) {
+		if (const auto &glyph = row[col]; !glyph.isDummy()) {
+			clusters.encode(glyph, m_text);
+		}
+	}
+
+	to_lower_ascii(m_text, start);
+
+	// trigrams spanning the wrap are included via the tail of the
+	// previous row kept at the start of m_text
+	for (size_t pos = 0; pos + 3 <= m_text.size(); pos++) {
+		addTrigram(trigram_at(m_text, pos));
+	}
+
+	m_continued = row.isWrapped();
+
+	if (m_continued && m_text.size() > 2) {
+		m_text.erase(0, m_text.size() - 2);
+	}
+}
+
+void HistoryIndex::addTrigram(const uint32_t trigram) {
+	auto &list = m_postings[trigram];
+
+	// entries are added in ascending order, so duplicates within a line
+	// can only be found at the end
+	if (!list.empty() && list.back() == m_open_seq)
+		return;
+
+	list.push_back(m_open_seq);
+
+	if (m_lines.empty() || m_lines.back().seq != m_open_seq) {
+		m_lines.push_back(IndexedLine{m_open_seq, 0});
+	}
+
+	m_lines.back().entries++;
+	m_entries++;
+}
+
+void HistoryIndex::shrinkTo(const size_t bytes) {
+	while (!m_lines.empty() && bytesFor(m_entries - m_stale_entries) > bytes) {
+		m_stale_entries += m_lines.front().entries;
+		m_lines.pop_front();
+	}
+
+	m_min_seq = m_lines.empty() ? m_next_seq : m_lines.front().seq;
+
+	sweep(/*force=*/true);
+}
+
+void HistoryIndex::dropBefore(const size_t seq) {
+	if (seq <= m_min_seq)
+		return;
+
+	while (!m_lines.empty() && m_lines.front().seq < seq) {
+		m_stale_entries += m_lines.front().entries;
+		m_lines.pop_front();
+	}
+
+	m_min_seq = seq;
+}
+
+void HistoryIndex::sweep(const bool force) {
+	if (!force && (m_stale_entries < MIN_SWEEP_ENTRIES || m_stale_entries < m_entries / 4))
+		return;
+
+	for (auto it = m_postings.begin(); it != m_postings.end(); ) {
+		auto &list = it->second;
+		list.erase(list.begin(), std::lower_bound(list.begin(), list.end(), m_min_seq));
+
+		if (list.empty()) {
+			it = m_postings.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	m_entries -= m_stale_entries;
+	m_stale_entries = 0;
+}
+
+size_t HistoryIndex::bytesFor(const size_t entries) const {
+	return entries * sizeof(size_t) + m_postings.size() * POSTING_OVERHEAD + m_lines.size() * sizeof(IndexedLine);
+}
+
+std::optional<HistoryIndex::Candidates> HistoryIndex::candidates(const std::string &pattern, const bool fixed_string) const {
+	const auto literals = fixed_string ? std::vector<std::string>{pattern} : requiredLiterals(pattern);
+	std::vector<uint32_t> trigrams;
+
+	for (auto literal: literals) {
+		to_lower_ascii(literal, 0);
+
+		for (size_t pos = 0; pos + 3 <= literal.size(); pos++) {
+			trigrams.push_back(trigram_at(literal, pos));
+		}
+	}
+
+	if (trigrams.empty())
+		return std::nullopt;
+
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+	Candidates ret;
+	ret.begin = m_min_seq;
+	ret.end = std::max(m_min_seq, completeSeq());
+
+	std::vector<const std::vector<size_t>*> lists;
+
+	for (const auto trigram: trigrams) {
+		const auto it = m_postings.find(trigram);
+
+		if (it == m_postings.end()) {
+			// no line in the index can match
+			return ret;
+		}
+
+		lists.push_back(&it->second);
+	}
+
+	// start out with the shortest list to keep intermediate results small
+	std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b) {
+		return a->size() < b->size();
+	});
+
+	const auto &shortest = *lists.front();
+	ret.seqs.assign(
+			std::lower_bound(shortest.begin(), shortest.end(), ret.begin),
+			std::lower_bound(shortest.begin(), shortest.end(), ret.end));
+
+	std::vector<size_t> remaining;
+
+	for (auto it = lists.begin() + 1; it != lists.end() && !ret.seqs.empty(); it++) {
+		const auto &list = **it;
+		remaining.clear();
+		std::set_intersection(ret.seqs.begin(), ret.seqs.end(), list.begin(), list.end(), std::back_inserter(remaining));
+		ret.seqs.swap(remaining);
+	}
+
+	return ret;
+}
+
+HistoryIndex::Usage HistoryIndex::usage() const {
+	return Usage{m_lines.size(), m_postings.size(), bytesFor(m_entries)};
+}
+
+std::vector<std::string> HistoryIndex::requiredLiterals(const std::string &pattern) {
+	// this only understands the top-level concatenation of the pattern,
+	// anything more complex is skipped, which only makes the set of
+	// candidates larger.
+	std::vector<std::string> ret;
+	std::string run;
+	size_t depth = 0;
+
+	auto flush = [&ret, &run]() {
+		if (run.size() >= 3) {
+			ret.push_back(run);
+		}
+		run.clear();
+	};
+
+	for (size_t pos = 0; pos < pattern.size(); pos++) {
+		const auto ch = pattern[pos];
+
+		if (ch == '\\') {
+			// escape sequences can be character classes, assertions
+			// or back references, treat them as unknown
+			flush();
+			pos++;
+			continue;
+		} else if (ch == '[') {
+			flush();
+			// skip the bracket expression, a leading ']' is literal
+			pos++;
+			if (pos < pattern.size() && pattern[pos] == '^')
+				pos++;
+			if (pos < pattern.size() && pattern[pos] == ']')
+				pos++;
+			for (; pos < pattern.size() && pattern[pos] != ']'; pos++) {
+				if (pattern[pos] == '\\')
+					pos++;
+			}
+			continue;
+		} else if (depth != 0) {
+			// group contents might be optional or alternatives
+			if (ch == '(')
+				depth++;
+			else if (ch == ')')
+				depth--;
+			continue;
+		}
+
+		switch (ch) {
+			case '|':
+				// alternatives on the top level, nothing is required
+				return {};
+			case '(':
+				flush();
+				depth++;
+				break;
+			case '?':
+			case '*':
+			case '{':
+				// the preceding byte is optional
+				if (!run.empty())
+					run.pop_back();
+				flush();
+				if (ch == '{') {
+					pos = std::min(pattern.find('}', pos), pattern.size());
+				}
+				break;
+			case '+':
+				// the preceding byte is required, but might be repeated
+				flush();
+				break;
+			case '.':
+			case '^':
+			case '$':
+			case ')':
+				flush();
+				break;
+			default:
+				run.push_back(ch);
+				break;
+		}
+	}
+
+	flush();
+
+	return ret;
+}
+
+} // end ns
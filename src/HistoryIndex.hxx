@@ -0,0 +1,148 @@
+#pragma once
+
+// C++
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// nst
+#include "Line.hxx"
+
+namespace nst {
+
+class ClusterTable;
+class Screen;
+
+/// Trigram index over the scrollback history for narrowing down searches.
+/**
+ * For every logical line in the history (i.e. screen rows joined across
+ * automatic line wraps) the index records which trigrams (sequences of
+ * three bytes of the UTF-8 encoded text) occur in it. Lines are identified
+ * by the sequence number of their first row, see Screen::historySeq(). For
+ * each trigram a posting list of the lines containing it is kept in
+ * ascending order. ASCII letters are indexed in lower case, so that the
+ * index can also be used for case insensitive searches.
+ *
+ * The index is updated incrementally via update() whenever lines leave the
+ * screen and become part of the history. Lines that drop out of the history
+ * are pruned lazily, as are lines that rewrapping can still renumber (see
+ * Screen::stableSeq()). The memory used by the index is limited to the budget
+ * passed to the constructor. Once it is exhausted the oldest lines are
+ * removed from the index, even if they are still present in the history.
+ *
+ * A search pattern can be turned into a set of candidate lines via
+ * candidates(). Lines outside of the range covered by the index need to be
+ * searched completely, and candidates need to be verified, since the index
+ * only tells which lines possibly match.
+ **/
+class HistoryIndex {
+public: // types
+
+	/// The result of a candidates() query.
+	struct Candidates {
+		/// The range [begin, end) of sequence numbers covered by the index.
+		/**
+		 * Logical lines starting in this range that are not
+		 * listed in `seqs` can't match the pattern.
+		 **/
+		size_t begin = 0;
+		size_t end = 0;
+		std::vector<size_t> seqs; ///< sequence numbers of the lines possibly matching the pattern
+	};
+
+	/// Statistics about the index as reported via IPC.
+	struct Usage {
+		size_t lines = 0; ///< number of logical lines in the index
+		size_t trigrams = 0; ///< number of distinct trigrams
+		size_t bytes = 0; ///< approximate memory used in bytes
+	};
+
+public: // functions
+
+	/// Creates an empty index using approximately at most `budget` bytes.
+	explicit HistoryIndex(const size_t budget) :
+			m_budget{budget} {}
+
+	/// Adds history lines of `screen` that haven't been indexed yet and prunes lines that are gone.
+	/**
+	 * This is supposed to be called after lines have been scrolled into
+	 * the history of the main screen.
+	 **/
+	void update(const Screen &screen, const ClusterTable &clusters);
+
+	/// Discards the index contents and continues indexing at the given sequence number.
+	/**
+	 * This is necessary when lines have been renumbered, e.g. by
+	 * rewrapping them.
+	 **/
+	void reset(const size_t next_seq);
+
+	/// Returns the lines possibly matching the given search pattern.
+	/**
+	 * If `fixed_string` is unset then the pattern is interpreted as an
+	 * ECMAScript regular expression. If no trigrams can be derived from
+	 * the pattern then `std::nullopt` is returned and the complete
+	 * history needs to be searched.
+	 **/
+	std::optional<Candidates> candidates(const std::string &pattern, const bool fixed_string) const;
+
+	Usage usage() const;
+
+protected: // types
+
+	/// A logical line in the index.
+	struct IndexedLine {
+		size_t seq = 0; ///< the sequence number of its first row
+		size_t entries = 0; ///< the number of posting list entries referring to it
+	};
+
+protected: // functions
+
+	/// Adds the trigrams of the given row.
+	void addRow(const size_t seq, const Line &line, const ClusterTable &clusters);
+
+	/// Adds an entry for the current logical line to the posting list of `trigram`.
+	void addTrigram(const uint32_t trigram);
+
+	/// Removes lines from the front of m_lines until the index fits into `bytes`.
+	void shrinkTo(const size_t bytes);
+
+	/// Removes lines starting before `seq` from the index.
+	void dropBefore(const size_t seq);
+
+	/// Removes posting list entries that refer to dropped lines, if worthwhile.
+	void sweep(const bool force = false);
+
+	/// Returns the literal strings that need to be part of every match of the regular expression `pattern`.
+	static std::vector<std::string> requiredLiterals(const std::string &pattern);
+
+	/// Returns the approximate memory used by the index for the given number of entries.
+	size_t bytesFor(const size_t entries) const;
+
+	/// Returns the sequence number after the last logical line that is completely indexed.
+	size_t completeSeq() const {
+		// the last line might continue on the screen
+		return m_continued ? m_open_seq : m_next_seq;
+	}
+
+protected: // data
+
+	size_t m_budget = 0; ///< maximum number of bytes to use
+	/// Posting lists of sequence numbers for each trigram.
+	std::unordered_map<uint32_t, std::vector<size_t>> m_postings;
+	std::deque<IndexedLine> m_lines; ///< all lines currently in the index, oldest first
+	size_t m_entries = 0; ///< total number of entries in m_postings
+	size_t m_stale_entries = 0; ///< number of entries in m_postings referring to dropped lines
+	size_t m_min_seq = 0; ///< the index covers all logical lines starting at this sequence number
+	size_t m_next_seq = 0; ///< the sequence number of the next row to index
+	size_t m_open_seq = 0; ///< the sequence number of the logical line the last indexed row belongs to
+	bool m_continued = false; ///< whether the last indexed row wrapped, i.e. the next row continues its logical line
+	std::string m_text; ///< buffer for encoding rows, starts with the tail of the previous row if m_continued
+	Line m_buffer{/*keep_data_on_shrink=*/true}; ///< buffer for loading archived lines
+	Line m_expanded{/*keep_data_on_shrink=*/true}; ///< buffer for expanding compressed lines
+};
+
+} // end ns
@@ -0,0 +1,305 @@
+// C++
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+// nst
+#include "HistorySearch.hxx"
+
+namespace nst {
+
+namespace {
+
+/// The minimum number of lines processed by a single worker thread.
+constexpr size_t MIN_CHUNK_LINES = 16 * 1024;
+
+/// The maximum number of chunks processed in parallel for a single search.
+constexpr size_t MAX_WORKERS = 8;
+
+/// The number of logical lines after which a chunk checks whether it can stop early.
+constexpr size_t EARLY_OUT_INTERVAL = 256;
+
+bool equal_ignore_case(const char a, const char b) {
+	return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+}
+
+} // end anon ns
+
+HistorySearch::HistorySearch(std::shared_ptr<const HistorySnapshot> snapshot,
+		const std::string &pattern, const uint32_t flags, const size_t limit) :
+			m_snapshot{std::move(snapshot)},
+			m_pattern{pattern},
+			m_ignore_case{(flags & static_cast<uint32_t>(Flag::IGNORE_CASE)) != 0},
+			m_fixed_string{(flags & static_cast<uint32_t>(Flag::FIXED_STRING)) != 0},
+			m_limit{limit} {
+	if (!m_fixed_string) {
+		auto syntax = std::regex::ECMAScript | std::regex::optimize;
+		if (m_ignore_case)
+			syntax |= std::regex::icase;
+		m_regex = std::regex{m_pattern, syntax};
+	}
+
+	// lines() would load archived lines, which is left to run()
+	m_spans.push_back(Span{0, m_snapshot->size()});
+}
+
+void HistorySearch::restrict(const size_t begin, const size_t end, const std::vector<size_t> &seqs) {
+	const auto num_lines = m_snapshot->size();
+	auto to_index = [this, num_lines](const size_t seq) {
+		return std::clamp(seq, m_snapshot->beginSeq(), m_snapshot->beginSeq() + num_lines) - m_snapshot->beginSeq();
+	};
+
+	const auto first = to_index(begin);
+	const auto last = to_index(end);
+
+	m_spans.clear();
+	m_spans.push_back(Span{0, first});
+
+	for (const auto seq: seqs) {
+		if (const auto index = to_index(seq); index >= first && index < last) {
+			m_spans.push_back(Span{index, index + 1});
+		}
+	}
+
+	m_spans.push_back(Span{last, num_lines});
+}
+
+std::vector<HistorySearch::Chunk> HistorySearch::partition(const size_t threads) const {
+	size_t total = 0;
+
+	for (const auto &span: m_spans) {
+		total += span.end - span.begin;
+	}
+
+	const size_t cpus = std::max(std::thread::hardware_concurrency(), 1U);
+	const auto workers = std::clamp(total / MIN_CHUNK_LINES, size_t{1}, std::min({cpus, threads, MAX_WORKERS}));
+	const auto per_chunk = std::max((total + workers - 1) / workers, size_t{1});
+	std::vector<Chunk> ret(1);
+	size_t assigned = 0;
+
+	// spans are split at arbitrary lines, logical lines are processed by
+	// the chunk they start in
+	for (auto span: m_spans) {
+		while (span.begin < span.end) {
+			if (assigned == per_chunk) {
+				ret.emplace_back();
+				assigned = 0;
+			}
+
+			const auto len = std::min(span.end - span.begin, per_chunk - assigned);
+			ret.back().push_back(Span{span.begin, span.begin + len});
+			span.begin += len;
+			assigned += len;
+		}
+	}
+
+	return ret;
+}
+
+std::vector<HistorySearch::Match> HistorySearch::run(WorkerPool *pool) const {
+	// queued tasks might only run after we returned, thus they share
+	// ownership of the state
+	auto state = std::make_shared<RunState>(partition(pool ? pool->size() : 1));
+	const auto num_chunks = state->chunks.size();
+	size_t self_done = 0;
+
+	if (pool) {
+		for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+			// a task that doesn't get to claim its chunk won't access
+			// `this` anymore
+			pool->submit([this, state, chunk]() {
+				if (state->claimed[chunk].exchange(true))
+					return;
+
+				processChunk(*state, chunk);
+				std::lock_guard guard{state->lock};
+				state->pool_done++;
+				state->cond.notify_one();
+			});
+		}
+	}
+
+	// the calling thread processes all chunks not claimed by the pool,
+	// this way no chunk depends on a free pool thread (the calling thread
+	// typically is one of the pool's threads itself)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		if (state->claimed[chunk].exchange(true))
+			continue;
+
+		processChunk(*state, chunk);
+		self_done++;
+	}
+
+	{
+		std::unique_lock lock{state->lock};
+		state->cond.wait(lock, [&]() { return self_done + state->pool_done == num_chunks; });
+	}
+
+	for (auto &error: state->errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	std::vector<Match> ret;
+
+	for (auto &result: state->results) {
+		for (auto &match: result) {
+			if (ret.size() >= m_limit)
+				return ret;
+			ret.push_back(std::move(match));
+		}
+	}
+
+	return ret;
+}
+
+std::string HistorySearch::runAsText(WorkerPool *pool) const {
+	std::string ret;
+
+	for (const auto &match: run(pool)) {
+		ret += std::to_string(match.seq);
+		ret += ':';
+		ret += std::to_string(match.column);
+		ret += ':';
+		ret += match.text;
+		ret += '\n';
+	}
+
+	return ret;
+}
+
+void HistorySearch::processChunk(RunState &state, const size_t chunk) const {
+	try {
+		searchChunk(chunk, state.chunks[chunk], state.found, state.results[chunk]);
+	} catch (...) {
+		// e.g. std::regex can fail on complex patterns or long lines,
+		// this is rethrown by run()
+		state.errors[chunk] = std::current_exception();
+	}
+}
+
+void HistorySearch::searchChunk(const size_t chunk, const Chunk &spans,
+		std::vector<std::atomic<size_t>> &found, std::vector<Match> &out) const {
+	const auto seq_base = m_snapshot->beginSeq();
+	Line expanded{/*keep_data_on_shrink=*/true};
+	std::string text;
+	std::vector<CellPos> positions;
+	std::vector<size_t> offsets;
+	size_t processed = 0;
+
+	for (const auto &span: spans) {
+		for (auto index = span.begin; index < span.end; ) {
+			if (!startsLogicalLine(index)) {
+				// processed as part of a preceding line
+				index++;
+				continue;
+			}
+
+			if (chunk != 0 && ++processed % EARLY_OUT_INTERVAL == 0) {
+				// the number of matches found in preceding chunks only
+				// grows, if it already reached the limit then nothing
+				// found here will be returned.
+				size_t preceding = 0;
+				for (size_t prev = 0; prev < chunk; prev++) {
+					preceding += found[prev].load(std::memory_order_relaxed);
+				}
+
+				if (preceding >= m_limit)
+					return;
+			}
+
+			const auto first = index;
+			index = encodeLogicalLine(index, expanded, text, positions);
+
+			offsets.clear();
+			findMatches(text, offsets);
+
+			for (const auto offset: offsets) {
+				Match match{seq_base + first, 0, text};
+
+				// find the cell the matching byte belongs to
+				auto pos = std::upper_bound(positions.begin(), positions.end(), offset,
+						[](const size_t off, const CellPos &cell) { return off < cell.offset; });
+
+				if (pos != positions.begin()) {
+					pos--;
+					match.seq = seq_base + pos->line;
+					match.column = pos->column;
+				}
+
+				out.push_back(std::move(match));
+
+				if (found[chunk].fetch_add(1, std::memory_order_relaxed) + 1 >= m_limit)
+					return;
+			}
+		}
+	}
+}
+
+size_t HistorySearch::encodeLogicalLine(size_t index, Line &expanded,
+		std::string &text, std::vector<CellPos> &positions) const {
+	const auto &lines = m_snapshot->lines();
+	const auto &clusters = m_snapshot->clusters();
+
+	text.clear();
+	positions.clear();
+
+	while (index < lines.size()) {
+		const auto &orig = lines[index];
+		const bool wrapped = orig.isWrapped();
+
+		if (!orig.empty()) {
+			if (orig.isCompressed()) {
+				expanded.assignExpanded(orig);
+			}
+
+			const auto &line = orig.isCompressed() ? expanded : orig;
+			const size_t used = line.usedLength();
+
+			for (size_t col = 0; col < used; col++) {
+				const auto &glyph = line[col];
+
+				if (glyph.isDummy())
+					continue;
+
+				positions.push_back(CellPos{text.size(), index, col});
+				clusters.encode(glyph, text);
+			}
+		}
+
+		index++;
+
+		if (!wrapped)
+			break;
+	}
+
+	return index;
+}
+
+void HistorySearch::findMatches(const std::string &text, std::vector<size_t> &offsets) const {
+	if (!m_fixed_string) {
+		for (auto it = std::sregex_iterator{text.begin(), text.end(), m_regex}; it != std::sregex_iterator{}; it++) {
+			offsets.push_back(static_cast<size_t>(it->position()));
+		}
+		return;
+	}
+
+	// always advance, even for an empty pattern
+	const auto step = std::max(m_pattern.size(), size_t{1});
+
+	if (m_ignore_case) {
+		for (auto it = text.begin(); it < text.end(); it += step) {
+			it = std::search(it, text.end(), m_pattern.begin(), m_pattern.end(), equal_ignore_case);
+			if (it == text.end())
+				break;
+			offsets.push_back(static_cast<size_t>(it - text.begin()));
+		}
+	} else {
+		for (auto pos = text.find(m_pattern); pos != text.npos; pos = text.find(m_pattern, pos + step)) {
+			offsets.push_back(pos);
+		}
+	}
+}
+
+} // end ns
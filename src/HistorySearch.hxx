@@ -0,0 +1,166 @@
+#pragma once
+
+// C++
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+
+// nst
+#include "HistorySnapshot.hxx"
+#include "WorkerPool.hxx"
+
+namespace nst {
+
+/// Searches a HistorySnapshot for a pattern, optionally using a WorkerPool.
+/**
+ * The search operates directly on the snapshot's Lines, the history isn't
+ * encoded as a whole. Wrapped lines are joined into logical lines, so
+ * matches can span automatic line wraps. The snapshot is partitioned into
+ * chunks of logical lines which are scanned in parallel by the pool's
+ * threads. The calling thread processes all chunks none of the pool's
+ * threads picked up, so the search completes even if the pool is busy.
+ * Matches are reported in order of appearance, only the first `limit`
+ * matches are returned. Chunks stop early once the preceding chunks
+ * already found enough matches.
+ *
+ * If a HistoryIndex is available then the search can be restricted to the
+ * candidate lines found in the index via restrict().
+ **/
+class HistorySearch {
+public: // types
+
+	/// Flags modifying the interpretation of the search pattern.
+	enum class Flag : uint32_t {
+		IGNORE_CASE   = 1 << 0, ///< match case insensitively
+		FIXED_STRING  = 1 << 1  ///< treat the pattern as a literal string instead of a regular expression
+	};
+
+	/// A single match found in the history.
+	struct Match {
+		size_t seq = 0; ///< the sequence number of the line the match starts in
+		size_t column = 0; ///< the column in the line the match starts at
+		std::string text; ///< the text of the logical line containing the match
+	};
+
+public: // functions
+
+	/// Prepares a search for `pattern` in `snapshot`.
+	/**
+	 * `flags` is a bitmask of Flag values. If the pattern is not a valid
+	 * regular expression then std::regex_error is thrown.
+	 **/
+	HistorySearch(std::shared_ptr<const HistorySnapshot> snapshot,
+			const std::string &pattern, const uint32_t flags, const size_t limit);
+
+	/// Only searches the logical lines starting at `seqs` within the range of sequence numbers [begin, end).
+	/**
+	 * Logical lines starting outside of this range are still searched
+	 * completely. `seqs` needs to be sorted in ascending order. This is
+	 * used for searching the candidates found via HistoryIndex.
+	 **/
+	void restrict(const size_t begin, const size_t end, const std::vector<size_t> &seqs);
+
+	/// Performs the search and returns the matches in order of appearance.
+	/**
+	 * If `pool` is passed then its threads help processing the
+	 * search. The HistorySearch may be destroyed right after this
+	 * returns, even if tasks are still queued in `pool`.
+	 **/
+	std::vector<Match> run(WorkerPool *pool = nullptr) const;
+
+	/// Performs the search and returns the result in textual form, one match per line.
+	/**
+	 * Each line has the format `SEQ:COLUMN:TEXT` where TEXT is the
+	 * logical line containing the match.
+	 **/
+	std::string runAsText(WorkerPool *pool = nullptr) const;
+
+protected: // types
+
+	/// A range of line indices [begin, end) in the snapshot.
+	/**
+	 * All logical lines starting in this range are searched.
+	 **/
+	struct Span {
+		size_t begin = 0;
+		size_t end = 0;
+	};
+
+	/// The spans a single worker thread processes.
+	using Chunk = std::vector<Span>;
+
+	/// The state of a single run(), shared with the tasks queued in the WorkerPool.
+	struct RunState {
+		explicit RunState(std::vector<Chunk> &&_chunks) :
+				chunks{std::move(_chunks)},
+				found(chunks.size()),
+				results(chunks.size()),
+				claimed(chunks.size()),
+				errors(chunks.size()) {}
+
+		std::vector<Chunk> chunks;
+		std::vector<std::atomic<size_t>> found; ///< the number of matches found per chunk
+		std::vector<std::vector<Match>> results; ///< the matches found per chunk
+		std::vector<std::atomic<bool>> claimed; ///< whether a thread already started processing a chunk
+		std::vector<std::exception_ptr> errors; ///< exceptions thrown while processing a chunk
+		std::mutex lock; ///< protects `pool_done`
+		std::condition_variable cond; ///< signals changes to `pool_done`
+		size_t pool_done = 0; ///< the number of chunks completed by the pool's threads
+	};
+
+	/// Maps a byte offset in the text of a logical line to the screen cell it was encoded from.
+	struct CellPos {
+		size_t offset = 0; ///< byte offset in the text
+		size_t line = 0; ///< index of the physical line in the snapshot
+		size_t column = 0;
+	};
+
+protected: // functions
+
+	/// Distributes m_spans onto at most `threads` chunks processed in parallel.
+	std::vector<Chunk> partition(const size_t threads) const;
+
+	/// Processes the given chunk of `state`, which the caller has claimed.
+	/**
+	 * Exceptions are stored in `state.errors`.
+	 **/
+	void processChunk(RunState &state, const size_t chunk) const;
+
+	/// Searches the logical lines starting in `spans`, stopping early when `found` indicates enough matches.
+	/**
+	 * `chunk` is the index of `spans` in the result of partition().
+	 **/
+	void searchChunk(const size_t chunk, const Chunk &spans,
+			std::vector<std::atomic<size_t>> &found, std::vector<Match> &out) const;
+
+	/// Returns whether a logical line starts at the given line index.
+	bool startsLogicalLine(const size_t index) const {
+		// the snapshot might start in the middle of a logical line
+		return index == 0 || !m_snapshot->lines()[index - 1].isWrapped();
+	}
+
+	/// Encodes the logical line starting at `index` into `text` and `positions`, returning the index after it.
+	size_t encodeLogicalLine(size_t index, Line &expanded,
+			std::string &text, std::vector<CellPos> &positions) const;
+
+	/// Appends the byte offsets of all matches in `text` to `offsets`.
+	void findMatches(const std::string &text, std::vector<size_t> &offsets) const;
+
+protected: // data
+
+	std::shared_ptr<const HistorySnapshot> m_snapshot;
+	std::string m_pattern;
+	bool m_ignore_case = false;
+	bool m_fixed_string = false;
+	std::regex m_regex; ///< the compiled pattern if not FIXED_STRING
+	size_t m_limit = 0; ///< the maximum number of matches to return
+	std::vector<Span> m_spans; ///< the parts of the snapshot to search, in ascending order
+};
+
+} // end ns
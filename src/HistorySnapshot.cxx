@@ -0,0 +1,73 @@
+// C++
+#include <algorithm>
+#include <iterator>
+
+// nst
+#include "HistoryStream.hxx"
+#include "HistorySnapshot.hxx"
+#include "Screen.hxx"
+#include "Term.hxx"
+
+namespace nst {
+
+HistorySnapshot::HistorySnapshot(const Term &term) :
+		m_clusters{term.clusters()} {
+	capture(term, HistoryStream{term});
+}
+
+HistorySnapshot::HistorySnapshot(const Term &term, const size_t begin, const size_t end) :
+		m_clusters{term.clusters()} {
+	capture(term, HistoryStream{term, begin, end});
+}
+
+void HistorySnapshot::capture(const Term &term, const HistoryStream &stream) {
+	const auto &screen = HistoryStream::mainScreen(term);
+	Line buffer{/*keep_data_on_shrink=*/true};
+
+	m_begin_seq = stream.beginSeq();
+	m_size = stream.endSeq() - stream.beginSeq();
+	// deserializing archived lines takes a while, only pin them here
+	m_archived = screen.pinArchived(stream.beginSeq(), stream.endSeq());
+	m_lines.reserve(m_size);
+
+	for (auto seq = stream.beginSeq() + m_archived.size(); seq < stream.endSeq(); seq++) {
+		m_lines.push_back(screen.lineAtSeq(seq, buffer));
+	}
+}
+
+const LineVector& HistorySnapshot::lines() const {
+	std::call_once(m_loaded, [this]() {
+		if (m_archived.size() == 0)
+			return;
+
+		LineVector lines;
+		lines.reserve(m_size);
+		Line buffer{/*keep_data_on_shrink=*/true};
+
+		for (size_t index = 0; index < m_archived.size(); index++) {
+			// the copy takes over the CompressedLine
+			m_archived.load(index, buffer);
+			lines.push_back(buffer);
+		}
+
+		std::move(m_lines.begin(), m_lines.end(), std::back_inserter(lines));
+		m_lines = std::move(lines);
+		// release the pinned segments
+		m_archived = HistoryArchive::Pin{};
+	});
+
+	return m_lines;
+}
+
+std::string HistorySnapshot::encode() const {
+	std::string ret;
+	Line expanded{/*keep_data_on_shrink=*/true};
+
+	for (const auto &line: lines()) {
+		Screen::appendText(line, m_clusters, ret, expanded);
+	}
+
+	return ret;
+}
+
+} // end ns
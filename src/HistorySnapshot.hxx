@@ -0,0 +1,84 @@
+#pragma once
+
+// C++
+#include <mutex>
+#include <string>
+
+// nst
+#include "ClusterTable.hxx"
+#include "fwd.hxx"
+#include "HistoryArchive.hxx"
+#include "Line.hxx"
+
+namespace nst {
+
+class HistoryStream;
+
+/// Immutable copy of the terminal history taken for the SNAPSHOT_HISTORY IPC command.
+/**
+ * Instead of the history text this stores copies of the Lines that make up
+ * the history. History lines are kept in compressed form and the
+ * CompressedLine data is shared between copies of a Line, thus taking a
+ * snapshot doesn't duplicate the history data. Only the few Lines that
+ * aren't compressed, typically the lines currently visible on the screen,
+ * are actually copied.
+ *
+ * Lines from the HistoryArchive are only pinned when taking the snapshot
+ * (see HistoryArchive::Pin). They are loaded on first access to lines(),
+ * which typically happens in a worker thread.
+ *
+ * The text is only produced on request via encode(). Since the snapshot
+ * doesn't refer to the Term anymore, encode() can be called from a worker
+ * thread while the terminal continues operating.
+ **/
+class HistorySnapshot {
+public: // functions
+
+	/// Captures the lines currently returned by HistoryStream for `term`.
+	explicit HistorySnapshot(const Term &term);
+
+	/// Captures the lines with sequence numbers in the range [begin, end).
+	/**
+	 * The range is clamped like in HistoryStream.
+	 **/
+	HistorySnapshot(const Term &term, const size_t begin, const size_t end);
+
+	/// Returns the text of the snapshot.
+	/**
+	 * This produces the same text as HistoryStream::drain() would have
+	 * returned at the time the snapshot was taken.
+	 **/
+	std::string encode() const;
+
+	/// Returns the captured lines, oldest first.
+	/**
+	 * The first call loads the archived lines, this can be expensive.
+	 * It's safe to call this concurrently.
+	 **/
+	const LineVector& lines() const;
+
+	/// Returns the number of captured lines, without loading archived lines.
+	size_t size() const { return m_size; }
+
+	/// Returns the table for looking up clusters found in lines().
+	const ClusterTable& clusters() const { return m_clusters; }
+
+	/// Returns the sequence number of the first line in lines().
+	size_t beginSeq() const { return m_begin_seq; }
+
+protected: // functions
+
+	/// Copies the lines covered by `stream`.
+	void capture(const Term &term, const HistoryStream &stream);
+
+protected: // data
+
+	size_t m_begin_seq = 0; ///< the sequence number of the first captured line
+	size_t m_size = 0; ///< the number of captured lines
+	mutable LineVector m_lines; ///< the captured history lines, oldest first. Lacks the archived lines until they're loaded.
+	mutable HistoryArchive::Pin m_archived; ///< the captured archived lines, until they're loaded
+	mutable std::once_flag m_loaded; ///< for loading m_archived in lines()
+	ClusterTable m_clusters; ///< copy of the terminal's clusters, entries might be reused after the snapshot has been taken
+};
+
+} // end ns
@@ -0,0 +1,129 @@
+// C++
+#include <algorithm>
+#include <cstdint>
+
+// nst
+#include "HistoryStream.hxx"
+#include "Screen.hxx"
+#include "Term.hxx"
+
+namespace nst {
+
+HistoryStream::HistoryStream(const Term &term) :
+		m_term{term} {
+	m_begin_seq = m_next_seq = mainScreen().historySeq();
+	m_end_seq = findEnd();
+}
+
+HistoryStream::HistoryStream(const Term &term, const size_t begin, const size_t end) :
+		m_term{term} {
+	const auto [first, last] = availableSeqs(term);
+	m_begin_seq = m_next_seq = std::clamp(begin, first, last);
+	m_end_seq = std::clamp(end, m_begin_seq, last);
+}
+
+std::pair<size_t, size_t> HistoryStream::availableSeqs(const Term &term) {
+	const auto &screen = mainScreen(term);
+	const auto &cursor = term.onAltScreen() ? screen.getCachedCursor() : term.cursor();
+	const auto cursor_row = static_cast<size_t>(std::max(cursor.position().y, 0));
+
+	return {screen.historySeq(), screen.screenSeq() + cursor_row};
+}
+
+const Screen& HistoryStream::mainScreen(const Term &term) {
+	// always operate on the main screen for two reasons:
+	// - this will be the typical use case
+	// - the current screen is subject to race conditions e.g. the command
+	//   line `nst-msg -d | less` is subject to race conditions, since
+	//   less switches to the alt screen and if that happens first, then
+	//   less displays itself, so to say.
+	return term.onAltScreen() ? term.savedScreen() : term.screen();
+}
+
+size_t HistoryStream::findEnd() const {
+	const auto &screen = mainScreen();
+	Line buffer{/*keep_data_on_shrink=*/true};
+
+	// screen lines at and below the cursor are not included, like in
+	// Screen::asText().
+	const auto end = availableSeqs(m_term).second;
+	auto last = end;
+
+	// find the last line that contributes text
+	while (last > m_next_seq && screen.lineAtSeq(last - 1, buffer).empty()) {
+		last--;
+	}
+
+	// also drop the last logical line which contains the currently
+	// entered command line. this avoids that e.g.
+	//     nst-msg -d | grep something
+	// matches the very command line that searches for `something`. The
+	// text ends after the last newline before the last line.
+	for (auto seq = last - std::min(last, size_t{1}); seq > m_next_seq; seq--) {
+		const auto &line = screen.lineAtSeq(seq - 1, buffer);
+
+		if (!line.empty() && !line.isWrapped()) {
+			return seq;
+		}
+	}
+
+	// no complete line found, transfer everything
+	return end;
+}
+
+void HistoryStream::fill(const size_t bytes) {
+	const auto &screen = mainScreen();
+	const auto &clusters = m_term.clusters();
+
+	// the history might have been cleared or might have dropped lines
+	// in the meantime, or the screen shrunk.
+	m_next_seq = std::max(m_next_seq, screen.historySeq());
+	m_end_seq = std::min(m_end_seq, screen.screenSeq() + screen.numLines());
+
+	while (m_pending.size() < bytes && !atEnd()) {
+		Screen::appendText(screen.lineAtSeq(m_next_seq, m_buffer), clusters, m_pending, m_expanded);
+		m_next_seq++;
+	}
+}
+
+bool HistoryStream::nextChunk(std::string &out, const size_t max_bytes) {
+	fill(max_bytes);
+
+	const auto len = std::min(max_bytes, m_pending.size());
+	out.assign(m_pending, 0, len);
+	m_pending.erase(0, len);
+
+	return !m_pending.empty() || !atEnd();
+}
+
+std::string HistoryStream::drain() {
+	fill(SIZE_MAX);
+	return std::move(m_pending);
+}
+
+size_t HistoryStream::nextLines(std::string &out, const size_t max_bytes) {
+	// only adjusts the range to the current state of the screen
+	fill(0);
+
+	const auto &screen = mainScreen();
+	const auto &clusters = m_term.clusters();
+	out.clear();
+
+	while (!atEnd()) {
+		// m_pending keeps the line that didn't fit during the last call
+		if (m_pending.empty()) {
+			Screen::appendText(screen.lineAtSeq(m_next_seq, m_buffer), clusters, m_pending, m_expanded);
+		}
+
+		if (!out.empty() && out.size() + m_pending.size() > max_bytes)
+			break;
+
+		out.append(m_pending, 0, max_bytes - out.size());
+		m_pending.clear();
+		m_next_seq++;
+	}
+
+	return m_next_seq;
+}
+
+} // end ns
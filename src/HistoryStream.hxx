@@ -0,0 +1,120 @@
+#pragma once
+
+// C++
+#include <string>
+#include <utility>
+
+// nst
+#include "fwd.hxx"
+#include "Line.hxx"
+
+namespace nst {
+
+class Screen;
+
+/// Incrementally encodes the terminal history as text.
+/**
+ * This produces the same text as Screen::asText() for the main screen,
+ * without the last line which typically contains the command line that
+ * requested the history. Instead of encoding everything at once, the text is
+ * produced in chunks of limited size, directly from the Screen's lines. This
+ * way transferring a large history over IPC doesn't require a copy of the
+ * complete history text, and the main loop only spends a bounded amount of
+ * time per chunk.
+ *
+ * Alternatively an explicit range of lines can be streamed, this is used for
+ * ranged and incremental history queries via IPC.
+ *
+ * The range of lines to transfer is determined upon construction and is
+ * tracked via Screen line sequence numbers (see Screen::historySeq()), so
+ * that new output arriving during the transfer doesn't disturb it. Lines
+ * that are dropped from the history or rewrapped while the transfer is
+ * ongoing can be missing or duplicated in the output, though.
+ **/
+class HistoryStream {
+public: // functions
+
+	/// Streams the complete history.
+	explicit HistoryStream(const Term &term);
+
+	/// Streams the lines with sequence numbers in the range [begin, end).
+	/**
+	 * The range is clamped to the lines that are currently available,
+	 * see availableSeqs(). In contrast to the complete history the last
+	 * line is not dropped.
+	 **/
+	HistoryStream(const Term &term, const size_t begin, const size_t end);
+
+	/// Returns the range of sequence numbers available for streaming.
+	/**
+	 * This starts at the oldest history line and ends before the line
+	 * the cursor is on, which is typically still being written.
+	 **/
+	static std::pair<size_t, size_t> availableSeqs(const Term &term);
+
+	/// Returns the screen the history is taken from.
+	/**
+	 * This is always the main screen, also if the alternative screen is
+	 * currently active.
+	 **/
+	static const Screen& mainScreen(const Term &term);
+
+	/// Returns the sequence number of the first line streamed.
+	size_t beginSeq() const { return m_begin_seq; }
+
+	/// Returns the sequence number after the last line streamed.
+	size_t endSeq() const { return m_end_seq; }
+
+	/// Stores the next chunk of text of at most `max_bytes` in `out`.
+	/**
+	 * The returned chunk is only smaller than `max_bytes` for the final
+	 * chunk of the stream.
+	 *
+	 * \return Whether more data is available after this chunk.
+	 **/
+	bool nextChunk(std::string &out, const size_t max_bytes);
+
+	/// Returns the complete (remaining) text of the stream at once.
+	std::string drain();
+
+	/// Stores the text of the next complete lines in `out`, up to `max_bytes`.
+	/**
+	 * In contrast to nextChunk() lines are never split across calls, so
+	 * that the caller knows exactly which lines are contained in `out`.
+	 * At least one line is returned if available, a single line
+	 * exceeding `max_bytes` is truncated. This must not be mixed with
+	 * calls to nextChunk().
+	 *
+	 * \return The sequence number of the line following the last line
+	 * stored in `out`.
+	 **/
+	size_t nextLines(std::string &out, const size_t max_bytes);
+
+protected: // functions
+
+	const Screen& mainScreen() const {
+		return mainScreen(m_term);
+	}
+
+	/// Determines the end of the line range to transfer.
+	size_t findEnd() const;
+
+	/// Encodes lines into m_pending until at least `bytes` are available or the end is reached.
+	void fill(const size_t bytes);
+
+	bool atEnd() const {
+		return m_next_seq >= m_end_seq;
+	}
+
+protected: // data
+
+	const Term &m_term;
+	size_t m_begin_seq = 0; ///< sequence number of the first line to encode
+	size_t m_next_seq = 0; ///< sequence number of the next line to encode
+	size_t m_end_seq = 0; ///< sequence number of the line after the last line to encode
+	std::string m_pending; ///< encoded text not yet returned from nextChunk()
+	Line m_buffer{/*keep_data_on_shrink=*/true}; ///< buffer for loading archived lines
+	Line m_expanded{/*keep_data_on_shrink=*/true}; ///< buffer for expanding compressed lines
+};
+
+} // end ns
@@ -1,18 +1,34 @@
 // C++
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
+// Linux
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 // cosmos
 #include "cosmos/error/ApiError.hxx"
 #include "cosmos/formatting.hxx"
+#include "cosmos/fs/File.hxx"
 #include "cosmos/fs/filesystem.hxx"
 #include "cosmos/proc/process.hxx"
+#include "cosmos/utils.hxx"
 
 // nst
+#include "HistorySearch.hxx"
+#include "HistorySnapshot.hxx"
+#include "HistoryStream.hxx"
 #include "IpcHandler.hxx"
 #include "nst.hxx"
 
 namespace nst {
 
+static_assert(IpcHandler::SearchParams::IGNORE_CASE == static_cast<uint32_t>(HistorySearch::Flag::IGNORE_CASE));
+static_assert(IpcHandler::SearchParams::FIXED_STRING == static_cast<uint32_t>(HistorySearch::Flag::FIXED_STRING));
 
 namespace {
 	auto& log_error() {
@@ -20,6 +36,13 @@ namespace {
 	}
 }
 
+IpcHandler::Session::Session(cosmos::UnixConnection &&conn) :
+		connection{std::move(conn)} {
+}
+
+IpcHandler::Session::~Session() {
+}
+
 std::string IpcHandler::address() {
 	std::string ret{"nst-ipc-"};
 	const auto pid = cosmos::proc::cached_pids.own_pid;
@@ -32,61 +55,110 @@ void IpcHandler::init() {
 	m_listener.bind(cosmos::UnixAddress{address(), cosmos::UnixAddress::Abstract{true}});
 	m_listener.listen(5);
 	m_poller.addFD(m_listener.fd(), {cosmos::Poller::MonitorFlag::INPUT});
+	m_poller.addFD(m_job_pipe.readEnd(), {cosmos::Poller::MonitorFlag::INPUT});
+
+	m_drain_timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (m_drain_timer == -1) {
+		cosmos_throw (cosmos::ApiError("timerfd_create()"));
+	}
+
+	m_poller.addFD(cosmos::FileDescriptor{cosmos::FileNum{m_drain_timer}}, {cosmos::Poller::MonitorFlag::INPUT});
+}
+
+IpcHandler::~IpcHandler() {
+	if (m_drain_timer != -1) {
+		::close(m_drain_timer);
+	}
 }
 
 bool IpcHandler::checkEvent(const cosmos::Poller::PollEvent &event) {
 	bool redraw = false;
 
-	if (m_state == State::WAITING) {
-		if (event.fd() == m_listener.fd()) {
-			try {
-				acceptConnection();
-			} catch (const cosmos::ApiError &e) {
-				log_error() << e.what() << "\n";
-			}
+	if (event.fd() == m_listener.fd()) {
+		try {
+			acceptConnection();
+		} catch (const cosmos::ApiError &e) {
+			log_error() << e.what() << "\n";
 		}
-	} else if (event.fd() == m_connection->fd()) {
-		switch (m_state) {
+		return false;
+	} else if (event.fd() == m_job_pipe.readEnd()) {
+		finishWorkerJobs();
+		return false;
+	} else if (event.fd() == cosmos::FileDescriptor{cosmos::FileNum{m_drain_timer}}) {
+		checkDrained();
+		removeClosedSessions();
+		return false;
+	}
+
+	for (auto &session: m_sessions) {
+		if (session.state == State::CLOSED || event.fd() != session.connection.fd())
+			continue;
+
+		switch (session.state) {
 			case State::RECEIVING:
-				redraw = receiveCommand();
+				redraw = receiveCommand(session);
 				break;
 			case State::SENDING:
-				sendData();
+				sendData(session);
+				break;
+			case State::SUBSCRIBED:
+				sendOutput(session);
+				break;
+			case State::INJECTING:
+				receiveInput(session);
+				break;
+			case State::DRAINING:
+				// the client hung up while waiting for the
+				// reply
+				closeSession(session);
+				break;
+			case State::ENCODING:
+				// the client hung up or sent unexpected data
+				// while the reply is still being encoded
+				closeSession(session);
 				break;
 			default:
 				log_error() << "bad IPC state, closing session\n";
-				closeSession();
+				closeSession(session);
 				break;
 		}
+
+		break;
 	}
 
+	removeClosedSessions();
+
 	return redraw;
 }
 
 void IpcHandler::acceptConnection() {
-	m_connection = m_listener.accept();
+	auto connection = m_listener.accept();
+
+	if (m_sessions.size() >= MAX_SESSIONS) {
+		log_error() << "too many concurrent connections, rejecting new connection\n";
+		connection.close();
+		return;
+	}
 
-	auto opts = m_connection->unixOptions();
+	auto opts = connection.unixOptions();
 	if (auto peer_uid = opts.credentials().userID(); peer_uid != cosmos::proc::get_real_user_id()) {
 		log_error() << "rejecting connection from uid " << cosmos::to_integral(peer_uid) << "\n";
-		m_connection->close();
-		m_connection.reset();
+		connection.close();
 		return;
 	}
 
-	m_poller.delFD(m_listener.fd());
-	m_poller.addFD(m_connection->fd(), {cosmos::Poller::MonitorFlag::INPUT});
-	m_state = State::RECEIVING;
+	auto &session = m_sessions.emplace_back(std::move(connection));
+	m_poller.addFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::INPUT});
 }
 
-bool IpcHandler::receiveCommand() {
-	auto &connection = *m_connection;
+bool IpcHandler::receiveCommand(Session &session) {
 	Message message = Message::INVALID;
 
 	size_t len = 0;
 
 	try {
-		len = receiveData(reinterpret_cast<char*>(&message), sizeof(Message));
+		len = receiveData(session, reinterpret_cast<char*>(&message), sizeof(Message));
 	} catch (const cosmos::ApiError &error) {
 		return false;
 	}
@@ -96,56 +168,55 @@ bool IpcHandler::receiveCommand() {
 			log_error() << "short IPC command, closing session.\n";
 		else
 			log_error() << "too long IPC command, closing session.\n";
-		closeSession();
+		closeSession(session);
 		return false;
 	}
 
-	const bool redraw = processCommand(message);
+	const bool redraw = processCommand(session, message);
 
-	if (m_state == State::SENDING) {
+	if (session.state == State::SENDING || session.state == State::SUBSCRIBED) {
 		// transitioned to sending, we need to monitor output now
-		m_poller.modFD(connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+		m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
 	}
 
 	return redraw;
 }
 
-size_t IpcHandler::receiveData(char *buffer, const size_t max_size) {
+size_t IpcHandler::receiveData(Session &session, char *buffer, const size_t max_size) {
 	try {
-		return m_connection->receive(buffer, max_size, cosmos::MessageFlags{cosmos::MessageFlag::TRUNCATE});
+		return session.connection.receive(buffer, max_size, cosmos::MessageFlags{cosmos::MessageFlag::TRUNCATE});
 	} catch (const cosmos::ApiError &error) {
 		log_error() << "receive error: " << error.what() << "\n";
-		closeSession();
+		closeSession(session);
 		throw;
 	}
 }
 
-std::string IpcHandler::history() const {
+std::string IpcHandler::historyUsage() const {
 	const auto &term = m_nst.term();
-	// always operate on the main screen for two reasons:
-	// - this will be the typical use case
-	// - the current screen is subject to race conditions e.g. the command
-	//   line `nst-msg -d | less` is subject to race conditions, since
-	//   less switches to the alt screen and if that happens first, then
-	//   less displays itself, so to say.
+	// the history is only maintained on the main screen
 	const auto &screen = term.onAltScreen() ? term.savedScreen() : term.screen();
-	const auto &cursor = term.onAltScreen() ? screen.getCachedCursor() : term.cursor();
-	auto ret = screen.asText(cursor);
-
-	// drop the last line which contains the currently entered
-	// command line. this avoids that e.g.
-	//     nst-msg -d | grep something
-	// matches the very command line that searches for `something`.
-	// TODO: this is currently not unicode safe ...
-	auto pos = ret.find_last_of('\n', ret.size() >= 2 ? ret.size() - 2 : ret.npos);
-	if (pos != ret.npos) {
-		ret.erase(pos+1);
+	const auto usage = screen.historyUsage();
+
+	std::string ret;
+	ret += "history lines: " + std::to_string(usage.lines) + "\n";
+	ret += "compressed lines: " + std::to_string(usage.compressed) + "\n";
+	ret += "history bytes: " + std::to_string(usage.bytes) + "\n";
+	ret += "bytes per line: " + std::to_string(usage.lines ? usage.bytes / usage.lines : 0) + "\n";
+	ret += "archived lines: " + std::to_string(usage.archived) + "\n";
+	ret += "archived bytes: " + std::to_string(usage.archived_bytes) + "\n";
+
+	if (const auto index = term.historyIndex(); index) {
+		const auto index_usage = index->usage();
+		ret += "indexed lines: " + std::to_string(index_usage.lines) + "\n";
+		ret += "indexed trigrams: " + std::to_string(index_usage.trigrams) + "\n";
+		ret += "index bytes: " + std::to_string(index_usage.bytes) + "\n";
 	}
 
 	return ret;
 }
 
-bool IpcHandler::processCommand(const Message message) {
+bool IpcHandler::processCommand(Session &session, const Message message) {
 	bool redraw = false;
 	cosmos::ExitStatus cmd_res = cosmos::ExitStatus::SUCCESS;
 
@@ -155,26 +226,71 @@ bool IpcHandler::processCommand(const Message message) {
 			cmd_res = cosmos::ExitStatus::FAILURE;
 			break;
 		case Message::SNAPSHOT_HISTORY:
-			m_snapshot = history();
+			m_snapshot = std::make_shared<const HistorySnapshot>(m_nst.term());
 			break;
 		case Message::GET_HISTORY:
-			m_send_queue.emplace_back(history());
+			// the history can be large, encode it chunk by chunk
+			// while sending
+			session.history_stream = std::make_unique<HistoryStream>(m_nst.term());
 			break;
 		case Message::GET_SNAPSHOT:
-			m_send_queue.push_back(m_snapshot);
+			if (m_snapshot) {
+				// encoding a large history takes a while, don't
+				// block the terminal meanwhile. The snapshot is
+				// immutable and shared with the job, so taking a
+				// new snapshot meanwhile doesn't affect the job.
+				startWorkerJob(session, [snapshot = m_snapshot]() {
+					return snapshot->encode();
+				});
+			}
 			break;
 		case Message::GET_CWD:
-			m_send_queue.emplace_back(childCWD());
+			session.send_queue.emplace_back(childCWD());
+			break;
+		case Message::GET_HISTORY_USAGE:
+			session.send_queue.emplace_back(historyUsage());
 			break;
 		case Message::PING: {
 			constexpr auto msg = Message::PING;
-			auto &data = m_send_queue.emplace_back(std::string{});
+			auto &data = session.send_queue.emplace_back(std::string{});
 			data.resize(sizeof(msg));
 			std::memcpy(data.data(), &msg, sizeof(msg));
 			break;
 		}
+		case Message::GET_HISTORY_TAIL:
+		case Message::GET_HISTORY_RANGE:
+		case Message::GET_HISTORY_SINCE:
+			if (!handleHistoryRange(session, message)) {
+				cmd_res = cosmos::ExitStatus::FAILURE;
+			}
+			break;
+		case Message::SUBSCRIBE_OUTPUT:
+			if (!handleSubscribe(session)) {
+				cmd_res = cosmos::ExitStatus::FAILURE;
+			}
+			break;
+		case Message::SEARCH:
+			if (!handleSearch(session)) {
+				cmd_res = cosmos::ExitStatus::FAILURE;
+			}
+			break;
+		case Message::SEND_INPUT:
+			if (!handleSendInput(session)) {
+				cmd_res = cosmos::ExitStatus::FAILURE;
+			}
+			break;
+		case Message::GET_SCREEN_SHARE:
+			try {
+				// the share is populated synchronously, the client
+				// can read the screen right away
+				session.pass_fd = m_nst.term().enableScreenShare().readOnlyFD();
+			} catch (const cosmos::ApiError &e) {
+				log_error() << "failed to set up screen share: " << e.what() << "\n";
+				cmd_res = cosmos::ExitStatus::FAILURE;
+			}
+			break;
 		case Message::SET_THEME: {
-			if (handleSetTheme()) {
+			if (handleSetTheme(session)) {
 				redraw = true;
 			} else {
 				cmd_res = cosmos::ExitStatus::FAILURE;
@@ -183,18 +299,37 @@ bool IpcHandler::processCommand(const Message message) {
 		}
 	}
 
-	queueStatus(cmd_res);
+	if (session.state == State::CLOSED) {
+		// receiving parameters failed
+		return redraw;
+	} else if (session.state == State::INJECTING) {
+		// the status is sent once the input has been written, see
+		// finishInput()
+		return redraw;
+	}
+
+	queueStatus(session, cmd_res);
+
+	if (message == Message::SUBSCRIBE_OUTPUT && cmd_res == cosmos::ExitStatus::SUCCESS) {
+		session.state = State::SUBSCRIBED;
+		session.queued_bytes = session.send_queue.front().size();
+		m_num_subscribers++;
+		// lines already available starting at the requested sequence
+		// number follow the status
+		queueOutput(session);
+	} else if (session.state == State::RECEIVING) {
+		session.state = State::SENDING;
+	}
 
-	m_state = State::SENDING;
 	return redraw;
 }
 
-bool IpcHandler::handleSetTheme() {
+bool IpcHandler::handleSetTheme(Session &session) {
 	std::string theme;
 	theme.resize(128);
 
 	try {
-		const auto len = receiveData(theme.data(), theme.size());
+		const auto len = receiveData(session, theme.data(), theme.size());
 		if (len == 0 || len > theme.size()) {
 			log_error() << "set_theme request: excess theme name length encountered\n";
 		} else {
@@ -208,68 +343,646 @@ bool IpcHandler::handleSetTheme() {
 	}
 
 	if (!m_nst.setTheme(theme)) {
-		m_send_queue.push_back("invalid theme name encountered");
+		session.send_queue.push_back("invalid theme name encountered");
 		return false;
 	}
 
 	return true;
 }
 
-void IpcHandler::queueStatus(cosmos::ExitStatus status) {
+bool IpcHandler::handleHistoryRange(Session &session, const Message message) {
+	SeqRange param;
+	// only GET_HISTORY_RANGE passes two values
+	const size_t expected = message == Message::GET_HISTORY_RANGE ? sizeof(param) : sizeof(param.begin);
+
+	try {
+		const auto len = receiveData(session, reinterpret_cast<char*>(&param), sizeof(param));
+		if (len != expected) {
+			log_error() << "history range request: bad parameter length encountered\n";
+			return false;
+		}
+	} catch (const cosmos::ApiError&) {
+		return false;
+	}
+
+	const auto &term = m_nst.term();
+	const auto [first, last] = HistoryStream::availableSeqs(term);
+	size_t begin = 0;
+	size_t end = last;
+
+	switch (message) {
+		case Message::GET_HISTORY_TAIL:
+			begin = last - std::min(static_cast<size_t>(param.begin), last - first);
+			break;
+		case Message::GET_HISTORY_RANGE:
+			begin = param.begin;
+			end = param.end;
+			break;
+		case Message::GET_HISTORY_SINCE:
+		default:
+			begin = param.begin;
+			break;
+	}
+
+	session.history_stream = std::make_unique<HistoryStream>(term, begin, end);
+	const auto &stream = *session.history_stream;
+	const SeqRange reply{stream.beginSeq(), stream.endSeq()};
+
+	auto &data = session.send_queue.emplace_back(std::string{});
+	data.resize(sizeof(reply));
+	std::memcpy(data.data(), &reply, sizeof(reply));
+
+	return true;
+}
+
+bool IpcHandler::handleSearch(Session &session) {
+	SearchParams params;
+	std::string data;
+	data.resize(sizeof(params) + MAX_SEARCH_PATTERN);
+
+	try {
+		const auto len = receiveData(session, data.data(), data.size());
+		if (len <= sizeof(params) || len > data.size()) {
+			log_error() << "search request: bad parameter length encountered\n";
+			return false;
+		}
+		data.resize(len);
+	} catch (const cosmos::ApiError&) {
+		return false;
+	}
+
+	std::memcpy(&params, data.data(), sizeof(params));
+	const auto pattern = data.substr(sizeof(params));
+	const auto &term = m_nst.term();
+	const auto [first, last] = HistoryStream::availableSeqs(term);
+	std::unique_ptr<HistorySearch> search;
+
+	try {
+		// searching operates on a snapshot of the complete buffer,
+		// which shares the line data with the terminal. Archived
+		// lines are only pinned, the worker deserializes them.
+		search = std::make_unique<HistorySearch>(
+				std::make_shared<const HistorySnapshot>(term, first, last),
+				pattern, params.flags, params.limit ? params.limit : SIZE_MAX);
+	} catch (const std::regex_error &e) {
+		session.send_queue.push_back(std::string{"invalid search pattern: "} + e.what());
+		return false;
+	}
+
+	if (const auto index = term.historyIndex(); index) {
+		// only verify the lines the index considers candidates
+		const bool fixed_string = (params.flags & SearchParams::FIXED_STRING) != 0;
+
+		if (const auto candidates = index->candidates(pattern, fixed_string); candidates) {
+			search->restrict(candidates->begin, candidates->end, candidates->seqs);
+		}
+	}
+
+	startWorkerJob(session, [search = std::shared_ptr<HistorySearch>{std::move(search)}, pool = &m_workers]() {
+		return search->runAsText(pool);
+	});
+
+	return true;
+}
+
+bool IpcHandler::handleSubscribe(Session &session) {
+	uint64_t start = 0;
+
+	try {
+		const auto len = receiveData(session, reinterpret_cast<char*>(&start), sizeof(start));
+		if (len != sizeof(start)) {
+			log_error() << "subscribe request: bad parameter length encountered\n";
+			return false;
+		}
+	} catch (const cosmos::ApiError&) {
+		return false;
+	}
+
+	const auto [first, last] = HistoryStream::availableSeqs(m_nst.term());
+	session.next_seq = std::clamp(static_cast<size_t>(start), first, last);
+
+	return true;
+}
+
+bool IpcHandler::handleSendInput(Session &session) {
+	SendInputParams params;
+
+	try {
+		const auto len = receiveData(session, reinterpret_cast<char*>(&params), sizeof(params));
+		if (len != sizeof(params)) {
+			log_error() << "send input request: bad parameter length encountered\n";
+			return false;
+		}
+	} catch (const cosmos::ApiError&) {
+		return false;
+	}
+
+	session.input_left = params.size;
+	session.input_flags = params.flags;
+	session.state = State::INJECTING;
+
+	return true;
+}
+
+void IpcHandler::receiveInput(Session &session) {
+	if (session.input_left == 0) {
+		// the client hung up or sent excess data while the input is
+		// still being written
+		closeSession(session);
+		return;
+	}
+
+	// drop the part already written, if that's worthwhile
+	if (session.input_pos != 0 && session.input_pos >= session.pendingInput()) {
+		session.input.erase(0, session.input_pos);
+		session.input_pos = 0;
+	}
+
+	const auto old_size = session.input.size();
+	session.input.resize(old_size + MAX_CHUNK_SIZE);
+	size_t len = 0;
+
+	try {
+		len = receiveData(session, session.input.data() + old_size, MAX_CHUNK_SIZE);
+	} catch (const cosmos::ApiError&) {
+		return;
+	}
+
+	if (len == 0 || len > MAX_CHUNK_SIZE || len > session.input_left) {
+		if (len == 0)
+			log_error() << "send input request: client hung up before sending all data\n";
+		else
+			log_error() << "send input request: bad packet length encountered\n";
+		closeSession(session);
+		return;
+	}
+
+	session.input.resize(old_size + len);
+	session.input_left -= len;
+
+	if (session.input_left != 0 && session.pendingInput() >= INPUT_BUFFER_SIZE) {
+		// stop receiving until the TTY caught up, the client
+		// blocks meanwhile since its socket buffer fills up
+		m_poller.delFD(session.connection.fd());
+		session.input_paused = true;
+	}
+}
+
+bool IpcHandler::hasPendingInput() const {
+	if (m_injecting)
+		return m_injecting->canWriteInput();
+
+	return std::any_of(m_sessions.begin(), m_sessions.end(), [](const Session &session) {
+		return session.canWriteInput();
+	});
+}
+
+void IpcHandler::writeInput() {
+	if (!m_injecting) {
+		for (auto &session: m_sessions) {
+			if (session.canWriteInput()) {
+				m_injecting = &session;
+				break;
+			}
+		}
+
+		if (!m_injecting)
+			return;
+	}
+
+	auto &session = *m_injecting;
+
+	if (!session.input_started) {
+		session.input_started = true;
+
+		if (session.input_flags & SendInputParams::BRACKETED_PASTE)
+			m_nst.term().reportPaste(true);
+	}
+
+	if (const auto bytes = std::min(session.pendingInput(), INPUT_WRITE_SIZE); bytes != 0) {
+		// this is treated the same as keyboard input or pasted data,
+		// but the TTY might accept only part of it, the rest is
+		// written on the next writable event
+		session.input_pos += m_nst.tty().tryWrite({session.input.data() + session.input_pos, bytes}, TTY::MayEcho{true});
+	}
+
+	if (session.input_paused && session.pendingInput() < INPUT_BUFFER_SIZE) {
+		m_poller.addFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::INPUT});
+		session.input_paused = false;
+	}
+
+	if (session.input_left == 0 && session.pendingInput() == 0) {
+		finishInput(session);
+	}
+}
+
+void IpcHandler::dropInput() {
+	m_injecting = nullptr;
+
+	for (auto &session: m_sessions) {
+		if (session.state != State::INJECTING)
+			continue;
+
+		session.input.clear();
+		session.input_pos = 0;
+		session.send_queue.push_back("the terminal has been hung up");
+		queueStatus(session, cosmos::ExitStatus::FAILURE);
+		session.state = State::SENDING;
+
+		if (session.input_paused) {
+			m_poller.addFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+			session.input_paused = false;
+		} else {
+			m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+		}
+	}
+}
+
+void IpcHandler::finishInput(Session &session) {
+	if (session.input_flags & SendInputParams::BRACKETED_PASTE)
+		m_nst.term().reportPaste(false);
+
+	m_injecting = nullptr;
+	session.input.clear();
+	session.input_pos = 0;
+
+	if (session.input_flags & SendInputParams::WAIT_CONSUMED) {
+		session.state = State::DRAINING;
+		armDrainTimer(true);
+		return;
+	}
+
+	queueStatus(session, cosmos::ExitStatus::SUCCESS);
+	session.state = State::SENDING;
+	m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+}
+
+void IpcHandler::checkDrained() {
+	uint64_t expirations = 0;
+
+	if (::read(m_drain_timer, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+		log_error() << "failed to read from drain timer: " << std::strerror(errno) << "\n";
+	}
+
+	const auto draining = [](const Session &session) {
+		return session.state == State::DRAINING;
+	};
+
+	if (std::none_of(m_sessions.begin(), m_sessions.end(), draining)) {
+		// the waiting clients went away meanwhile
+		armDrainTimer(false);
+		return;
+	}
+
+	auto status = cosmos::ExitStatus::SUCCESS;
+	std::string error;
+
+	try {
+		if (m_nst.tty().pendingInput() != 0) {
+			// check again later
+			return;
+		}
+	} catch (const cosmos::ApiError &e) {
+		error = std::string{"cannot determine whether the input has been consumed: "} + e.what();
+		log_error() << error << "\n";
+		status = cosmos::ExitStatus::FAILURE;
+	}
+
+	// the TTY's input queue is shared, thus all waiting clients are done
+	for (auto &session: m_sessions) {
+		if (!draining(session))
+			continue;
+
+		if (!error.empty())
+			session.send_queue.push_back(error);
+
+		queueStatus(session, status);
+		session.state = State::SENDING;
+		m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+	}
+
+	armDrainTimer(false);
+}
+
+void IpcHandler::armDrainTimer(const bool on) {
+	struct itimerspec spec{};
+
+	if (on) {
+		spec.it_value.tv_nsec = DRAIN_CHECK_INTERVAL * 1000 * 1000;
+		spec.it_interval = spec.it_value;
+	}
+
+	if (::timerfd_settime(m_drain_timer, 0, &spec, nullptr) != 0) {
+		log_error() << "failed to set drain timer: " << std::strerror(errno) << "\n";
+	}
+}
+
+void IpcHandler::publishOutput() {
+	if (!hasSubscribers())
+		return;
+
+	for (auto &session: m_sessions) {
+		if (session.state != State::SUBSCRIBED)
+			continue;
+
+		const bool was_idle = session.send_queue.empty();
+
+		queueOutput(session);
+
+		if (was_idle && !session.send_queue.empty()) {
+			m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+		}
+	}
+}
+
+void IpcHandler::queueOutput(Session &session) {
+	const auto &term = m_nst.term();
+	const auto last = HistoryStream::availableSeqs(term).second;
+
+	// the cursor might have moved upwards, wait for it to pass the
+	// lines already published
+	if (last <= session.next_seq)
+		return;
+
+	if (session.queued_bytes >= SUBSCRIBER_BUFFER_SIZE) {
+		// the client doesn't keep up, drop the new lines instead of
+		// stalling the terminal. The client notices the gap from the
+		// SeqRange of the next packet.
+		session.next_seq = last;
+		return;
+	}
+
+	// lines that dropped out of the history meanwhile are skipped
+	// by the stream, this also results in a gap for the client
+	HistoryStream stream{term, session.next_seq, last};
+	SeqRange range{stream.beginSeq(), stream.beginSeq()};
+	std::string text;
+
+	while (range.end < stream.endSeq() && session.queued_bytes < SUBSCRIBER_BUFFER_SIZE) {
+		range.begin = range.end;
+		range.end = stream.nextLines(text, MAX_CHUNK_SIZE - sizeof(range));
+
+		auto &packet = session.send_queue.emplace_back(std::string{});
+		packet.resize(sizeof(range));
+		std::memcpy(packet.data(), &range, sizeof(range));
+		packet.append(text);
+		session.queued_bytes += packet.size();
+	}
+
+	session.next_seq = last;
+}
+
+void IpcHandler::queueStatus(Session &session, cosmos::ExitStatus status) {
 	// place this at the front, the status needs to be the first message
 	// sent back
-	auto &data = m_send_queue.emplace_front(std::string{});
+	auto &data = session.send_queue.emplace_front(std::string{});
 	data.resize(sizeof(status));
 	std::memcpy(data.data(), &status, sizeof(status));
 }
 
-void IpcHandler::sendData() {
-	const auto &data = m_send_queue.front();
+const std::string* IpcHandler::nextSendData(Session &session) {
+	if (session.send_queue.empty() && session.history_stream) {
+		auto &chunk = session.send_queue.emplace_back(std::string{});
+
+		if (!session.history_stream->nextChunk(chunk, MAX_CHUNK_SIZE)) {
+			session.history_stream.reset();
+		}
+
+		if (chunk.empty()) {
+			session.send_queue.pop_back();
+		}
+	}
+
+	return session.send_queue.empty() ? nullptr : &session.send_queue.front();
+}
+
+void IpcHandler::sendData(Session &session) {
+	const auto data = nextSendData(session);
+
+	if (!data) {
+		// everything has been sent out
+		closeSession(session);
+		return;
+	}
+
 	// we possibly need to chunk the payload here, because replies like
-	// the history buffer can be larger than the maximum seq-packet socket
-	// message length.
-	const auto left = data.size() - m_msg_pos;
+	// the history snapshot can be larger than the maximum seq-packet
+	// socket message length.
+	const auto left = data->size() - session.msg_pos;
 	const auto chunk_bytes = std::min(MAX_CHUNK_SIZE, left);
 
 	try {
-		const auto sent = m_connection->send(data.data() + m_msg_pos, chunk_bytes);
+		const auto sent = session.pass_fd != -1 ?
+			sendWithFD(session, data->data() + session.msg_pos, chunk_bytes) :
+			session.connection.send(data->data() + session.msg_pos, chunk_bytes);
 
 		if (sent != chunk_bytes) {
 			log_error() << "short IPC message sent.\n";
-			closeSession();
+			closeSession(session);
 			return;
 		}
 
-		m_msg_pos += sent;
+		session.msg_pos += sent;
 
-		if (m_msg_pos == data.size()) {
+		if (session.msg_pos == data->size()) {
 			// we're done with this message, remove it from the queue
-			m_send_queue.pop_front();
-			m_msg_pos = 0;
-			if (m_send_queue.empty()) {
+			session.send_queue.pop_front();
+			session.msg_pos = 0;
+			if (!nextSendData(session)) {
 				// everything has been sent out
-				closeSession();
+				closeSession(session);
 			}
 		}
 	} catch (const cosmos::ApiError &e) {
 		log_error() << "failed to send IPC message: " << e.what() << ". Closing session.\n";
-		closeSession();
+		closeSession(session);
 	}
 }
 
-void IpcHandler::closeSession() {
-	m_state = State::WAITING;
-	m_send_queue.clear();
-	m_msg_pos = 0;
+void IpcHandler::sendOutput(Session &session) {
+	if (session.send_queue.empty()) {
+		// while nothing is queued only input is monitored: the client
+		// closed the connection or sent unexpected data
+		closeSession(session);
+		return;
+	}
+
+	const auto &packet = session.send_queue.front();
+
+	try {
+		const auto sent = session.connection.send(packet.data(), packet.size());
 
-	if (!m_connection)
+		if (sent != packet.size()) {
+			log_error() << "short IPC message sent.\n";
+			closeSession(session);
+			return;
+		}
+	} catch (const cosmos::ApiError &e) {
+		// the client going away is the regular way to end a subscription
+		if (!cosmos::in_list(e.errnum(), {cosmos::Errno::BROKEN_PIPE, cosmos::Errno::CONN_RESET})) {
+			log_error() << "failed to send IPC message: " << e.what() << ". Closing session.\n";
+		}
+		closeSession(session);
 		return;
+	}
 
-	m_poller.addFD(m_listener.fd(), {cosmos::Poller::MonitorFlag::INPUT});
-	m_poller.delFD(m_connection->fd());
-	m_connection->close();
-	m_connection.reset();
-	m_send_status = cosmos::ExitStatus::SUCCESS;
+	session.queued_bytes -= packet.size();
+	session.send_queue.pop_front();
+
+	if (session.send_queue.empty()) {
+		// wait for new output, meanwhile only detect the client
+		// closing the connection
+		m_poller.modFD(session.connection.fd(), {cosmos::Poller::MonitorFlag::INPUT});
+	}
+}
+
+void IpcHandler::startWorkerJob(Session &session, std::function<std::string()> work) {
+	// std::function needs to be copyable, thus share the promise
+	auto promise = std::make_shared<std::promise<std::string>>();
+	auto &job = m_worker_jobs.emplace_back();
+	job.text = promise->get_future();
+	job.session = &session;
+	job.abandoned = std::make_shared<std::atomic<bool>>(false);
+
+	// closing the session meanwhile doesn't affect a running job, its
+	// result is discarded in this case. A job that didn't start yet is
+	// skipped.
+	m_workers.submit([work = std::move(work), promise, abandoned = job.abandoned, notify = m_job_pipe.writeEnd()]() {
+		try {
+			promise->set_value(*abandoned ? std::string{} : work());
+		} catch (const std::exception &e) {
+			// e.g. std::regex can fail on complex patterns or long lines
+			log_error() << "worker job failed: " << e.what() << "\n";
+			promise->set_value(std::string{});
+		}
+
+		try {
+			const char done = 1;
+			cosmos::File{notify, cosmos::AutoCloseFD{false}}.write(&done, sizeof(done));
+		} catch (const cosmos::ApiError &e) {
+			log_error() << "failed to signal finished worker job: " << e.what() << "\n";
+		}
+	});
+
+	session.state = State::ENCODING;
+}
+
+void IpcHandler::finishWorkerJobs() {
+	char buffer[64];
+
+	try {
+		// a single byte might stand for multiple jobs, all finished
+		// jobs are checked below anyway
+		cosmos::File{m_job_pipe.readEnd(), cosmos::AutoCloseFD{false}}.read(buffer, sizeof(buffer));
+	} catch (const cosmos::ApiError &e) {
+		log_error() << "failed to read from worker job pipe: " << e.what() << "\n";
+	}
+
+	for (auto it = m_worker_jobs.begin(); it != m_worker_jobs.end(); ) {
+		auto &job = *it;
+
+		if (job.text.wait_for(std::chrono::seconds{0}) != std::future_status::ready) {
+			it++;
+			continue;
+		}
+
+		if (auto session = job.session; session) {
+			if (auto text = job.text.get(); !text.empty()) {
+				session->send_queue.push_back(std::move(text));
+			}
+
+			session->state = State::SENDING;
+			m_poller.modFD(session->connection.fd(), {cosmos::Poller::MonitorFlag::OUTPUT});
+		}
+
+		it = m_worker_jobs.erase(it);
+	}
+}
+
+size_t IpcHandler::sendWithFD(Session &session, const char *data, const size_t len) {
+	struct iovec iov{const_cast<char*>(data), len};
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control{};
+
+	struct msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	std::memcpy(CMSG_DATA(cmsg), &session.pass_fd, sizeof(int));
+
+	const auto sent = ::sendmsg(cosmos::to_integral(session.connection.fd().raw()), &msg, MSG_NOSIGNAL);
+
+	if (sent < 0) {
+		cosmos_throw (cosmos::ApiError("sendmsg()"));
+	}
+
+	// the peer has its own copy now
+	::close(session.pass_fd);
+	session.pass_fd = -1;
+
+	return static_cast<size_t>(sent);
+}
+
+void IpcHandler::closeSession(Session &session) {
+	if (session.state == State::CLOSED)
+		return;
+
+	if (session.state == State::ENCODING) {
+		// a running job continues, but its result is discarded
+		for (auto &job: m_worker_jobs) {
+			if (job.session == &session) {
+				job.session = nullptr;
+				*job.abandoned = true;
+			}
+		}
+	}
+
+	if (session.state == State::SUBSCRIBED)
+		m_num_subscribers--;
+
+	if (&session == m_injecting) {
+		// the rest of the input is dropped, but don't leave the
+		// application in paste mode
+		if (session.input_flags & SendInputParams::BRACKETED_PASTE)
+			m_nst.term().reportPaste(false);
+		m_injecting = nullptr;
+	}
+
+	session.state = State::CLOSED;
+	session.send_queue.clear();
+	session.history_stream.reset();
+	session.msg_pos = 0;
+	session.queued_bytes = 0;
+
+	if (session.pass_fd != -1) {
+		::close(session.pass_fd);
+		session.pass_fd = -1;
+	}
+
+	session.input.clear();
+	session.input_pos = 0;
+	session.input_left = 0;
+
+	if (!session.input_paused) {
+		m_poller.delFD(session.connection.fd());
+	}
+
+	session.input_paused = false;
+	session.connection.close();
+}
+
+void IpcHandler::removeClosedSessions() {
+	m_sessions.remove_if([](const Session &session) {
+		return session.state == State::CLOSED;
+	});
 }
 
 std::string IpcHandler::childCWD() const {
@@ -1,20 +1,31 @@
 #pragma once
 
 // C++
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <deque>
-#include <optional>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
 
 // cosmos
+#include "cosmos/io/Pipe.hxx"
 #include "cosmos/io/Poller.hxx"
 #include "cosmos/net/UnixConnection.hxx"
 #include "cosmos/net/UnixListenSocket.hxx"
 
 // nst
 #include "fwd.hxx"
+#include "WorkerPool.hxx"
 
 namespace nst {
 
+// these are only forward declared to keep this header usable for nst-msg
+class HistorySnapshot;
+class HistoryStream;
+
 /// UNIX domain socket IPC handler.
 /**
  * This class deals with IPC socket requests.
@@ -23,9 +34,27 @@ namespace nst {
  * connections to access its interface. Currently the IPC is mainly used for
  * accessing the terminal screen and history contents.
  *
- * Only one session is allowed in parallel. Either the listener socket is
- * monitored in the Poller for new connection requests, or an active
- * connection is monitored for I/O.
+ * The listener socket is always monitored in the Poller for new connection
+ * requests. Each accepted connection gets its own Session with independent
+ * receive/send state, which is multiplexed on the same Poller. This way a
+ * slow client (e.g. `nst-msg -d | less`) doesn't block other clients.
+ *
+ * Replies are transmitted in packets of at most MAX_CHUNK_SIZE bytes, and
+ * each Session only sends a single packet whenever its connection becomes
+ * writable. This bounds the time spent on behalf of a single client in each
+ * main loop iteration. At most MAX_SESSIONS connections are served in
+ * parallel, further connections are closed right away.
+ *
+ * Expensive replies like the text of a history snapshot (see
+ * HistorySnapshot) or search results (see HistorySearch) are produced in
+ * a WorkerPool of at most MAX_WORKER_THREADS threads shared by all
+ * sessions. The session is resumed once the worker signals completion via
+ * m_job_pipe.
+ *
+ * Input injected via SEND_INPUT is written to the TTY in bounded steps
+ * whenever the TTY is writable, see writeInput(). Receiving further input
+ * from a client is paused while too much of it is pending, so the client
+ * is throttled by its socket buffer instead of piling up data in nst.
  *
  * Clients send a request in form of an IpcHandler::Message value. The
  * IpcHandler processes requests and replies with data, if applicable.
@@ -43,6 +72,9 @@ public: // functions
 			m_nst{nst},
 			m_poller{poller} {}
 
+	/// Waits for worker jobs that are still running, queued ones are discarded.
+	~IpcHandler();
+
 	/// Returns the address used for m_listener.
 	static std::string address();
 
@@ -56,6 +88,38 @@ public: // functions
 	 **/
 	bool checkEvent(const cosmos::Poller::PollEvent &event);
 
+	/// Returns whether any client subscribed to the terminal output.
+	bool hasSubscribers() const {
+		return m_num_subscribers != 0;
+	}
+
+	/// Forwards newly completed terminal lines to output subscribers.
+	/**
+	 * This is supposed to be called after new TTY output has been
+	 * processed. If nobody subscribed then this does nothing.
+	 **/
+	void publishOutput();
+
+	/// Returns whether SEND_INPUT data is waiting to be written to the TTY.
+	/**
+	 * While this is the case the main loop needs to monitor the TTY for
+	 * writability and call writeInput() once it is writable.
+	 **/
+	bool hasPendingInput() const;
+
+	/// Writes the next piece of SEND_INPUT data to the TTY.
+	/**
+	 * At most INPUT_WRITE_SIZE bytes are written per call, and only as
+	 * many as the TTY accepts without blocking (see TTY::tryWrite()), so
+	 * that large injections don't stall the main loop. Inputs of
+	 * different clients are written one after the other, never
+	 * interleaved.
+	 **/
+	void writeInput();
+
+	/// Fails all SEND_INPUT requests, to be called when the TTY has been hung up.
+	void dropInput();
+
 public: // types
 
 	/// Different IPC message types. This is what a client request needs to send in its initial message.
@@ -72,7 +136,101 @@ public: // types
 		/// Send the current working directory of the terminal's child process.
 		GET_CWD,
 		/// Change the active theme.
-		SET_THEME
+		SET_THEME,
+		/// Get statistics about the memory used for the scrollback history.
+		GET_HISTORY_USAGE,
+		/// Get the last N lines of the terminal buffer, N is passed as uint64_t.
+		GET_HISTORY_TAIL,
+		/// Get the lines in a range of sequence numbers, passed as SeqRange.
+		GET_HISTORY_RANGE,
+		/// Get the lines starting at a sequence number, passed as uint64_t.
+		GET_HISTORY_SINCE,
+		/// Continuously receive lines as they are output, starting at a sequence number passed as uint64_t.
+		/**
+		 * Pass FOLLOW_NEW_OUTPUT to only receive lines output after the
+		 * subscription. The connection stays open until the client or
+		 * the terminal closes it. Each packet sent starts with a
+		 * SeqRange followed by the text of the lines in this range.
+		 *
+		 * Each subscriber has a bounded buffer of
+		 * SUBSCRIBER_BUFFER_SIZE bytes. If the client doesn't keep up
+		 * then new lines are dropped instead of stalling the terminal.
+		 * Dropped lines can be detected by the client, since the
+		 * `begin` of the next SeqRange won't match the `end` of the
+		 * previous one.
+		 **/
+		SUBSCRIBE_OUTPUT,
+		/// Get a read-only file descriptor for the shared memory view of the screen, see ScreenShare.
+		/**
+		 * The file descriptor is passed as SCM_RIGHTS ancillary data
+		 * along with the status reply.
+		 **/
+		GET_SCREEN_SHARE,
+		/// Search the terminal buffer for a pattern, passed as SearchParams followed by the pattern.
+		/**
+		 * The reply contains one line per match in the format
+		 * `SEQ:COLUMN:TEXT`, where SEQ is the sequence number of the
+		 * line the match starts in, COLUMN is the zero based column of
+		 * the match and TEXT is the complete logical line containing
+		 * the match. See HistorySearch. If the HistoryIndex is enabled
+		 * then only the candidate lines found in it are searched.
+		 **/
+		SEARCH,
+		/// Write input to the child process as if it was typed, passed as SendInputParams followed by the data.
+		/**
+		 * The data follows the parameters in packets of at most
+		 * MAX_CHUNK_SIZE bytes, until SendInputParams::size bytes
+		 * have been sent. It is written to the TTY the same way
+		 * keyboard input is, i.e. subject to local echo and CRLF
+		 * translation. While more than INPUT_BUFFER_SIZE bytes of
+		 * a client are pending, no further data is received from
+		 * it.
+		 *
+		 * The status is sent once all data has been written to the
+		 * TTY, or with WAIT_CONSUMED once the child process read it.
+		 **/
+		SEND_INPUT
+	};
+
+	/// A range of line sequence numbers [begin, end).
+	/**
+	 * Replies to GET_HISTORY_TAIL, GET_HISTORY_RANGE and
+	 * GET_HISTORY_SINCE start with this structure (as well as each
+	 * packet sent to SUBSCRIBE_OUTPUT clients), describing the lines
+	 * actually contained in the reply, followed by the text of the
+	 * lines. `end` is the sequence number to pass to the next
+	 * GET_HISTORY_SINCE request to only receive new lines. If `begin` is
+	 * larger than requested then lines have been dropped from the history
+	 * meanwhile.
+	 *
+	 * Only lines above the cursor are returned, the cursor line is
+	 * typically still being written.
+	 **/
+	struct SeqRange {
+		uint64_t begin = 0;
+		uint64_t end = 0;
+	};
+
+	/// Parameters for the SEARCH request.
+	struct SearchParams {
+		/// SEARCH flag: match case insensitively (HistorySearch::Flag::IGNORE_CASE).
+		static constexpr uint32_t IGNORE_CASE = 1 << 0;
+		/// SEARCH flag: the pattern is a literal string (HistorySearch::Flag::FIXED_STRING).
+		static constexpr uint32_t FIXED_STRING = 1 << 1;
+
+		uint32_t flags = 0; ///< bitmask of the flags above
+		uint32_t limit = 0; ///< the maximum number of matches to return, 0 for no limit
+	};
+
+	/// Parameters for the SEND_INPUT request.
+	struct SendInputParams {
+		/// SEND_INPUT flag: wrap the input in bracketed paste markers, if the application enabled bracketed paste mode.
+		static constexpr uint32_t BRACKETED_PASTE = 1 << 0;
+		/// SEND_INPUT flag: only reply once the child process consumed the input, see TTY::pendingInput().
+		static constexpr uint32_t WAIT_CONSUMED = 1 << 1;
+
+		uint64_t size = 0; ///< the number of input bytes following
+		uint32_t flags = 0; ///< bitmask of the flags above
 	};
 
 public: // data
@@ -80,24 +238,98 @@ public: // data
 	/// Largest packet size to send/receive.
 	static constexpr size_t MAX_CHUNK_SIZE = 1024 * 64;
 
+	/// Maximum number of concurrent client connections.
+	static constexpr size_t MAX_SESSIONS = 16;
+
+	/// Maximum number of bytes queued for a SUBSCRIBE_OUTPUT client before lines are dropped.
+	static constexpr size_t SUBSCRIBER_BUFFER_SIZE = 1024 * 1024;
+
+	/// SUBSCRIBE_OUTPUT parameter to only receive output produced after the subscription.
+	static constexpr uint64_t FOLLOW_NEW_OUTPUT = UINT64_MAX;
+
+	/// Maximum length of a SEARCH pattern in bytes.
+	static constexpr size_t MAX_SEARCH_PATTERN = 4096;
+
+	/// Number of SEND_INPUT bytes buffered per client before receiving further data is paused.
+	static constexpr size_t INPUT_BUFFER_SIZE = 1024 * 256;
+
+	/// Maximum number of SEND_INPUT bytes written to the TTY in one go.
+	static constexpr size_t INPUT_WRITE_SIZE = 1024 * 4;
+
+	/// Interval in milliseconds in which sessions waiting for their input to be consumed are checked.
+	static constexpr long DRAIN_CHECK_INTERVAL = 10;
+
+	/// Maximum number of threads producing replies, further requests are queued.
+	static constexpr size_t MAX_WORKER_THREADS = 4;
+
 protected: // types
 
 	/// The current state of an IPC session.
 	enum class State {
-		/// Waiting for new connections.
-		WAITING,
-		/// A connection is being processed, request is being collected.
+		/// Request is being collected.
 		RECEIVING,
+		/// The reply is being produced by a worker thread, see WorkerJob.
+		ENCODING,
 		/// Ongoing transmission to fulfill a request.
-		SENDING
+		SENDING,
+		/// Client subscribed to the terminal output, see SUBSCRIBE_OUTPUT.
+		SUBSCRIBED,
+		/// SEND_INPUT data is being received and written to the TTY.
+		INJECTING,
+		/// Waiting for the child process to consume the SEND_INPUT data, see WAIT_CONSUMED.
+		DRAINING,
+		/// The connection has been closed, the session is about to be removed.
+		CLOSED
+	};
+
+	/// Per-connection state of an IPC client.
+	struct Session {
+		// defined out of line, HistoryStream is incomplete here
+		explicit Session(cosmos::UnixConnection &&conn);
+		~Session();
+
+		cosmos::UnixConnection connection;
+		State state = State::RECEIVING;
+		std::deque<std::string> send_queue;
+		size_t msg_pos = 0; ///< number of bytes of front element in send_queue that have already been sent
+		/// Produces the history text for GET_HISTORY and ranged requests once send_queue has been sent.
+		std::unique_ptr<HistoryStream> history_stream;
+		size_t next_seq = 0; ///< for subscribers: the sequence number of the next line to publish
+		size_t queued_bytes = 0; ///< for subscribers: the number of bytes in send_queue
+		int pass_fd = -1; ///< file descriptor to pass along with the next packet sent, owned by the session
+		/// For SEND_INPUT: received data, the part starting at input_pos still needs to be written to the TTY.
+		std::string input;
+		size_t input_pos = 0;
+		uint64_t input_left = 0; ///< for SEND_INPUT: number of bytes still to be received from the client
+		uint32_t input_flags = 0; ///< for SEND_INPUT: SendInputParams flags
+		/// For SEND_INPUT: receiving is paused since `input` is full, the connection isn't monitored meanwhile.
+		bool input_paused = false;
+		bool input_started = false; ///< for SEND_INPUT: writing to the TTY has started
+
+		/// Returns the number of SEND_INPUT bytes not yet written to the TTY.
+		size_t pendingInput() const {
+			return input.size() - input_pos;
+		}
+
+		/// Returns whether the session's SEND_INPUT data can be written (or finished) right now.
+		bool canWriteInput() const {
+			return state == State::INJECTING && (pendingInput() != 0 || input_left == 0);
+		}
+	};
+
+	/// A reply being produced by a worker thread.
+	struct WorkerJob {
+		std::future<std::string> text;
+		Session *session = nullptr; ///< the session waiting for the text, or nullptr if it has been closed meanwhile
+		std::shared_ptr<std::atomic<bool>> abandoned; ///< set when the session is closed, a job not started yet is skipped then
 	};
 
 protected: // functions
 
 	/// Handles the initial I/O on an IPC connection.
-	bool receiveCommand();
+	bool receiveCommand(Session &session);
 
-	/// Receive arbitrary data from the current connection.
+	/// Receive arbitrary data from the session's connection.
 	/**
 	 * This function can return a size larger than \c max_size when the
 	 * received message has been truncated.
@@ -105,25 +337,77 @@ protected: // functions
 	 * On error an exception is thrown, the session will be closed in this
 	 * case.
 	 **/
-	size_t receiveData(char *buffer, const size_t max_size);
+	size_t receiveData(Session &session, char *buffer, const size_t max_size);
 
 	/// Once a valid request has been received this processes it.
-	bool processCommand(const Message message);
+	bool processCommand(Session &session, const Message message);
 
-	/// Stores the given RPC result in m_send_queue.
-	void queueStatus(const cosmos::ExitStatus status);
+	/// Stores the given RPC result in the session's send queue.
+	void queueStatus(Session &session, const cosmos::ExitStatus status);
 
 	/// Handles a SET_THEME command.
-	bool handleSetTheme();
+	bool handleSetTheme(Session &session);
+
+	/// Handles the GET_HISTORY_TAIL, GET_HISTORY_RANGE and GET_HISTORY_SINCE commands.
+	bool handleHistoryRange(Session &session, const Message message);
+
+	/// Handles a SEARCH command.
+	bool handleSearch(Session &session);
+
+	/// Handles a SUBSCRIBE_OUTPUT command.
+	bool handleSubscribe(Session &session);
+
+	/// Handles a SEND_INPUT command.
+	bool handleSendInput(Session &session);
+
+	/// Receives the next packet of SEND_INPUT data from the session's connection.
+	void receiveInput(Session &session);
+
+	/// Completes a SEND_INPUT request whose data has been written to the TTY completely.
+	void finishInput(Session &session);
+
+	/// Replies to DRAINING sessions whose input has been consumed by the child process.
+	void checkDrained();
+
+	/// Starts or stops m_drain_timer.
+	void armDrainTimer(const bool on);
+
+	/// Queues packets for lines completed since the last call for a subscribed session.
+	void queueOutput(Session &session);
 
 	/// If we need to reply with data then this manages the transmission.
-	void sendData();
+	void sendData(Session &session);
+
+	/// Transmits the data queued for a subscribed session.
+	void sendOutput(Session &session);
+
+	/// Sends a packet passing the session's pass_fd as SCM_RIGHTS ancillary data.
+	size_t sendWithFD(Session &session, const char *data, const size_t len);
+
+	/// Returns the data to send next, producing a new chunk from the session's history stream if necessary.
+	/**
+	 * Returns `nullptr` if there's nothing left to send.
+	 **/
+	const std::string* nextSendData(Session &session);
+
+	/// Runs `work` in m_workers, its result will be sent to the given session.
+	/**
+	 * Any data needed by `work` must be owned by the function object, it
+	 * must not access the Term or the IpcHandler, apart from m_workers.
+	 **/
+	void startWorkerJob(Session &session, std::function<std::string()> work);
+
+	/// Hands over the results of finished WorkerJobs to their sessions.
+	void finishWorkerJobs();
+
+	/// Closes the session's connection, it will be removed in removeClosedSessions().
+	void closeSession(Session &session);
 
-	/// Closes all session state and accepts new connections again.
-	void closeSession();
+	/// Drops all sessions that have been closed.
+	void removeClosedSessions();
 
-	/// Returns the current history buffer.
-	std::string history() const;
+	/// Returns a textual report of the memory used for the history buffer.
+	std::string historyUsage() const;
 
 	/// Accept a new connection, checking the peer's permissions.
 	void acceptConnection();
@@ -134,13 +418,17 @@ protected: // data
 
 	Nst &m_nst;
 	cosmos::Poller &m_poller;
-	State m_state = State::WAITING;
 	cosmos::UnixSeqPacketListenSocket m_listener;
-	std::optional<cosmos::UnixConnection> m_connection;
-	std::string m_snapshot;
-	cosmos::ExitStatus m_send_status = cosmos::ExitStatus::SUCCESS;
-	std::deque<std::string> m_send_queue;
-	size_t m_msg_pos = 0; ///< number of bytes of front element in m_send_queue that have already been sent
+	std::list<Session> m_sessions; ///< all active client connections
+	/// The history stored by SNAPSHOT_HISTORY, shared with running WorkerJobs.
+	std::shared_ptr<const HistorySnapshot> m_snapshot;
+	std::list<WorkerJob> m_worker_jobs; ///< replies currently being produced in worker threads
+	cosmos::Pipe m_job_pipe; ///< WorkerJobs write a byte into this pipe when done, to wake up the main loop
+	/// Threads for WorkerJobs, declared after m_job_pipe so it is destroyed first.
+	WorkerPool m_workers{MAX_WORKER_THREADS};
+	size_t m_num_subscribers = 0; ///< number of sessions in SUBSCRIBED state
+	Session *m_injecting = nullptr; ///< the session currently writing its SEND_INPUT data to the TTY
+	int m_drain_timer = -1; ///< timerfd for periodically checking DRAINING sessions
 };
 
 } // end ns
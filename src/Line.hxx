@@ -2,11 +2,14 @@
 
 // C++
 #include <algorithm>
-#include <vector>
 #include <cassert>
+#include <memory>
+#include <vector>
 
 // nst
+#include "CompressedLine.hxx"
 #include "Glyph.hxx"
+#include "GlyphPool.hxx"
 
 namespace nst {
 
@@ -15,9 +18,10 @@ namespace nst {
  * This is a rather simple wrapper around a std::vector, because we want to
  * control the iterator ranges applied to Lines.
  *
- * We are not doing full reflow of lines upon window resize, because of the
- * involved complexity, but we also don't want to lose information if a window
- * is decreased in size temporarily (e.g. due to a tiling window manager).
+ * Screens with scrollback buffer rewrap their lines upon window resize (see
+ * Screen::reflowsLines()). Where Lines are only resized instead, we don't
+ * want to lose information if a window is decreased in size temporarily
+ * (e.g. due to a tiling window manager).
  *
  * To achieve this we keep existing columns that would otherwise be dropped
  * when the number of columns is decreased. The actual vector never shrinks but
@@ -40,15 +44,31 @@ namespace nst {
  * Currently this is done in Term::clearRegion(), to clear lines that are
  * edited using various operations or when scrolling the screen (not history)
  * up/down. It seems this is enough for most situations.
+ *
+ * The Glyph storage is allocated from the GlyphPool, which recycles the
+ * memory of Lines that are compressed or cleared.
+ *
+ * Lines that are part of the scrollback history can be compressed via
+ * compress(). In this state the Glyph vector is released and only
+ * size(), empty(), isWrapped(), resize() and clear() may be used. expand()
+ * restores the regular representation. The Screen takes care of expanding
+ * Lines before they're accessed, see Screen::operator[].
  **/
 class Line {
 public: // types
 
-	using GlyphVector = std::vector<Glyph>;
+	using GlyphVector = nst::GlyphVector;
 	using iterator = GlyphVector::iterator;
 	using const_iterator = GlyphVector::const_iterator;
 	using value_type = GlyphVector::value_type;
 
+	/// Accuracy of the attribute summary of a Line, see attrSummary().
+	enum class SummaryState : uint8_t {
+		UNKNOWN,  ///< Glyphs have been added without updating the summary
+		SUPERSET, ///< the summary contains all attributes in use, possibly more
+		EXACT     ///< the summary matches the attributes in use
+	};
+
 public: // functions
 
 	explicit Line(const bool keep_data_on_shrink) :
@@ -68,20 +88,33 @@ public: // functions
 		m_dirty = other.m_dirty;
 		m_glyphs = other.m_glyphs;
 		m_cols = other.m_cols;
+		m_attrs = other.m_attrs;
+		m_summary_state = other.m_summary_state;
+		// the compressed representation is immutable, thus it can be
+		// shared, e.g. with HistorySnapshot
+		m_compressed = other.m_compressed;
 		return *this;
 	}
 
 	Line& operator=(Line &&other) noexcept {
 		m_dirty = other.m_dirty;
 		m_cols = other.m_cols;
+		m_attrs = other.m_attrs;
+		m_summary_state = other.m_summary_state;
 		m_glyphs = std::move(other.m_glyphs);
+		m_compressed = std::move(other.m_compressed);
 		m_keep_data_on_shrink = other.m_keep_data_on_shrink;
 		return *this;
 	}
 
 	/// Returns whether the line has a WRAP attribute set for the last element
 	bool isWrapped() const {
-		return !empty() && back().mode[Attr::WRAP];
+		if (empty())
+			return false;
+		else if (m_compressed)
+			return m_compressed->flagsAt(m_cols - 1)[Attr::WRAP];
+
+		return back().isWrapped();
 	}
 
 	bool isDirty() const {
@@ -94,16 +127,126 @@ public: // functions
 
 	void clear() {
 		m_glyphs.clear();
+		m_compressed.reset();
 		m_cols = 0;
+		setAttrSummary(Glyph::AttrBitMask{});
 	}
 
 	void resize(GlyphVector::size_type size, const Glyph &defval = Glyph()) {
-		if (!m_keep_data_on_shrink || size > m_glyphs.size()) {
+		if (!m_keep_data_on_shrink || size > rawSize()) {
+			if (size > rawSize()) {
+				// the style of `defval` is not known here
+				m_summary_state = SummaryState::UNKNOWN;
+			}
+			const auto was_compressed = isCompressed();
+			expand();
 			m_glyphs.resize(size, defval);
+			if (was_compressed) {
+				compress();
+			}
 		}
 		m_cols = size;
 	}
 
+	/// Returns whether the Line is currently stored in compressed form.
+	bool isCompressed() const { return m_compressed != nullptr; }
+
+	/// Replace the Glyph vector by a compact CompressedLine representation.
+	/**
+	 * If the Line cannot be compressed then it simply stays in regular
+	 * representation.
+	 **/
+	void compress() {
+		if (m_compressed || m_glyphs.empty())
+			return;
+
+		m_compressed = CompressedLine::encode(m_glyphs);
+
+		if (m_compressed) {
+			// actually release the memory
+			GlyphVector{}.swap(m_glyphs);
+		}
+	}
+
+	/// Restore the regular Glyph vector representation, if necessary.
+	void expand() {
+		if (m_compressed) {
+			m_compressed->decode(m_glyphs);
+			m_compressed.reset();
+		}
+	}
+
+	/// Copy the content of `other` into this Line in expanded form.
+	/**
+	 * This reuses the existing Glyph allocation of this object, which is
+	 * helpful when looking at a larger number of compressed Lines
+	 * temporarily.
+	 **/
+	void assignExpanded(const Line &other) {
+		m_dirty = other.m_dirty;
+		m_cols = other.m_cols;
+		m_attrs = other.m_attrs;
+		m_summary_state = other.m_summary_state;
+		m_compressed.reset();
+
+		if (other.m_compressed) {
+			other.m_compressed->decode(m_glyphs);
+		} else {
+			m_glyphs = other.m_glyphs;
+		}
+	}
+
+	/// Replace the content of this Line by the given compressed representation.
+	void assignCompressed(std::unique_ptr<CompressedLine> compressed) {
+		m_cols = compressed->size();
+		m_summary_state = SummaryState::UNKNOWN;
+		m_compressed = std::move(compressed);
+		// keep the allocation around for a later expand()
+		m_glyphs.clear();
+	}
+
+	/// Returns a summary of the rendering attributes used by the Glyphs of this Line.
+	/**
+	 * The summary covers the GlyphStyle modes of all Glyphs (including
+	 * hidden columns) and the WIDE flag. Since Glyphs only carry a
+	 * StyleID, the summary needs to be maintained by the code changing
+	 * Glyphs, which is Term. Depending on summaryState() the summary may
+	 * contain more attributes than actually used or may be unknown
+	 * altogether, see Term::lineHasAttr().
+	 **/
+	Glyph::AttrBitMask attrSummary() const { return m_attrs; }
+
+	SummaryState summaryState() const { return m_summary_state; }
+
+	/// Add attributes of newly written Glyphs to the summary.
+	void addAttrs(const Glyph::AttrBitMask attrs) {
+		m_attrs.set(attrs);
+		if (m_summary_state == SummaryState::EXACT) {
+			// the overwritten Glyphs may have used other attributes
+			m_summary_state = SummaryState::SUPERSET;
+		}
+	}
+
+	/// Set the exact attribute summary of the Line.
+	void setAttrSummary(const Glyph::AttrBitMask attrs) const {
+		m_attrs = attrs;
+		m_summary_state = SummaryState::EXACT;
+	}
+
+	/// Grants access to the compressed representation, if any.
+	const CompressedLine* compressed() const { return m_compressed.get(); }
+
+	/// Returns the number of bytes occupied by this Line including heap allocations.
+	size_t memoryUsage() const {
+		size_t ret = sizeof(*this) + m_glyphs.capacity() * sizeof(Glyph);
+
+		if (m_compressed) {
+			ret += m_compressed->memoryUsage();
+		}
+
+		return ret;
+	}
+
 	bool empty() const { return m_cols == 0; }
 
 	auto size() const { return m_cols; }
@@ -147,15 +290,26 @@ public: // functions
 
 	/// Discard any saved hidden columns.
 	void shrinkToPhysical() {
+		expand();
 		m_glyphs.resize(m_cols);
 	}
 
+protected: // functions
+
+	/// Returns the number of Glyphs stored including hidden columns.
+	size_t rawSize() const {
+		return m_compressed ? m_compressed->size() : m_glyphs.size();
+	}
+
 protected: // data
 
 	mutable bool m_dirty = false;
 	bool m_keep_data_on_shrink = false;
+	mutable SummaryState m_summary_state = SummaryState::UNKNOWN; ///< accuracy of m_attrs
+	mutable Glyph::AttrBitMask m_attrs; ///< summary of the rendering attributes in use, see attrSummary()
 	size_t m_cols = 0; ///< number of columns actually used in m_glyphs
 	GlyphVector m_glyphs;
+	std::shared_ptr<const CompressedLine> m_compressed; ///< compact representation for history lines, if set then m_glyphs is empty, shared between copies of the Line
 };
 
 using LineVector = std::vector<Line>;
@@ -1,5 +1,8 @@
-// cosmos
-#include "cosmos/error/RuntimeError.hxx"
+// C++
+#include <algorithm>
+#include <deque>
+#include <initializer_list>
+#include <iterator>
 
 // nst
 #include "Screen.hxx"
@@ -7,7 +10,111 @@
 
 namespace nst {
 
-void Screen::setDimension(const TermSize size, const Glyph defattrs) {
+namespace {
+
+/// A Glyph within a logical line whose position should be followed during rewrapping.
+struct Anchor {
+	size_t index = SIZE_MAX; ///< the index of the Glyph in the logical line, SIZE_MAX if unused
+	CharPos pos; ///< the resulting position, `y` is relative to the first rewrapped Line
+};
+
+/// Appends the Glyphs of a physical line to the Glyphs of the logical line it belongs to.
+/**
+ * If `last` is set then this is the final physical line of the logical
+ * line and trailing blanks are dropped, unless they are needed to cover
+ * `min_len` columns.
+ *
+ * \return The index in `glyphs` at which the Glyphs of `line` start.
+ **/
+size_t append_glyphs(GlyphVector &glyphs, const Line &line, const bool last, const size_t min_len = 0) {
+	size_t len = line.size();
+
+	if (last) {
+		len = std::max(static_cast<size_t>(line.usedLength()), std::min(min_len, len));
+	}
+
+	// a blank at the end of the previous physical line may have been
+	// added for a wide character that didn't fit anymore, drop it
+	if (len != 0 && line[0].isWide() && !glyphs.empty() && glyphs.back().isEmpty()) {
+		glyphs.pop_back();
+	}
+
+	const auto start = glyphs.size();
+	glyphs.insert(glyphs.end(), line.begin(), line.begin() + len);
+
+	if (len != 0) {
+		glyphs.back().flags.reset(Attr::WRAP);
+	}
+
+	return start;
+}
+
+/// Wraps the Glyphs of a logical line into Lines of `cols` columns, which are appended to `out`.
+/**
+ * New cells are initialized from `fill`. The positions of the given
+ * `anchors` are determined along the way.
+ **/
+template <typename LINES>
+void wrap_glyphs(const GlyphVector &glyphs, const size_t cols, const Glyph &fill,
+		LINES &out, const std::initializer_list<Anchor*> anchors) {
+	auto addLine = [&]() {
+		out.emplace_back(Line{/*keep_data_on_shrink=*/true});
+		out.back().resize(cols, fill);
+		out.back().setDirty(true);
+	};
+
+	int row = 0;
+	size_t col = 0;
+	addLine();
+
+	for (size_t i = 0; i < glyphs.size(); i++) {
+		const auto &glyph = glyphs[i];
+		CharPos pos;
+
+		if (glyph.isDummy()) {
+			// these are recreated following their wide character
+			pos = CharPos{static_cast<int>(col ? col - 1 : 0), row};
+		} else {
+			// we can't display wide characters in a single column
+			const size_t width = glyph.isWide() && cols > 1 ? 2 : 1;
+
+			if (col + width > cols) {
+				out.back().back().setWrapped();
+				addLine();
+				row++;
+				col = 0;
+			}
+
+			auto &line = out.back();
+			line[col] = glyph;
+			pos = CharPos{static_cast<int>(col), row};
+
+			if (width == 2) {
+				line[col + 1] = glyph;
+				line[col + 1].makeDummy();
+			}
+
+			col += width;
+		}
+
+		for (auto anchor: anchors) {
+			if (anchor->index == i) {
+				anchor->pos = pos;
+			}
+		}
+	}
+
+	// anchors past the end of the logical line
+	for (auto anchor: anchors) {
+		if (anchor->index != SIZE_MAX && anchor->index >= glyphs.size()) {
+			anchor->pos = CharPos{static_cast<int>(std::min(col, cols - 1)), row};
+		}
+	}
+}
+
+} // end anon ns
+
+void Screen::setDimension(const TermSize size, const Glyph defattrs, CharPos &cursor) {
 
 	// stop any active scrolling since the operations are destined for the
 	// current screen
@@ -16,19 +123,18 @@ void Screen::setDimension(const TermSize size, const Glyph defattrs) {
 	// on the alt screen don't do stunts with restoring columns lost due to resize.
 	const auto init_line = Line{/*keep_data_on_shrink=*/!m_is_alt_screen};
 
-	/* if we use a ring buffer with scroll back history then never
-	 * change the ring buffer's size, it will always stick at
-	 * m_history_len. If there is no history len then we need to
-	 * adjust the size to the current terminal dimensions though
-	 * (e.g. for the alt screen).
+	/* if we use a ring buffer with scroll back history then it starts
+	 * out with the size of the screen and grows on demand up to
+	 * m_history_len history lines (see growRing()). If there is no
+	 * history len then we need to adjust the size to the current
+	 * terminal dimensions though (e.g. for the alt screen).
 	 */
 	if (m_lines.empty()) {
 		/* we need a buffer size of at least m_rows + 1 so that the
 		 * custom iterator type works correctly, because we need a
 		 * valid end() position that is not part of the current screen
 		 */
-		const auto bufsize = m_history_len + size.rows + 1;
-		m_lines.resize(bufsize, init_line);
+		m_lines.resize(size.rows + 1, init_line);
 	} else if (m_history_len == 0) {
 		if (m_cur_pos != 0) {
 			std::copy(this->begin(), this->end(), m_lines.begin());
@@ -36,19 +142,26 @@ void Screen::setDimension(const TermSize size, const Glyph defattrs) {
 		}
 
 		m_lines.resize(size.rows + 1, init_line);
-	} else if (size_t(size.rows) > m_lines.size()) {
-		if (m_cur_pos == 0) {
-			m_lines.resize(size.rows + m_history_len, init_line);
-		} else {
-			// we don't want to reorganize the ring buffer, the
-			// scroll back buffer should be large enough to allow
-			// larger window sizes
-			cosmos_throw(cosmos::RuntimeError{"Requested terminal size larger than scroll ring buffer"});
-		}
+	} else {
+		// keep the populated history if the screen grows
+		growRing(size.rows, m_history_used);
+	}
+
+	if (reflowsLines() && m_cols != 0 && m_cols != size_t(size.cols)) {
+		m_fill = defattrs;
+		reflowView(size, cursor);
+		return;
+	}
+
+	// the screen may grow into the oldest history lines
+	if (const auto max_history = m_lines.size() - size.rows; m_history_used > max_history) {
+		archiveOldest(m_history_used - max_history);
 	}
 
 	const auto old_rows = m_rows;
 	m_rows = size.rows;
+	m_cols = size.cols;
+	m_fill = defattrs;
 
 	// clear rows at the bottom that are no longer visible
 	if (m_rows < old_rows && hasScrollBuffer()) {
@@ -58,32 +171,291 @@ void Screen::setDimension(const TermSize size, const Glyph defattrs) {
 		}
 	}
 
-	if (size_t(size.cols) == this->begin()->size()) {
-		return;
-	}
-
 	// unconditionally resize the visible screen to the new number
 	// of cols, in case yet unallocated lines have come into view
 	//
 	// the initialization of newly appearing cells on the visible screen
 	// will be done by the caller (in Term).
+	//
+	// history lines are adjusted lazily in prepareLine(), which avoids
+	// touching the complete ring buffer on each resize.
 	for (auto &row: *this) {
+		row.expand();
 		row.resize(size.cols, defattrs);
 	}
+}
 
-	// in a second step resize any history lines in the ring buffer, but
-	// only if they're already allocated
-	for (auto &row: m_lines) {
-		if (row.empty())
-			continue;
+void Screen::reflowView(const TermSize size, CharPos &cursor) {
+	const auto old_rows = static_cast<ssize_t>(m_rows);
+	const auto new_rows = static_cast<size_t>(size.rows);
+	const auto new_cols = static_cast<size_t>(size.cols);
+	cursor.clampY(0, old_rows - 1);
 
-		// when increasing the size then defattrs will be
-		// applied to new columns
-		row.resize(size.cols, defattrs);
+	// a logical line might continue from the history into the screen
+	ssize_t start = 0;
+	while (-start < static_cast<ssize_t>(m_history_used) && m_lines[bufferPos(start - 1)].isWrapped()) {
+		start--;
+	}
+
+	// blank lines at the bottom don't need to be rewrapped
+	ssize_t end = old_rows;
+	while (end - 1 > cursor.y) {
+		const auto &line = m_lines[bufferPos(end - 1)];
+		if (line.isWrapped() || line.usedLength() != 0)
+			break;
+		end--;
 	}
+
+	std::vector<Line> out;
+	GlyphVector glyphs;
+	// the new positions of the cursor and the old top of the screen
+	CharPos new_cursor, new_top;
+
+	for (auto pos = start; pos < end; ) {
+		Anchor cursor_anchor, top_anchor;
+		glyphs.clear();
+
+		// collect the Glyphs of one logical line
+		while (true) {
+			auto &line = m_lines[bufferPos(pos)];
+			line.expand();
+			const bool last = !line.isWrapped() || pos + 1 == end;
+			const auto is_cursor_line = pos == cursor.y;
+			const auto first = append_glyphs(glyphs, line, last, is_cursor_line ? cursor.x + 1 : 0);
+
+			if (pos == 0) {
+				top_anchor.index = first;
+			}
+			if (is_cursor_line) {
+				cursor_anchor.index = first + cursor.x;
+			}
+
+			pos++;
+
+			if (last)
+				break;
+		}
+
+		const auto first_row = static_cast<int>(out.size());
+		wrap_glyphs(glyphs, new_cols, m_fill, out, {&cursor_anchor, &top_anchor});
+
+		if (cursor_anchor.index != SIZE_MAX) {
+			new_cursor = cursor_anchor.pos.nextLine(first_row);
+		}
+		if (top_anchor.index != SIZE_MAX) {
+			new_top = top_anchor.pos.nextLine(first_row);
+		}
+	}
+
+	// the number of rewrapped lines that go into the history. keep the
+	// top of the screen in place, unless the cursor would be off screen.
+	auto history = static_cast<size_t>(std::max(new_top.y, new_cursor.y - static_cast<int>(new_rows) + 1));
+
+	// lines that moved from the screen into the history get new
+	// numbers. If rewrapping joined lines then the numbering is kept,
+	// sequence numbers never move backwards. The distance of the older
+	// history lines to the screen changes, historySeq() reflects this.
+	if (const auto pushed = static_cast<ssize_t>(history) + start; pushed > 0) {
+		m_pushed_lines += static_cast<size_t>(pushed);
+	}
+	moveHistoryPos(static_cast<ssize_t>(history) + start);
+
+	// archive the oldest lines if they don't fit into the ring buffer anymore
+	auto older_history = m_history_used - static_cast<size_t>(-start);
+	growRing(new_rows, older_history + history);
+	const auto max_history = m_lines.size() - new_rows;
+
+	if (const auto needed = older_history + history; needed > max_history) {
+		const auto count = std::min(older_history, needed - max_history);
+		archiveOldest(count);
+		older_history -= count;
+	}
+
+	if (history > max_history) {
+		const auto drop = history - max_history;
+
+		if (m_archive) {
+			for (size_t i = 0; i < drop; i++) {
+				m_archive->append(out[i]);
+			}
+		}
+
+		out.erase(out.begin(), out.begin() + drop);
+		new_cursor.y -= static_cast<int>(drop);
+		history = max_history;
+	}
+
+	// replace the old lines by the rewrapped ones, starting from the
+	// first rewrapped history line. older history lines stay in place.
+	const auto num_lines = m_lines.size();
+	const auto base = bufferPos(start);
+
+	for (size_t i = 0; i < static_cast<size_t>(old_rows - start); i++) {
+		m_lines[(base + i) % num_lines].clear();
+	}
+
+	for (size_t i = 0; i < history + new_rows; i++) {
+		auto &line = m_lines[(base + i) % num_lines];
+
+		if (i < out.size()) {
+			line = std::move(out[i]);
+		} else {
+			line.clear();
+			line.resize(new_cols, m_fill);
+			line.setDirty(true);
+		}
+	}
+
+	m_cur_pos = (base + history) % num_lines;
+	m_rows = new_rows;
+	m_cols = new_cols;
+	m_history_used = older_history + history;
+	m_reflowed = history;
+
+	compressHistory(-static_cast<ssize_t>(history), 0);
+
+	cursor = CharPos{std::min(new_cursor.x, size.cols - 1), new_cursor.y - static_cast<int>(history)};
 }
 
-std::string Screen::asText(const CursorState &cursor) const {
+void Screen::reflowHistory(const size_t lines) {
+	if (!reflowsLines())
+		return;
+
+	GlyphVector glyphs;
+	std::vector<Line> wrapped;
+	std::deque<Line> out;
+
+	while (m_reflowed < lines && m_reflowed < m_history_used) {
+		const auto done = static_cast<ssize_t>(m_reflowed);
+		const auto oldest = -static_cast<ssize_t>(m_history_used);
+		const auto wanted = std::max(lines - m_reflowed, m_reflowed + m_rows);
+		ssize_t end = -done;
+		out.clear();
+
+		// collect and rewrap whole logical lines, newest first
+		while (end > oldest && out.size() < wanted) {
+			auto begin = end - 1;
+			while (begin > oldest && m_lines[unscrolledPos(begin - 1)].isWrapped()) {
+				begin--;
+			}
+
+			glyphs.clear();
+
+			for (auto pos = begin; pos < end; pos++) {
+				auto &line = m_lines[unscrolledPos(pos)];
+				line.expand();
+				append_glyphs(glyphs, line, pos + 1 == end);
+			}
+
+			wrapped.clear();
+			wrap_glyphs(glyphs, m_cols, m_fill, wrapped, {});
+			out.insert(out.begin(), std::make_move_iterator(wrapped.begin()), std::make_move_iterator(wrapped.end()));
+			end = begin;
+		}
+
+		// archive the oldest lines if they don't fit into the ring buffer anymore
+		const auto older = m_history_used - static_cast<size_t>(-end);
+		growRing(m_rows, older + m_reflowed + out.size());
+
+		if (const auto needed = older + m_reflowed + out.size(); needed > maxHistoryLines()) {
+			archiveOldest(std::min(older, needed - maxHistoryLines()));
+		}
+
+		// the older lines move away from the screen by this amount,
+		// including those that end up in the archive
+		moveHistoryPos(static_cast<ssize_t>(out.size()) - (-done - end));
+
+		while (out.size() > maxHistoryLines() - m_reflowed) {
+			if (m_archive) {
+				m_archive->append(out.front());
+			}
+			out.pop_front();
+		}
+
+		const auto consumed = -done - end;
+		const auto diff = static_cast<ssize_t>(out.size()) - consumed;
+		const auto rows = static_cast<ssize_t>(m_rows);
+
+		// move the newer lines to make room for the rewrapped ones
+		if (diff > 0) {
+			for (auto pos = rows - 1; pos >= -done; pos--) {
+				m_lines[unscrolledPos(pos + diff)] = std::move(m_lines[unscrolledPos(pos)]);
+			}
+		} else if (diff < 0) {
+			for (auto pos = -done; pos < rows; pos++) {
+				m_lines[unscrolledPos(pos + diff)] = std::move(m_lines[unscrolledPos(pos)]);
+			}
+		}
+
+		m_cur_pos = (m_cur_pos + m_lines.size() + diff) % m_lines.size();
+
+		// lines that are now located past the end of the screen
+		for (auto pos = rows; pos < rows - diff; pos++) {
+			m_lines[unscrolledPos(pos)].clear();
+		}
+
+		const auto first = -done - static_cast<ssize_t>(out.size());
+
+		for (size_t i = 0; i < out.size(); i++) {
+			m_lines[unscrolledPos(first + static_cast<ssize_t>(i))] = std::move(out[i]);
+		}
+
+		// the numbers of the newer lines stay the same, the
+		// rewrapped and older lines are renumbered, see historySeq()
+		m_history_used = static_cast<size_t>(static_cast<ssize_t>(m_history_used) + diff);
+		m_reflowed += out.size();
+
+		compressHistory(first, -done);
+	}
+}
+
+void Screen::appendText(const Line &orig, const ClusterTable &clusters, std::string &out, Line &expanded) {
+	if (orig.empty())
+		return;
+
+	if (orig.isCompressed()) {
+		expanded.assignExpanded(orig);
+	}
+
+	const auto &line = orig.isCompressed() ? expanded : orig;
+	const auto used_cols = line.usedLength();
+
+	for (auto it = line.raw().begin(); it < line.raw().begin() + used_cols; it++) {
+		clusters.encode(*it, out);
+	}
+
+	if (!line.raw().back().isWrapped()) {
+		utf8::encode(Rune{'\n'}, out);
+	}
+}
+
+const Line& Screen::lineAtSeq(const size_t seq, Line &buffer) const {
+	if (seq >= m_pushed_lines) {
+		return m_lines[unscrolledPos(static_cast<ssize_t>(seq - m_pushed_lines))];
+	}
+
+	const auto distance = m_pushed_lines - seq;
+
+	if (distance <= m_history_used) {
+		return m_lines[unscrolledPos(-static_cast<ssize_t>(distance))];
+	}
+
+	m_archive->load(distance - m_history_used - 1, buffer);
+	return buffer;
+}
+
+HistoryArchive::Pin Screen::pinArchived(const size_t begin, const size_t end) const {
+	// the sequence number after the newest archived line
+	const auto archive_end = std::min(end, m_pushed_lines - std::min(m_pushed_lines, m_history_used));
+
+	if (!m_archive || begin >= archive_end)
+		return {};
+
+	// see lineAtSeq()
+	return m_archive->pin(m_pushed_lines - begin - m_history_used - 1, archive_end - begin);
+}
+
+std::string Screen::asText(const CursorState &cursor, const ClusterTable &clusters) const {
 	std::string ret;
 
 	/*
@@ -98,82 +470,201 @@ std::string Screen::asText(const CursorState &cursor) const {
 	 * - only if this position is beyond the current cursor position,
 	 *   trigger the logic.
 	 */
-	auto reachedEndOfScreen = [&cursor,this](const std::optional<size_t> screen_pos) {
+	auto reachedEndOfScreen = [&cursor,this](const size_t screen_pos) {
 		if (m_is_alt_screen)
 			return false;
-		else if (!screen_pos)
-			return false;
 		// skip the current line which is helpful for `nst-msg -d | grep text`, to avoid matching the query itself
-		else if (static_cast<int>(*screen_pos) < cursor.position().y)
+		else if (static_cast<int>(screen_pos) < cursor.position().y)
 			return false;
 		else
 			return true;
 	};
 
-	auto addLine = [&ret](const Line &line) {
-		if (line.empty())
-			return;
+	// compressed lines are expanded into this temporary Line
+	Line expanded{/*keep_data_on_shrink=*/true};
+
+	auto addLine = [&ret, &expanded, &clusters](const Line &line) {
+		appendText(line, clusters, ret, expanded);
+	};
 
-		const auto used_cols = line.usedLength();
+	if (m_archive) {
+		Line archived{/*keep_data_on_shrink=*/true};
 
-		for (auto it = line.raw().begin(); it < line.raw().begin() + used_cols; it++) {
-			utf8::encode(it->rune, ret);
+		for (auto index = m_archive->size(); index > 0; index--) {
+			m_archive->load(index - 1, archived);
+			addLine(archived);
 		}
+	}
 
-		if (!line.raw().back().isWrapped()) {
-			utf8::encode(Rune{'\n'}, ret);
-		}
-	};
+	for (auto pos = -static_cast<ssize_t>(m_history_used); pos < 0; pos++) {
+		addLine(m_lines[unscrolledPos(pos)]);
+	}
+
+	for (size_t row = 0; row < m_rows; row++) {
+		if (reachedEndOfScreen(row))
+			break;
+		addLine(m_lines[unscrolledPos(static_cast<ssize_t>(row))]);
+	}
+
+	return ret;
+}
+
+Screen::HistoryUsage Screen::historyUsage() const {
+	HistoryUsage ret;
+	const auto offset = static_cast<ssize_t>(m_scroll_offset);
+	const auto used = static_cast<ssize_t>(m_history_used);
+
+	for (ssize_t pos = -1; pos >= -used; pos--) {
+		const auto &line = m_lines[bufferPos(pos + offset)];
 
-	if (m_cur_pos + m_rows <= m_lines.size()) {
-		for (size_t line = m_cur_pos + m_rows; line < m_lines.size(); line++) {
-			addLine(m_lines[line]);
+		ret.lines++;
+		if (line.isCompressed()) {
+			ret.compressed++;
 		}
+		ret.bytes += line.memoryUsage();
+	}
 
-		for (size_t line = 0; line < m_cur_pos + m_rows; line++) {
-			if (line >= m_cur_pos && reachedEndOfScreen(line - m_cur_pos))
-				break;
-			addLine(m_lines[line]);
+	if (m_archive) {
+		ret.archived = m_archive->size();
+		ret.archived_bytes = m_archive->bytes();
+	}
+
+	return ret;
+}
+
+void Screen::markStyles(std::vector<bool> &in_use) const {
+	// used for lazily adjusted lines
+	in_use[m_fill.style] = true;
+
+	for (const auto lines: {&m_lines, &m_archive_view}) {
+		for (const auto &line: *lines) {
+			if (auto compressed = line.compressed(); compressed) {
+				compressed->markStyles(in_use);
+				continue;
+			}
+
+			// also consider hidden columns
+			for (const auto &glyph: line.raw()) {
+				in_use[glyph.style] = true;
+			}
 		}
-	} else {
-		/* current screen wraps around the ring buffer */
-		const auto end_screen_index = m_cur_pos + m_rows - m_lines.size();
+	}
+
+	if (m_archive) {
+		m_archive->markStyles(in_use);
+	}
+}
+
+void Screen::markClusters(std::vector<bool> &in_use) const {
+	std::vector<Rune> runes;
 
-		for (size_t line = end_screen_index; line < m_cur_pos; line++) {
-			addLine(m_lines[line]);
+	for (const auto lines: {&m_lines, &m_archive_view}) {
+		for (const auto &line: *lines) {
+			if (auto compressed = line.compressed(); compressed) {
+				compressed->collectRunes(Attr::CLUSTER, runes);
+				continue;
+			}
+
+			for (const auto &glyph: line.raw()) {
+				if (glyph.isCluster()) {
+					runes.push_back(glyph.rune);
+				}
+			}
 		}
+	}
+
+	for (const auto rune: runes) {
+		in_use[ClusterTable::toIndex(rune)] = true;
+	}
+
+	if (m_archive) {
+		m_archive->markClusters(in_use);
+	}
+}
 
-		size_t screen_index = 0;
+void Screen::archiveOldest(size_t count) {
+	count = std::min(count, m_history_used);
 
-		// now use the smart iterator to add the remaining lines from
-		// the screen that wrap around the buffer
-		for (const auto &line: *this) {
-			if (reachedEndOfScreen(screen_index))
-				break;
-			addLine(line);
-			screen_index++;
+	for (size_t i = 0; i < count; i++) {
+		auto &line = m_lines[unscrolledPos(static_cast<ssize_t>(i) - static_cast<ssize_t>(m_history_used))];
+
+		if (m_archive) {
+			m_archive->append(line);
 		}
+
+		// the slot is about to be reused, release the memory already
+		line.clear();
 	}
 
-	return ret;
+	m_history_used -= count;
+	m_reflowed = std::min(m_reflowed, m_history_used);
 }
 
-std::optional<size_t> Screen::screenPos(LineVector::size_type line_index) const {
-	const auto screen_end = bufferPos(m_rows-1);
-	const auto screen_wraps = screen_end < m_cur_pos;
+void Screen::growRing(const size_t rows, size_t history) {
+	history = std::min(history, m_history_len);
+	const auto needed = rows + history + 1;
 
-	if (screen_wraps) {
-		if (line_index >= m_cur_pos)
-			return line_index - m_cur_pos;
-		else if (line_index <= screen_end)
-			return m_lines.size() - m_cur_pos + line_index;
-	} else {
-		if (line_index >= m_cur_pos && line_index < m_cur_pos + m_rows) {
-			return line_index - m_cur_pos;
+	if (needed <= m_lines.size())
+		return;
+
+	// grow geometrically to keep the amortized cost low
+	const auto new_size = std::max(needed, std::min(m_lines.size() * 2, m_history_len + rows + 1));
+
+	LineVector lines;
+	lines.reserve(new_size);
+
+	// rearrange the ring starting with the oldest history line in a
+	// single pass, the new lines are appended after the old ring end
+	const auto first = unscrolledPos(-static_cast<ssize_t>(m_history_used));
+
+	for (size_t i = 0; i < m_lines.size(); i++) {
+		lines.emplace_back(std::move(m_lines[(first + i) % m_lines.size()]));
+	}
+
+	lines.resize(new_size, Line{/*keep_data_on_shrink=*/!m_is_alt_screen});
+	m_lines = std::move(lines);
+	m_cur_pos = m_history_used;
+}
+
+void Screen::loadArchiveView() {
+	m_archive_view.resize(m_rows + 1, Line{/*keep_data_on_shrink=*/true});
+	const auto used = static_cast<ssize_t>(m_history_used);
+
+	for (size_t row = 0; row < m_rows; row++) {
+		const auto pos = static_cast<ssize_t>(row) - static_cast<ssize_t>(m_scroll_offset);
+		auto &line = m_archive_view[row];
+
+		if (pos >= -used) {
+			line.assignExpanded(m_lines[unscrolledPos(pos)]);
+		} else {
+			m_archive->load(static_cast<size_t>(-pos - used - 1), line);
 		}
+
+		prepareLine(line);
+		line.setDirty(true);
 	}
+}
+
+void Screen::compressHistory(ssize_t first, ssize_t last) {
+	if (!hasScrollBuffer())
+		return;
+
+	// don't wrap around into the lines of the current screen
+	const auto max_history = static_cast<ssize_t>(maxHistoryLines());
+	first = std::max(first, -max_history);
+	last = std::min(last, ssize_t{0});
+
+	// the unscrolled line positions that are part of the current view
+	const auto offset = static_cast<ssize_t>(m_scroll_offset);
+	const auto view_top = -offset;
+	const auto view_end = view_top + static_cast<ssize_t>(m_rows);
 
-	return std::nullopt;
+	for (auto pos = first; pos < last; pos++) {
+		if (pos >= view_top && pos < view_end)
+			continue;
+
+		m_lines[bufferPos(pos + offset)].compress();
+	}
 }
 
 } // end ns
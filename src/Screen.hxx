@@ -1,14 +1,18 @@
 #pragma once
 
 // C++
+#include <algorithm>
 #include <climits>
 #include <iterator>
+#include <memory>
 #include <optional>
 #include <vector>
 
 // nst
+#include "ClusterTable.hxx"
 #include "CursorState.hxx"
 #include "Glyph.hxx"
+#include "HistoryArchive.hxx"
 #include "Line.hxx"
 
 namespace nst {
@@ -19,10 +23,42 @@ namespace nst {
  * Screen terminal context.
  *
  * Internally this is organized as a ring buffer holding also scrollback data.
+ * The ring buffer starts out with the size of the screen and grows
+ * geometrically as lines move into the history, until the configured
+ * history length is reached.
  * The interface is such that only the currently visible screen can be
  * accessed. It is allowed to access lines beyond the screen view for
  * performing scroll operations, though, which e.g. happens in
  * Term::scrollUp().
+ *
+ * Lines that leave the visible area are compressed (see Line::compress()) to
+ * reduce the memory footprint of the scrollback history. Lines that come
+ * into view again by scrolling are expanded. The non-const line accessors
+ * expand lines on demand, thus the lines of the current view are always
+ * available in regular representation.
+ *
+ * History lines keep their own number of columns. When the screen is
+ * resized only the lines of the current view are adjusted, history lines
+ * are adjusted lazily when they're accessed or come into view again (see
+ * prepareLine()). The number of populated history lines is tracked
+ * explicitly, so that the cost of resizing and scrolling does not depend on
+ * the size of the scrollback buffer.
+ *
+ * On screens with scrollback buffer automatically wrapped lines are
+ * rearranged when the number of columns changes (reflow). Logical lines
+ * are made up of physical lines carrying the WRAP attribute at their end.
+ * The visible screen is rewrapped immediately in setDimension(). History
+ * lines are rewrapped in chunks once they're about to be scrolled into
+ * view (see reflowHistory()). Until then they keep their previous layout,
+ * which doesn't matter for text export, since wrapped lines are joined
+ * there anyway.
+ *
+ * Optionally a HistoryArchive can be attached via setArchive(). History
+ * lines that drop out of the ring buffer are moved into the archive then.
+ * When scrolling back into archived lines, the view is assembled in a
+ * separate set of lines (m_archive_view). Archived lines are not
+ * rewrapped anymore, they are only adjusted to the current number of
+ * columns.
  **/
 class Screen {
 public: // types
@@ -102,6 +138,15 @@ public: // types
 	using iterator = IteratorT<LineVector, LineVector::iterator>;
 	using const_iterator = IteratorT<const LineVector, LineVector::const_iterator>;
 
+	/// Statistics about the memory used for the scrollback history.
+	struct HistoryUsage {
+		size_t lines = 0; ///< number of allocated history lines
+		size_t compressed = 0; ///< number of history lines in compressed form
+		size_t bytes = 0; ///< number of bytes occupied by the allocated history lines
+		size_t archived = 0; ///< number of history lines stored in the HistoryArchive
+		size_t archived_bytes = 0; ///< number of bytes occupied in the HistoryArchive
+	};
+
 public: // functions
 
 	/// Create a new screen representation using the given number of history lines.
@@ -123,8 +168,16 @@ public: // functions
 	Screen& operator=(Screen &&other) noexcept {
 		m_lines = std::move(other.m_lines);
 		m_rows = other.m_rows;
+		m_cols = other.m_cols;
+		m_fill = other.m_fill;
 		m_cur_pos = other.m_cur_pos;
-		m_saved_scroll_index = other.m_saved_scroll_index;
+		m_history_used = other.m_history_used;
+		m_reflowed = other.m_reflowed;
+		m_pushed_lines = other.m_pushed_lines;
+		m_history_pos = other.m_history_pos;
+		m_saved_scroll_pos = other.m_saved_scroll_pos;
+		m_archive = std::move(other.m_archive);
+		m_archive_view = std::move(other.m_archive_view);
 		m_history_len = other.m_history_len;
 		m_is_alt_screen = other.m_is_alt_screen;
 		m_cached_cursor = other.m_cached_cursor;
@@ -132,7 +185,7 @@ public: // functions
 	}
 
 	size_t numCols() const {
-		return m_lines.empty() ? 0 : m_lines.front().size();
+		return m_cols;
 	}
 	size_t numLines() const {
 		return m_rows;
@@ -217,16 +270,51 @@ public: // functions
 		return ret;
 	}
 
-	Glyph& operator[](const CharPos p)             { return m_lines[bufferPos(p.y)][p.x]; }
-	const Glyph& operator[](const CharPos p) const { return m_lines[bufferPos(p.y)][p.x]; }
+	Glyph& operator[](const CharPos p)             { return (*this)[p.y][p.x]; }
+	const Glyph& operator[](const CharPos p) const { return (*this)[p.y][p.x]; }
 
-	Line& operator[](ssize_t pos)             { return m_lines[bufferPos(pos)]; }
-	const Line& operator[](ssize_t pos) const { return m_lines[bufferPos(pos)]; }
+	/// Returns the line at the given position, preparing it for access if necessary.
+	Line& operator[](ssize_t pos) {
+		if (viewInArchive())
+			return m_archive_view[pos];
+
+		return prepareLine(m_lines[bufferPos(pos)]);
+	}
 
-	auto begin() { return iterator{m_lines, m_lines.begin() + bufferPos(0)}; }
-	auto end() { return iterator{m_lines, m_lines.begin() + bufferPos(m_rows)}; }
-	auto begin() const { return const_iterator{m_lines, m_lines.begin() + bufferPos(0)}; }
-	auto end() const { return const_iterator{m_lines, m_lines.begin() + bufferPos(m_rows)}; }
+	/// Returns the line at the given position.
+	/**
+	 * Lines outside of the current view may be in compressed form, in
+	 * which case only the basic Line properties may be accessed. They
+	 * may also still have a different number of columns than the
+	 * current screen.
+	 **/
+	const Line& operator[](ssize_t pos) const {
+		if (viewInArchive())
+			return m_archive_view[pos];
+
+		return m_lines[bufferPos(pos)];
+	}
+
+	auto begin() {
+		return viewInArchive() ?
+			iterator{m_archive_view, m_archive_view.begin()} :
+			iterator{m_lines, m_lines.begin() + bufferPos(0)};
+	}
+	auto end() {
+		return viewInArchive() ?
+			iterator{m_archive_view, m_archive_view.begin() + m_rows} :
+			iterator{m_lines, m_lines.begin() + bufferPos(m_rows)};
+	}
+	auto begin() const {
+		return viewInArchive() ?
+			const_iterator{m_archive_view, m_archive_view.begin()} :
+			const_iterator{m_lines, m_lines.begin() + bufferPos(0)};
+	}
+	auto end() const {
+		return viewInArchive() ?
+			const_iterator{m_archive_view, m_archive_view.begin() + m_rows} :
+			const_iterator{m_lines, m_lines.begin() + bufferPos(m_rows)};
+	}
 
 	/// grants raw access to the complete screen ring buffer
 	auto& rawLines() { return m_lines; }
@@ -243,6 +331,20 @@ public: // functions
 		return m_history_len != 0;
 	}
 
+	/// Returns whether automatically wrapped lines are rearranged when the number of columns changes.
+	/**
+	 * This is not done on the alt screen, the applications running there
+	 * redraw their content upon resize anyway.
+	 **/
+	bool reflowsLines() const {
+		return hasScrollBuffer() && !m_is_alt_screen;
+	}
+
+	/// Attach an archive for history lines that drop out of the ring buffer.
+	void setArchive(std::unique_ptr<HistoryArchive> archive) {
+		m_archive = std::move(archive);
+	}
+
 	/// Change the current screen's dimensions.
 	/**
 	 * This will change the physical screen dimensions. It can be used for
@@ -255,13 +357,21 @@ public: // functions
 	 * If the number of columns is increased then new cells will be
 	 * initialized using the provided `defattrs`. If the number of columns
 	 * is decreased then lost cells will be deleted.
+	 *
+	 * Only the lines of the current view are adjusted here, history lines
+	 * follow once they're accessed again.
+	 *
+	 * If reflowsLines() is set and the number of columns changes then the
+	 * logical lines of the screen are rewrapped instead. `cursor` is
+	 * adjusted to keep pointing to the same character in this case.
 	 **/
-	void setDimension(const TermSize size, const Glyph defattrs);
+	void setDimension(const TermSize size, const Glyph defattrs, CharPos &cursor);
 
 	/// Change the size of the scrollback buffer.
 	/**
 	 * Changing this setting will only take effect when setDimension() is
-	 * called.
+	 * called. The ring buffer is not allocated for the full history size
+	 * right away, it grows as lines move into the history.
 	 **/
 	void setHistoryLen(const size_t len) {
 		m_history_len = len;
@@ -272,6 +382,9 @@ public: // functions
 	 * \return The number of lines actually scrolled
 	 **/
 	size_t scrollHistoryMax() {
+		// the oldest position is only known after all history has
+		// been rewrapped
+		reflowHistory(SIZE_MAX);
 		return scrollHistoryUp(historyLinesLeft());
 	}
 
@@ -283,19 +396,14 @@ public: // functions
 		if (!hasScrollBuffer())
 			return 0;
 
+		reflowHistory(m_scroll_offset + std::min(lines, maxHistoryLines()));
+
 		if (const auto left = historyLinesLeft(); lines > left) {
 			lines = left;
 		}
 
-		ssize_t idx = ssize_t(lines);
-
-		// find the first history line that actually has content
-		while (idx > 0 && (*this)[-idx].empty())
-			--idx;
-
-		lines = size_t(idx);
-
 		m_scroll_offset += lines;
+		prepareView();
 		return lines;
 	}
 
@@ -311,7 +419,10 @@ public: // functions
 			lines = m_scroll_offset;
 		}
 
+		const auto old_top = -static_cast<ssize_t>(m_scroll_offset);
 		m_scroll_offset -= lines;
+		compressHistory(old_top, old_top + static_cast<ssize_t>(lines));
+		prepareView();
 		return lines;
 	}
 
@@ -324,16 +435,18 @@ public: // functions
 	size_t stopScrolling() {
 		const auto ret = m_scroll_offset;
 		m_scroll_offset = 0;
+		const auto old_top = -static_cast<ssize_t>(ret);
+		compressHistory(old_top, old_top + static_cast<ssize_t>(m_rows));
 		return ret;
 	}
 
 	/// Save the current scroll offset for later restoring via restoreScrollState().
 	bool saveScrollState() {
 		if (isScrolled()) {
-			m_saved_scroll_index = bufferPos(0);
+			m_saved_scroll_pos = m_history_pos - std::min(m_scroll_offset, m_history_pos);
 			return true;
 		} else {
-			m_saved_scroll_index = SIZE_MAX;
+			m_saved_scroll_pos = SIZE_MAX;
 			return false;
 		}
 	}
@@ -347,19 +460,26 @@ public: // functions
 	bool restoreScrollState() {
 		stopScrolling();
 
-		if (m_saved_scroll_index == SIZE_MAX)
+		if (m_saved_scroll_pos == SIZE_MAX)
 			return true;
-		else if (isOnScreen(m_saved_scroll_index))
+		else if (m_saved_scroll_pos >= m_history_pos)
 			// the original scroll position is no longer available
 			return false;
 
-		if (m_saved_scroll_index < m_cur_pos) {
-			m_scroll_offset = m_cur_pos - m_saved_scroll_index;
-		} else {
-			m_scroll_offset = m_cur_pos;
-			m_scroll_offset += m_lines.size() - m_saved_scroll_index;
-		}
+		reflowHistory(m_history_pos - m_saved_scroll_pos);
+
+		// rewrapping may have moved the position
+		if (m_saved_scroll_pos >= m_history_pos)
+			return false;
+
+		const auto offset = m_history_pos - m_saved_scroll_pos;
 
+		if (offset > m_history_used + archivedLines())
+			// the original position is no longer populated
+			return false;
+
+		m_scroll_offset = offset;
+		prepareView();
 		return true;
 	}
 
@@ -369,19 +489,64 @@ public: // functions
 	 * scrolling.
 	 **/
 	void shiftViewUp(size_t lines) {
+		// the newest history lines move back onto the screen
+		m_history_used -= std::min(lines, m_history_used);
+		m_reflowed -= std::min(lines, m_reflowed);
+		m_pushed_lines -= std::min(lines, m_pushed_lines);
+		m_history_pos -= std::min(lines, m_history_pos);
+		// archived lines can only be reached if the ring buffer is completely rewrapped
+		m_scroll_offset = std::min(m_scroll_offset,
+				m_reflowed == m_history_used ? m_reflowed + archivedLines() : m_reflowed);
+
 		if (lines <= m_cur_pos) {
 			m_cur_pos -= lines;
 		} else {
 			lines -= m_cur_pos;
 			m_cur_pos = m_lines.size() - lines;
 		}
+
+		prepareView();
 	}
 
 	void shiftViewDown(size_t lines) {
+		makeRoomForHistory(lines);
+
 		m_cur_pos += lines;
 		if (m_cur_pos >= m_lines.size()) {
 			m_cur_pos -= m_lines.size();
 		}
+
+		// the lines that left the screen are history lines now
+		if (hasScrollBuffer()) {
+			m_history_used = std::min(m_history_used + lines, maxHistoryLines());
+			// screen lines always match the current number of columns
+			m_reflowed = std::min(m_reflowed + lines, m_history_used);
+			m_pushed_lines += lines;
+			m_history_pos += lines;
+		}
+		compressHistory(-static_cast<ssize_t>(lines), 0);
+
+		if (isScrolled()) {
+			// the view moved along with the screen
+			prepareView();
+		}
+	}
+
+	/// Moves the history lines that would be overwritten by shiftViewDown(`lines`) into the archive.
+	/**
+	 * Term::scrollUp() needs to call this before moving lines beyond the
+	 * end of the screen around, since these are the oldest history lines.
+	 * Without an archive the lines are simply discarded.
+	 **/
+	void makeRoomForHistory(const size_t lines) {
+		if (!hasScrollBuffer())
+			return;
+
+		growRing(m_rows, m_history_used + lines);
+
+		if (const auto needed = m_history_used + lines; needed > maxHistoryLines()) {
+			archiveOldest(needed - maxHistoryLines());
+		}
 	}
 
 	/// Resets the scrolling data and ring buffer position.
@@ -392,19 +557,128 @@ public: // functions
 	void resetScrollBuffer() {
 		m_cur_pos = 0;
 		m_scroll_offset = 0;
+		m_history_used = 0;
+		m_reflowed = 0;
+		// keep the line numbering going, the new screen lines are
+		// new lines for IPC clients that follow the output, see
+		// historySeq().
+		m_pushed_lines += m_rows;
+		m_history_pos += m_rows;
+		if (m_archive) {
+			m_archive->clear();
+		}
 		// clear all lines except the (new) current screen
 		for (auto it = m_lines.begin() + m_rows; it != m_lines.end(); it++) {
 			it->clear();
 		}
+
+		prepareView();
 	}
 
 
+	/// Returns the number of scrollback history lines that have content.
+	size_t historyLines() const {
+		return m_history_used;
+	}
+
+	/// Returns the number of history lines stored in the HistoryArchive.
+	size_t archivedLines() const {
+		return m_archive ? m_archive->size() : 0;
+	}
+
+	/// Returns the sequence number of the oldest line available in the history.
+	/**
+	 * Lines are numbered consecutively in the order in which they moved
+	 * through the screen. The first screen row has the number returned
+	 * by screenSeq(), the history line directly above it the number
+	 * before, and so on. Scrolling the screen content thus doesn't change
+	 * the number of a line, and numbers are not reused when the history
+	 * is cleared. Lines that move back from the history onto the screen
+	 * (reverse scrolling) keep their numbers.
+	 *
+	 * Rewrapping lines for a changed number of columns never moves
+	 * screenSeq() backwards. It changes the number of history lines,
+	 * though. Only the rewrapped lines and the ones older than them are
+	 * renumbered then, historySeq() moves accordingly. Lines that are
+	 * already wrapped according to the current number of columns keep
+	 * their numbers.
+	 *
+	 * IPC clients use these numbers to request ranges of lines or only
+	 * the lines that appeared since a previous request.
+	 **/
+	size_t historySeq() const {
+		return m_pushed_lines - std::min(m_pushed_lines, m_history_used + archivedLines());
+	}
+
+	/// Returns the lowest sequence number that rewrapping history lines won't change anymore.
+	/**
+	 * History lines that are not yet wrapped according to the current
+	 * number of columns are renumbered by reflowHistory() later on,
+	 * together with all older lines, see historySeq().
+	 **/
+	size_t stableSeq() const {
+		if (m_reflowed < m_history_used)
+			return m_pushed_lines - std::min(m_pushed_lines, m_reflowed);
+
+		return historySeq();
+	}
+
+	/// Returns the sequence number of the first screen row, see historySeq().
+	size_t screenSeq() const {
+		return m_pushed_lines;
+	}
+
+	/// Returns the line with the given sequence number.
+	/**
+	 * `seq` needs to be in the range [historySeq(), screenSeq() +
+	 * numLines()). Archived lines are loaded into `buffer` and a
+	 * reference to it is returned, otherwise the line is returned
+	 * directly from the ring buffer. History lines may be compressed.
+	 **/
+	const Line& lineAtSeq(const size_t seq, Line &buffer) const;
+
+	/// Pins the archived lines among the sequence numbers [begin, end), see HistoryArchive::pin().
+	/**
+	 * `begin` needs to be at least historySeq(). Archived lines always
+	 * precede the lines in the ring buffer, thus the returned Pin covers
+	 * the sequence numbers [begin, begin + Pin::size()).
+	 **/
+	HistoryArchive::Pin pinArchived(const size_t begin, const size_t end) const;
+
+	/// Appends the UTF-8 encoded text of `line` to `out`, as done by asText().
+	/**
+	 * `expanded` is used as a temporary for compressed lines.
+	 **/
+	static void appendText(const Line &line, const ClusterTable &clusters, std::string &out, Line &expanded);
+
 	/// Returns the current buffer content as UTF-8 encoded text.
 	/**
 	 * This returns the complete buffer content including scroll back
-	 * history.
+	 * history. `clusters` is used for expanding cells that display
+	 * multiple code points.
+	 **/
+	std::string asText(const CursorState &cursor, const ClusterTable &clusters) const;
+
+	/// Returns statistics about the memory occupied by the scrollback history.
+	/**
+	 * This needs to look at every history line, so it should only be
+	 * used on explicit request.
 	 **/
-	std::string asText(const CursorState &cursor) const;
+	HistoryUsage historyUsage() const;
+
+	/// Marks all StyleIDs referenced by any line in the ring buffer in `in_use`.
+	/**
+	 * This is used for garbage collection of the StyleTable, see
+	 * Term::collectStyles().
+	 **/
+	void markStyles(std::vector<bool> &in_use) const;
+
+	/// Marks all ClusterTable entries referenced by any line in the ring buffer in `in_use`.
+	/**
+	 * This is used for garbage collection of the ClusterTable, see
+	 * Term::collectClusters().
+	 **/
+	void markClusters(std::vector<bool> &in_use) const;
 
 protected: // functions
 
@@ -429,38 +703,122 @@ protected: // functions
 		return static_cast<LineVector::size_type>(pos);
 	}
 
-	/// Translates a ring buffer index into a line index on the screen, if possible.
+	/// Returns the number of populated history lines left to scroll to.
+	size_t historyLinesLeft() const {
+		return m_history_used + archivedLines() - m_scroll_offset;
+	}
+
+	/// Returns whether the current view reaches into archived history lines.
+	bool viewInArchive() const {
+		return m_scroll_offset > m_history_used;
+	}
+
+	/// Returns the number of history lines the ring buffer can hold with the current number of rows.
+	size_t maxHistoryLines() const {
+		return m_lines.size() - m_rows;
+	}
+
+	/// Like bufferPos() but ignoring the current scroll offset.
+	LineVector::size_type unscrolledPos(ssize_t pos) const {
+		return bufferPos(pos + static_cast<ssize_t>(m_scroll_offset));
+	}
+
+	/// Makes sure the ring buffer can hold `rows` screen lines and `history` history lines.
 	/**
-	 * This performs the reverse operation of bufferPos(). If the given
-	 * index is not located on the current screen then std::nullopt is
-	 * returned.
+	 * The number of history lines is limited to m_history_len. The ring
+	 * buffer only grows, by at least a factor of two, and the order of
+	 * the existing lines is preserved.
 	 **/
-	std::optional<size_t> screenPos(LineVector::size_type line_index) const;
+	void growRing(const size_t rows, size_t history);
+
+	/// Moves the `count` oldest history lines into the archive, or discards them if there is none.
+	void archiveOldest(size_t count);
 
-	/// Returns the (theoretical) number of history lines left to scroll to.
+	/// Compress the history lines found in the given range of unscrolled line positions.
 	/**
-	 * Since there can be unallocated lines it doesn't mean there is
-	 * actually that much history content available.
+	 * `first` and `last` are line positions relative to the current
+	 * screen, not considering the current scroll offset. `last` is
+	 * exclusive. Only negative positions (history lines) are considered
+	 * and lines that are part of the current view are skipped.
 	 **/
-	size_t historyLinesLeft() const {
-		return m_lines.size() - m_rows - m_scroll_offset;
+	void compressHistory(ssize_t first, ssize_t last);
+
+	/// Rewrap the logical lines of the current screen for a changed number of columns.
+	/**
+	 * This is part of setDimension() for screens that reflow lines. A
+	 * logical line continuing from the history into the screen is
+	 * rewrapped as well. Rewrapped lines that no longer fit on the screen
+	 * move into the history. `cursor` is adjusted to keep pointing to the
+	 * same character. All other history lines are marked for lazy
+	 * rewrapping via reflowHistory().
+	 **/
+	void reflowView(const TermSize size, CharPos &cursor);
+
+	/// Rewrap history lines until at least `lines` of them match the current number of columns.
+	/**
+	 * History lines are rewrapped in chunks of whole logical lines,
+	 * starting with the newest history line that is not yet rewrapped.
+	 * Changes in the number of lines require shifting the newer lines in
+	 * the ring buffer. To keep this cost bounded, each chunk is at least
+	 * as big as the range of lines that has already been rewrapped.
+	 **/
+	void reflowHistory(const size_t lines);
+
+	/// Adjusts m_history_pos for older history lines that moved by `lines` due to rewrapping.
+	void moveHistoryPos(const ssize_t lines) {
+		m_history_pos = static_cast<size_t>(std::max(ssize_t{0}, static_cast<ssize_t>(m_history_pos) + lines));
+	}
+
+	/// Makes a line ready for access as part of the current screen.
+	/**
+	 * This restores the regular representation of compressed lines and
+	 * adjusts lines that still have the number of columns from before
+	 * the last setDimension() call. Unallocated lines are left alone, they
+	 * are sized by Term once they're used.
+	 **/
+	Line& prepareLine(Line &line) {
+		line.expand();
+
+		if (!line.empty() && line.size() != m_cols) {
+			line.resize(m_cols, m_fill);
+		}
+
+		return line;
 	}
 
-	/// Returns whether the given index in m_lines is visible on the current screen.
-	bool isOnScreen(LineVector::size_type line_index) const {
-		return screenPos(line_index).has_value();
+	/// Makes sure all lines in the current view are prepared for access.
+	void prepareView() {
+		if (viewInArchive()) {
+			loadArchiveView();
+			return;
+		}
+
+		for (auto &line: *this) {
+			prepareLine(line);
+		}
 	}
 
+	/// Assembles the current view in m_archive_view from ring buffer and archived lines.
+	void loadArchiveView();
+
 protected: // data
 
 	LineVector m_lines; ///< the actual ring buffer
 	size_t m_rows = 0; ///< number of rows the visible screen has.
+	size_t m_cols = 0; ///< number of columns the visible screen has.
+	Glyph m_fill; ///< template for cells added to lines that are lazily adjusted to m_cols.
 	size_t m_cur_pos = 0; ///< where the current screen content starts in the ring buffer.
+	size_t m_history_used = 0; ///< number of history lines that have content, counting from the newest one.
+	size_t m_reflowed = 0; ///< number of history lines, counting from the newest one, that are wrapped according to m_cols.
 	size_t m_scroll_offset = 0; ///< how many lines we are currently scrolled back.
-	size_t m_saved_scroll_index = SIZE_MAX; ///< the index in m_lines that was previously scrolled to (top position)
+	size_t m_pushed_lines = 0; ///< number of lines that moved from the screen into the history. This is also the sequence number of the first screen row.
+	size_t m_history_pos = 0; ///< like m_pushed_lines, but also counting the lines by which older history lines moved due to rewrapping.
+	size_t m_saved_scroll_pos = SIZE_MAX; ///< the value of m_history_pos at the history position previously scrolled to (top position)
 	size_t m_history_len = 0; ///< how big the ring buffer for history should be (0 == no history)
 	bool m_is_alt_screen = false; ///< Whether this represents the alternative screen.
 	CursorState m_cached_cursor; ///< save/load cursor state for this screen.
+	std::unique_ptr<HistoryArchive> m_archive; ///< storage for lines that dropped out of the ring buffer, if enabled.
+	LineVector m_archive_view; ///< the current view while scrolled back into archived lines, see viewInArchive().
 };
 
 } // end ns
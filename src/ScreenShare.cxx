@@ -0,0 +1,132 @@
+// C++
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <string>
+
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// cosmos
+#include "cosmos/error/ApiError.hxx"
+
+// nst
+#include "ClusterTable.hxx"
+#include "Line.hxx"
+#include "ScreenShare.hxx"
+#include "StyleTable.hxx"
+
+namespace nst {
+
+static_assert(ScreenShare::ATTR_WDUMMY == static_cast<uint32_t>(Glyph::Attr::WDUMMY));
+
+namespace {
+
+/// Granularity in which the shared memory is enlarged.
+constexpr size_t GROW_STEP = 64 * 1024;
+
+} // end anon ns
+
+ScreenShare::ScreenShare() {
+	m_fd = ::memfd_create("nst-screen", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+	if (m_fd == -1) {
+		cosmos_throw (cosmos::ApiError("creating screen share memfd"));
+	}
+
+	try {
+		grow(sizeof(Header));
+	} catch (...) {
+		::close(m_fd);
+		throw;
+	}
+
+	// clients must not be able to pull the memory away from under us
+	::fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK);
+}
+
+ScreenShare::~ScreenShare() {
+	::munmap(m_header, m_size);
+	::close(m_fd);
+}
+
+int ScreenShare::readOnlyFD() const {
+	// reopening via /proc results in an independent open file
+	// description, which can be read-only
+	const auto path = std::string{"/proc/self/fd/"} + std::to_string(m_fd);
+	const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1) {
+		cosmos_throw (cosmos::ApiError("reopening screen share memfd"));
+	}
+
+	return fd;
+}
+
+void ScreenShare::grow(const size_t bytes) {
+	const auto new_size = (bytes + GROW_STEP - 1) / GROW_STEP * GROW_STEP;
+
+	if (::ftruncate(m_fd, static_cast<off_t>(new_size)) != 0) {
+		cosmos_throw (cosmos::ApiError("resizing screen share memfd"));
+	}
+
+	void *addr = m_header ?
+		::mremap(m_header, m_size, new_size, MREMAP_MAYMOVE) :
+		::mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+	if (addr == MAP_FAILED) {
+		cosmos_throw (cosmos::ApiError("mapping screen share memfd"));
+	}
+
+	if (!m_header) {
+		new (addr) Header{};
+	}
+
+	m_header = static_cast<Header*>(addr);
+	m_header->size = m_size = new_size;
+}
+
+void ScreenShare::beginUpdate(const int cols, const int rows) {
+	const bool resized = static_cast<uint32_t>(cols) != m_header->cols || static_cast<uint32_t>(rows) != m_header->rows;
+	const size_t num_cells = size_t(cols) * size_t(rows);
+
+	// grow before marking the update as in progress, if this throws then
+	// readers would otherwise be stuck with an odd generation
+	if (const auto needed = sizeof(Header) + num_cells * sizeof(Cell); resized && needed > m_size) {
+		grow(needed);
+	}
+
+	const auto generation = m_header->generation.load(std::memory_order_relaxed);
+	m_header->generation.store(generation + 1, std::memory_order_relaxed);
+	// makes sure the odd generation is visible before any data changes
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (!resized)
+		return;
+
+	m_header->cols = cols;
+	m_header->rows = rows;
+	std::fill_n(cells(), num_cells, Cell{});
+}
+
+void ScreenShare::setLine(const int row, const Line &line, const StyleTable &styles, const ClusterTable &clusters) {
+	const auto cols = m_header->cols;
+	auto cell = cells() + size_t(row) * cols;
+	const auto used = std::min(static_cast<size_t>(line.size()), size_t{cols});
+
+	for (size_t col = 0; col < used; col++, cell++) {
+		const auto &glyph = line[col];
+		const auto &style = styles[glyph.style];
+
+		cell->rune = glyph.isCluster() ? clusters[glyph.rune].front() : glyph.rune;
+		cell->fg = static_cast<uint32_t>(style.fg);
+		cell->bg = static_cast<uint32_t>(style.bg);
+		cell->attrs = static_cast<uint32_t>(style.mode.raw() | glyph.flags.raw());
+	}
+
+	std::fill(cell, cell + (cols - used), Cell{});
+}
+
+} // end ns
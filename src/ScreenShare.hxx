@@ -0,0 +1,201 @@
+#pragma once
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace nst {
+
+// this header is also used by nst-msg, thus only forward declare these
+class ClusterTable;
+class Line;
+class StyleTable;
+
+/// Shared memory view of the visible terminal screen for local tools.
+/**
+ * This is an opt-in alternative to reading the screen contents via the
+ * serialized IPC path. The screen cells and cursor position are stored in
+ * a memfd which clients obtain via the GET_SCREEN_SHARE IPC message. The file
+ * descriptor passed to clients is opened read-only. Clients can map it and
+ * read the current screen at any rate without issuing system calls or causing
+ * work in nst's event loop.
+ *
+ * The memory starts with a Header, followed by `rows * cols` Cells in
+ * row-major order. Term fills in the complete screen once the share is
+ * created and updates the content at draw time afterwards, only for
+ * dirty lines. If the window isn't drawable (e.g. unmapped) then updates are
+ * deferred until drawing is possible again.
+ *
+ * Updates are protected by a seqlock: the Header's generation counter is
+ * odd while an update is in progress and is incremented again when the
+ * update is complete. Readers need to copy the data and verify that the
+ * generation didn't change meanwhile, see read(). Should nst die during an
+ * update then the generation stays odd, readers give up after a timeout.
+ *
+ * When the terminal grows the memory is enlarged. Clients notice this via
+ * Header::size and need to map the file descriptor again.
+ **/
+class ScreenShare {
+public: // types
+
+	/// A single screen cell as stored in the shared memory.
+	struct Cell {
+		uint32_t rune = 0; ///< the code point displayed, for grapheme clusters only the base character
+		uint32_t fg = 0; ///< foreground ColorIndex
+		uint32_t bg = 0; ///< background ColorIndex
+		uint32_t attrs = 0; ///< Glyph::Attr bits of the Glyph and its GlyphStyle
+	};
+
+	/// The header found at the start of the shared memory.
+	struct Header {
+		uint32_t magic = MAGIC;
+		uint32_t version = VERSION;
+		std::atomic<uint64_t> generation = 0; ///< seqlock counter, odd while an update is in progress
+		uint64_t size = 0; ///< the current size of the shared memory in bytes
+		uint32_t cols = 0;
+		uint32_t rows = 0;
+		int32_t cursor_x = -1; ///< cursor column, -1 if the cursor is outside of the visible area
+		int32_t cursor_y = -1; ///< cursor row, -1 if the cursor is outside of the visible area
+	};
+
+	/// A consistent copy of the shared screen state as returned from read().
+	struct Contents {
+		uint32_t cols = 0;
+		uint32_t rows = 0;
+		int32_t cursor_x = -1;
+		int32_t cursor_y = -1;
+		std::vector<Cell> cells;
+	};
+
+	/// The possible outcomes of read().
+	enum class ReadResult {
+		OK,     ///< a consistent copy has been obtained
+		GROWN,  ///< the shared memory grew beyond the mapping
+		TIMEOUT ///< no consistent state could be obtained in time
+	};
+
+public: // data
+
+	static constexpr uint32_t MAGIC = 0x6e737473; // "nsts"
+	static constexpr uint32_t VERSION = 1;
+
+	/// Cell::attrs bit marking the placeholder following a wide character (Glyph::Attr::WDUMMY).
+	static constexpr uint32_t ATTR_WDUMMY = 1 << 10;
+
+	/// How long read() tries to obtain a consistent state before giving up.
+	static constexpr std::chrono::milliseconds READ_TIMEOUT{1000};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlock counter needs to be lock free");
+
+public: // functions
+
+	/// Creates the shared memory. On error a cosmos::ApiError is thrown.
+	ScreenShare();
+
+	~ScreenShare();
+
+	ScreenShare(const ScreenShare&) = delete;
+	ScreenShare& operator=(const ScreenShare&) = delete;
+
+	/// Returns a new read-only file descriptor for the shared memory to be passed to clients.
+	/**
+	 * The caller is responsible for closing the file descriptor. On error
+	 * a cosmos::ApiError is thrown.
+	 **/
+	int readOnlyFD() const;
+
+	/// Starts an update for a screen of the given dimensions.
+	/**
+	 * If the dimensions changed then all cells are cleared, the caller
+	 * needs to provide all lines again in this case. If enlarging the
+	 * shared memory fails then a cosmos::ApiError is thrown and no
+	 * update is started.
+	 **/
+	void beginUpdate(const int cols, const int rows);
+
+	/// Stores the cells of the given screen row.
+	void setLine(const int row, const Line &line, const StyleTable &styles, const ClusterTable &clusters);
+
+	void setCursor(const int x, const int y) {
+		m_header->cursor_x = x;
+		m_header->cursor_y = y;
+	}
+
+	/// Finishes the update started in beginUpdate().
+	void endUpdate() {
+		m_header->generation.fetch_add(1, std::memory_order_release);
+	}
+
+	/// Copies a consistent state of the shared memory mapped at `map` into `out`.
+	/**
+	 * This implements the reader side of the seqlock protocol for
+	 * clients. `map_size` is the size of the mapping. If the shared
+	 * memory has grown beyond the mapping then ReadResult::GROWN is
+	 * returned and the client needs to map Header::size bytes again. If
+	 * no consistent state can be obtained within READ_TIMEOUT then
+	 * ReadResult::TIMEOUT is returned.
+	 **/
+	static ReadResult read(const void *map, const size_t map_size, Contents &out) {
+		const auto header = static_cast<const Header*>(map);
+		const auto cells = reinterpret_cast<const Cell*>(header + 1);
+		const auto deadline = std::chrono::steady_clock::now() + READ_TIMEOUT;
+
+		for (bool first = true; ; first = false) {
+			if (!first) {
+				if (std::chrono::steady_clock::now() >= deadline)
+					return ReadResult::TIMEOUT;
+				std::this_thread::yield();
+			}
+
+			const auto generation = header->generation.load(std::memory_order_acquire);
+
+			if (generation % 2 != 0) {
+				// update in progress
+				continue;
+			}
+
+			out.cols = header->cols;
+			out.rows = header->rows;
+			out.cursor_x = header->cursor_x;
+			out.cursor_y = header->cursor_y;
+			const size_t num_cells = size_t{out.cols} * out.rows;
+			const bool fits = sizeof(Header) + num_cells * sizeof(Cell) <= map_size;
+
+			if (fits) {
+				out.cells.assign(cells, cells + num_cells);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (header->generation.load(std::memory_order_relaxed) != generation) {
+				// torn read, try again
+				continue;
+			} else if (!fits) {
+				return ReadResult::GROWN;
+			}
+
+			return ReadResult::OK;
+		}
+	}
+
+protected: // functions
+
+	/// Enlarges the shared memory to at least `bytes`.
+	void grow(const size_t bytes);
+
+	Cell* cells() {
+		return reinterpret_cast<Cell*>(m_header + 1);
+	}
+
+protected: // data
+
+	int m_fd = -1; ///< the memfd backing the shared memory
+	size_t m_size = 0; ///< the size of the current mapping
+	Header *m_header = nullptr; ///< the writable mapping of the shared memory
+};
+
+} // end ns
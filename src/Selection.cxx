@@ -1,6 +1,7 @@
 // C++
 #include <algorithm>
 #include <cctype>
+#include <climits>
 
 // cosmos
 #include "cosmos/string.hxx"
@@ -67,13 +68,20 @@ void Selection::applyConfig() {
 	}
 }
 
-bool Selection::isSelected(const CharPos pos) const {
+std::optional<ColSpan> Selection::selectedCols(const int y) const {
 	if (inEmptyState() || !existsSelection() || hasScreenChanged())
-		return false;
+		return std::nullopt;
+	else if (y < m_range.begin.y || y > m_range.end.y)
+		return std::nullopt;
 	else if (doRectRange() || doLineRange())
-		return Rect{m_range}.inRect(pos);
-	else // exact range
-		return LinearRange{m_range}.inRange(pos);
+		return ColSpan{m_range.begin.x, m_range.end.x};
+
+	// exact range: the first and last lines can be partial, the lines
+	// in-between are selected completely.
+	return ColSpan{
+		y == m_range.begin.y ? m_range.begin.x : 0,
+		y == m_range.end.y   ? m_range.end.x   : INT_MAX
+	};
 }
 
 bool Selection::allowNewSelection(const Mode mode, const Flags flags) const {
@@ -499,10 +507,12 @@ std::string Selection::data() const {
 		return "";
 
 	const auto &screen = m_term.screen();
+	const auto &clusters = m_term.clusters();
 	std::string ret;
 
 	{
-		// worst case calculation for unicode text plus newlines
+		// worst case calculation for unicode text plus newlines (not
+		// considering grapheme clusters, which are rare)
 		const size_t bufsize = (screen.numCols()+1) * raw_height(LinearRange{m_range}.height()) * utf8::UTF_SIZE;
 		ret.reserve(bufsize);
 	}
@@ -543,7 +553,7 @@ std::string Selection::data() const {
 			if (cur->isDummy())
 				continue;
 
-			utf8::encode(cur->rune, ret);
+			clusters.encode(*cur, ret);
 		}
 
 		// Copy and pasting of line endings is inconsistent in the
@@ -69,7 +69,21 @@ public: // functions
 	void reset();
 
 	/// returns whether the given position is part of the current selection.
-	bool isSelected(const CharPos pos) const;
+	bool isSelected(const CharPos pos) const {
+		const auto cols = selectedCols(pos.y);
+		return cols && cols->inRange(pos.x);
+	}
+
+	/// Returns the span of selected columns in the given screen row, if any.
+	/**
+	 * In all selection modes the selected area of a single row is a
+	 * contiguous range of columns. The right boundary can exceed the
+	 * number of columns for rows that are selected up to the line end.
+	 *
+	 * This allows the renderer to determine the selection state of a
+	 * complete row at once instead of testing every single cell.
+	 **/
+	std::optional<ColSpan> selectedCols(const int y) const;
 
 	/// Adjust the current selection to a scroll operation, if possible.
 	/**
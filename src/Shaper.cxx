@@ -0,0 +1,193 @@
+// C++
+#include <cstdint>
+#include <iterator>
+
+#ifdef NST_HAVE_HARFBUZZ
+// HarfBuzz
+#include <hb.h>
+#include <hb-ft.h>
+#endif
+
+// xpp
+#include "xpp/XDisplay.hxx"
+
+// nst
+#include "Shaper.hxx"
+
+namespace nst {
+
+std::u32string Shaper::cacheKey(XftFont *font, const Rune *runes, const size_t count, const bool cluster) {
+	static_assert(sizeof(XftFont*) <= 2 * sizeof(char32_t));
+	const auto font_addr = reinterpret_cast<uintptr_t>(font);
+
+	std::u32string ret;
+	ret.reserve(count + 3);
+	// prefix the text with the font address
+	ret.push_back(static_cast<char32_t>(font_addr & 0xFFFFFFFF));
+	ret.push_back(static_cast<char32_t>(static_cast<uint64_t>(font_addr) >> 32));
+	// the same text can be shaped as a run and as a cluster, mark
+	// clusters by a value that isn't a valid code point.
+	if (cluster) {
+		ret.push_back(static_cast<char32_t>(0xFFFFFFFF));
+	}
+	ret.append(reinterpret_cast<const char32_t*>(runes), count);
+	return ret;
+}
+
+const Shaper::ShapedRun* Shaper::lookup(XftFont *font, const Rune *runes, const size_t count, const bool cluster) {
+	if constexpr (!available()) {
+		return nullptr;
+	}
+
+	auto key = cacheKey(font, runes, count, cluster);
+
+	if (auto it = m_cache_index.find(key); it != m_cache_index.end()) {
+		// move the entry to the front of the LRU list
+		m_cache.splice(m_cache.begin(), m_cache, it->second);
+	} else {
+		if (m_cache.size() >= CACHE_SIZE) {
+			// recycle the least recently used entry
+			m_cache_index.erase(m_cache.back().key);
+			m_cache.splice(m_cache.begin(), m_cache, std::prev(m_cache.end()));
+		} else {
+			m_cache.emplace_front();
+		}
+
+		auto &entry = m_cache.front();
+		entry.key = std::move(key);
+		m_misses++;
+
+		if (!doShape(font, runes, count, cluster, entry.run)) {
+			entry.run.clear();
+		}
+
+		m_cache_index[entry.key] = m_cache.begin();
+	}
+
+	const auto &run = m_cache.front().run;
+	return run.empty() ? nullptr : &run;
+}
+
+#ifdef NST_HAVE_HARFBUZZ
+
+void Shaper::clear() {
+	m_cache.clear();
+	m_cache_index.clear();
+
+	for (auto &entry: m_hb_fonts) {
+		::hb_font_destroy(entry.second.font);
+	}
+
+	m_hb_fonts.clear();
+
+	if (m_buffer) {
+		::hb_buffer_destroy(m_buffer);
+		m_buffer = nullptr;
+	}
+}
+
+bool Shaper::doShape(XftFont *font, const Rune *runes, const size_t count, const bool cluster, ShapedRun &out) {
+	// locking the face also makes Xft apply the font's size to it, which
+	// is important since Xft shares faces between fonts.
+	FT_Face face = ::XftLockFace(font);
+	if (!face)
+		return false;
+
+	auto it = m_hb_fonts.find(font);
+
+	if (it == m_hb_fonts.end()) {
+		HBFont hbfont;
+		// this keeps a reference to the face, even if Xft drops it
+		hbfont.font = ::hb_ft_font_create_referenced(face);
+		hbfont.blank_glyph = ::XftCharIndex(xpp::display, font, ' ');
+		it = m_hb_fonts.emplace(font, hbfont).first;
+	} else {
+		::hb_ft_font_changed(it->second.font);
+	}
+
+	const auto &hbfont = it->second;
+
+	if (!m_buffer) {
+		m_buffer = ::hb_buffer_create();
+	} else {
+		::hb_buffer_clear_contents(m_buffer);
+	}
+
+	::hb_buffer_set_direction(m_buffer, HB_DIRECTION_LTR);
+	::hb_buffer_add_utf32(m_buffer, runes, static_cast<int>(count), 0, static_cast<int>(count));
+	::hb_buffer_guess_segment_properties(m_buffer);
+	::hb_shape(hbfont.font, m_buffer, nullptr, 0);
+	::XftUnlockFace(font);
+
+	unsigned int num_glyphs = 0;
+	const auto *infos = ::hb_buffer_get_glyph_infos(m_buffer, &num_glyphs);
+	const auto *positions = ::hb_buffer_get_glyph_positions(m_buffer, &num_glyphs);
+
+	if (cluster) {
+		// all glyphs go into the same cell, keep the font's advances
+		// as offsets relative to the cell
+		out.clear();
+		int pen = 0;
+
+		for (unsigned int i = 0; i < num_glyphs; i++) {
+			const auto &info = infos[i];
+			const auto &pos = positions[i];
+
+			if (info.codepoint == 0)
+				return false;
+
+			out.push_back(ShapedGlyph{
+				info.codepoint,
+				static_cast<short>((pen + pos.x_offset) / 64),
+				static_cast<short>(pos.y_offset / 64)
+			});
+			pen += pos.x_advance;
+		}
+
+		return !out.empty();
+	}
+
+	// more glyphs than cells cannot be mapped onto the character grid
+	if (num_glyphs > count)
+		return false;
+
+	out.assign(count, ShapedGlyph{hbfont.blank_glyph, 0, 0});
+	size_t next_cell = 0;
+
+	for (unsigned int i = 0; i < num_glyphs; i++) {
+		const auto &info = infos[i];
+		const auto &pos = positions[i];
+
+		// a missing glyph, leave this run to the fallback font logic
+		if (info.codepoint == 0)
+			return false;
+		// clusters need to map to distinct, increasing cells
+		else if (info.cluster < next_cell || info.cluster >= count)
+			return false;
+
+		// positions are in 26.6 fixed point format
+		out[info.cluster] = ShapedGlyph{
+			info.codepoint,
+			static_cast<short>(pos.x_offset / 64),
+			static_cast<short>(pos.y_offset / 64)
+		};
+		next_cell = info.cluster + 1;
+	}
+
+	return true;
+}
+
+#else // NST_HAVE_HARFBUZZ
+
+void Shaper::clear() {
+	m_cache.clear();
+	m_cache_index.clear();
+}
+
+bool Shaper::doShape(XftFont *, const Rune *, const size_t, const bool, ShapedRun &) {
+	return false;
+}
+
+#endif // NST_HAVE_HARFBUZZ
+
+} // end ns
@@ -0,0 +1,159 @@
+#pragma once
+
+// C++
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// X11
+#include <X11/Xft/Xft.h>
+
+// nst
+#include "types.hxx"
+
+#ifdef NST_HAVE_HARFBUZZ
+struct hb_buffer_t;
+struct hb_font_t;
+#endif
+
+/**
+ * @file
+ *
+ * Text shaping support for ligature fonts.
+ **/
+
+namespace nst {
+
+/// Text shaping of Glyph runs via HarfBuzz, with an LRU cache of shaping results.
+/**
+ * Fonts with programming ligatures (like Fira Code or JetBrains Mono) need
+ * text shaping to replace sequences of characters like "->" or "!=" by
+ * dedicated glyphs. Shaping is comparatively expensive, thus shaping results
+ * are cached by (font, text run), so that redrawing unchanged text never
+ * shapes the same run again.
+ *
+ * Shaping results are always mapped to exactly one glyph per input Rune, so
+ * that they fit into the terminal's character grid. Monospace ligature fonts
+ * typically are designed this way already. Cells that are covered by a
+ * preceding multi-cell glyph receive a blank glyph.
+ *
+ * This is only functional if nst has been built with HarfBuzz support
+ * (`NST_HAVE_HARFBUZZ`), otherwise available() returns `false` and shape()
+ * never returns results.
+ **/
+class Shaper {
+	// non-copyable
+	Shaper(const Shaper&) = delete;
+	Shaper& operator=(const Shaper&) = delete;
+public: // types
+
+	/// A single shaped glyph for a terminal cell.
+	struct ShapedGlyph {
+		FT_UInt glyph = 0; ///< glyph index in the font
+		short x_offset = 0; ///< horizontal pixel offset relative to the cell (relative to the cluster's cell for shapeCluster())
+		short y_offset = 0; ///< vertical pixel offset relative to the baseline
+	};
+
+	/// The shaping result for a text run, one entry for each input Rune.
+	using ShapedRun = std::vector<ShapedGlyph>;
+
+	/// Maximum number of cached shaping results.
+	static constexpr size_t CACHE_SIZE = 4096;
+
+public: // functions
+
+	Shaper() = default;
+
+	~Shaper() {
+		clear();
+	}
+
+	/// Returns whether text shaping support has been compiled in.
+	static constexpr bool available() {
+#ifdef NST_HAVE_HARFBUZZ
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/// Returns the shaped glyphs for the given text run in `font`.
+	/**
+	 * If the run cannot be shaped into one glyph per Rune, or if the font
+	 * is missing glyphs for some of the Runes, then `nullptr` is
+	 * returned. The caller should then fall back to per-Rune font
+	 * lookup.
+	 *
+	 * The returned pointer is valid until the next call of shape() or
+	 * clear().
+	 **/
+	const ShapedRun* shape(XftFont *font, const Rune *runes, const size_t count) {
+		return lookup(font, runes, count, /*cluster=*/false);
+	}
+
+	/// Returns the shaped glyphs for a grapheme cluster displayed in a single cell.
+	/**
+	 * In contrast to shape() the result can contain any number of
+	 * glyphs, all of which are to be drawn in the same cell at the
+	 * returned offsets. This way combining marks can be positioned by the
+	 * font and multi code point emoji can be replaced by a single glyph.
+	 * The same restrictions regarding missing glyphs and the lifetime of
+	 * the result apply as for shape().
+	 **/
+	const ShapedRun* shapeCluster(XftFont *font, const Rune *runes, const size_t count) {
+		return lookup(font, runes, count, /*cluster=*/true);
+	}
+
+	/// Drop all cached data, to be called before fonts are closed.
+	void clear();
+
+	/// Returns the number of lookups that weren't found in the cache so far.
+	size_t misses() const { return m_misses; }
+
+protected: // types
+
+	/// A cached shaping result, the key is stored for removal from the lookup table.
+	/**
+	 * Runs that cannot be shaped are cached as well, using an empty
+	 * ShapedRun.
+	 **/
+	struct CacheEntry {
+		std::u32string key;
+		ShapedRun run;
+	};
+
+	using CacheList = std::list<CacheEntry>;
+
+protected: // functions
+
+	/// Returns the cached shaping result for the given text, shaping it if necessary.
+	const ShapedRun* lookup(XftFont *font, const Rune *runes, const size_t count, const bool cluster);
+
+	/// Actually shape the given text, returns whether this was possible.
+	bool doShape(XftFont *font, const Rune *runes, const size_t count, const bool cluster, ShapedRun &out);
+
+	/// Returns the lookup key for the given font and text run.
+	static std::u32string cacheKey(XftFont *font, const Rune *runes, const size_t count, const bool cluster);
+
+protected: // data
+
+	/// Cached shaping results, most recently used first.
+	CacheList m_cache;
+	/// Lookup table for m_cache.
+	std::unordered_map<std::u32string, CacheList::iterator> m_cache_index;
+	size_t m_misses = 0; ///< number of cache misses, see misses()
+
+#ifdef NST_HAVE_HARFBUZZ
+	/// HarfBuzz font data associated with an Xft font.
+	struct HBFont {
+		hb_font_t *font = nullptr;
+		FT_UInt blank_glyph = 0; ///< glyph to use for cells covered by a ligature
+	};
+
+	std::unordered_map<XftFont*, HBFont> m_hb_fonts;
+	hb_buffer_t *m_buffer = nullptr;
+#endif
+};
+
+} // end ns
@@ -0,0 +1,54 @@
+// nst
+#include "StyleTable.hxx"
+
+namespace nst {
+
+StyleTable::StyleTable() {
+	// the default style always has StyleID 0
+	m_styles.emplace_back(GlyphStyle{});
+	m_is_free.push_back(false);
+	m_ids[GlyphStyle{}] = Glyph::DEFAULT_STYLE;
+}
+
+StyleID StyleTable::intern(const GlyphStyle &style) {
+	if (auto it = m_ids.find(style); it != m_ids.end()) {
+		return it->second;
+	}
+
+	StyleID id;
+
+	if (!m_free_ids.empty()) {
+		id = m_free_ids.back();
+		m_free_ids.pop_back();
+		m_styles[id] = style;
+		m_is_free[id] = false;
+	} else if (m_styles.size() < MAX_STYLES) {
+		id = static_cast<StyleID>(m_styles.size());
+		m_styles.push_back(style);
+		m_is_free.push_back(false);
+	} else {
+		// table exhausted, degrade gracefully
+		return Glyph::DEFAULT_STYLE;
+	}
+
+	m_ids[style] = id;
+	return id;
+}
+
+void StyleTable::collect(const std::vector<bool> &in_use) {
+	for (size_t id = Glyph::DEFAULT_STYLE + 1; id < m_styles.size(); id++) {
+		if (in_use[id] || m_is_free[id])
+			continue;
+
+		// only drop the reverse mapping if it refers to this entry,
+		// there can be duplicates after modifyStyles().
+		if (auto it = m_ids.find(m_styles[id]); it != m_ids.end() && it->second == id) {
+			m_ids.erase(it);
+		}
+
+		m_is_free[id] = true;
+		m_free_ids.push_back(static_cast<StyleID>(id));
+	}
+}
+
+} // end ns
@@ -0,0 +1,113 @@
+#pragma once
+
+// C++
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// nst
+#include "Glyph.hxx"
+
+namespace nst {
+
+/// Per-terminal table of interned GlyphStyles.
+/**
+ * Glyphs only carry a 16-bit StyleID which refers to an entry in this
+ * table. Looking up a style is a plain vector access, while interning a
+ * style requires a hash lookup. Callers that intern styles frequently
+ * should cache the resulting StyleID (see Term::cursorStyle()).
+ *
+ * Entries are not reference counted, this would be too expensive given
+ * that Glyphs are copied around freely (even via memmove). Instead unused
+ * entries are garbage collected at safe points: the owner marks all
+ * StyleIDs that are still referenced and passes the result to collect(),
+ * which makes the remaining entries available for reuse. This is done via
+ * Term::collectStyles() once needsCollection() returns true.
+ *
+ * If the table is exhausted nevertheless (more than 64k distinct styles
+ * in use at the same time) then new styles fall back to the default style.
+ **/
+class StyleTable {
+public: // data
+
+	/// The maximum number of styles that can be addressed via StyleID.
+	static constexpr size_t MAX_STYLES = UINT16_MAX + 1;
+
+	/// The number of allocated styles after which a collection should be performed.
+	static constexpr size_t COLLECT_THRESHOLD = MAX_STYLES / 4 * 3;
+
+public: // functions
+
+	StyleTable();
+
+	/// Returns the StyleID for `style`, adding a new entry if necessary.
+	StyleID intern(const GlyphStyle &style);
+
+	const GlyphStyle& operator[](const StyleID id) const {
+		return m_styles[id];
+	}
+
+	/// Returns the number of StyleIDs currently allocated.
+	size_t size() const {
+		return m_styles.size() - m_free_ids.size();
+	}
+
+	/// Returns the number of StyleIDs currently addressable, including unused ones.
+	size_t capacity() const {
+		return m_styles.size();
+	}
+
+	/// Returns whether a garbage collection run should be performed.
+	bool needsCollection() const {
+		return size() >= COLLECT_THRESHOLD;
+	}
+
+	/// Release all StyleIDs that are not marked in `in_use`.
+	/**
+	 * `in_use` needs to be sized according to capacity(). The default
+	 * style is never released.
+	 **/
+	void collect(const std::vector<bool> &in_use);
+
+	/// Apply the given color transformation on all table entries.
+	/**
+	 * `modify` is invoked with a GlyphStyle reference for every allocated
+	 * entry. This is used for adjusting colors after theme changes. All
+	 * Glyphs referring to the entries are implicitly changed this way.
+	 **/
+	template <typename MODIFY>
+	void modifyStyles(MODIFY modify) {
+		m_ids.clear();
+
+		for (size_t id = 0; id < m_styles.size(); id++) {
+			if (m_is_free[id])
+				continue;
+
+			auto &style = m_styles[id];
+			modify(style);
+			// different entries may become equal here, this is not
+			// a problem, the latest one will be used for new
+			// Glyphs.
+			m_ids[style] = static_cast<StyleID>(id);
+		}
+	}
+
+protected: // types
+
+	struct Hash {
+		size_t operator()(const GlyphStyle &style) const {
+			const auto fg = static_cast<uint64_t>(style.fg);
+			const auto bg = static_cast<uint64_t>(style.bg);
+			return std::hash<uint64_t>{}((fg << 32 | bg) ^ (static_cast<uint64_t>(style.mode.raw()) << 48));
+		}
+	};
+
+protected: // data
+
+	std::vector<GlyphStyle> m_styles; ///< the style entries indexed by StyleID
+	std::vector<bool> m_is_free; ///< marks entries in m_styles that are currently unused
+	std::vector<StyleID> m_free_ids; ///< released StyleIDs available for reuse
+	std::unordered_map<GlyphStyle, StyleID, Hash> m_ids; ///< reverse lookup of allocated styles
+};
+
+} // end ns
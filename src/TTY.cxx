@@ -1,8 +1,14 @@
 // C++
+#include <cerrno>
 #include <cstring>
 #include <cstdlib>
 #include <ostream>
 
+// Linux
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
 // cosmos
 #include "cosmos/error/ApiError.hxx"
 #include "cosmos/error/InternalError.hxx"
@@ -70,6 +76,12 @@ void TTY::createPTY(const Extent extent) {
 
 	m_cmd_file.open(master, cosmos::AutoCloseFD{true});
 
+	// needed for looking at the child's input queue in pendingInput()
+	char slave_path[64];
+	if (::ptsname_r(cosmos::to_integral(m_cmd_file.fd().raw()), slave_path, sizeof(slave_path)) == 0) {
+		m_pty_slave = slave_path;
+	}
+
 	try {
 		executeShell(slave);
 		slave.close();
@@ -185,6 +197,8 @@ void TTY::write(const std::string_view sv, const MayEcho echo) {
 	auto &term = m_nst.term();
 	const auto mode = term.mode();
 
+	flushPendingNewline(true);
+
 	if (echo && mode[Term::Mode::TECHO])
 		// display data on screen
 		term.write(sv, Term::ShowCtrlChars{true});
@@ -211,6 +225,94 @@ void TTY::write(const std::string_view sv, const MayEcho echo) {
 	}
 }
 
+size_t TTY::tryWrite(const std::string_view sv, const MayEcho echo) {
+
+	auto &term = m_nst.term();
+	const auto mode = term.mode();
+	size_t accepted = 0;
+
+	if (!flushPendingNewline(false))
+		return 0;
+
+	if (!mode[Term::Mode::CRLF]) {
+		accepted = tryWriteRaw(sv);
+	} else {
+		// translate newlines like write() does
+		for (auto it = sv.begin(); it < sv.end();) {
+			if (*it == '\r') {
+				const auto written = tryWriteRaw("\r\n");
+
+				if (written == 0)
+					break;
+
+				// the CR is sent, the child must see the LF
+				// before any further input
+				it++;
+				m_pending_newline = written == 1;
+
+				if (m_pending_newline)
+					break;
+			} else {
+				auto next = std::find(it, sv.end(), '\r');
+				const auto len = static_cast<size_t>(next - it);
+				const auto written = tryWriteRaw({&(*it), len});
+				it += written;
+
+				if (written != len)
+					break;
+			}
+		}
+
+		accepted = static_cast<size_t>(it - sv.begin());
+	}
+
+	if (echo && mode[Term::Mode::TECHO] && accepted != 0)
+		term.write(sv.substr(0, accepted), Term::ShowCtrlChars{true});
+
+	return accepted;
+}
+
+bool TTY::flushPendingNewline(const bool block) {
+	if (!m_pending_newline)
+		return true;
+
+	if (block) {
+		writeRaw("\n");
+	} else if (tryWriteRaw("\n") == 0) {
+		return false;
+	}
+
+	m_pending_newline = false;
+	return true;
+}
+
+size_t TTY::tryWriteRaw(const std::string_view sv) {
+	if (sv.empty())
+		return 0;
+
+	// m_cmd_file is operated in blocking mode, only switch temporarily,
+	// since for a real TTY the file description might be shared with
+	// other processes.
+	const auto fd = cosmos::to_integral(m_cmd_file.fd().raw());
+	const auto flags = ::fcntl(fd, F_GETFL);
+
+	if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		cosmos_throw (cosmos::ApiError("fcntl(O_NONBLOCK)"));
+	}
+
+	cosmos::ResourceGuard<int> flags_guard{fd, [flags](int fd) { ::fcntl(fd, F_SETFL, flags); }};
+
+	while (true) {
+		if (const auto written = ::write(fd, sv.data(), sv.size()); written >= 0) {
+			return static_cast<size_t>(written);
+		} else if (errno == EAGAIN) {
+			return 0;
+		} else if (errno != EINTR) {
+			cosmos_throw (cosmos::ApiError("writing to TTY"));
+		}
+	}
+}
+
 void TTY::writeRaw(const std::string_view sv) {
 	// Remember that we are potentially using a real TTY, which might be a modem line.
 	// Writing too much will clog the line. That's why we are doing this dance.
@@ -258,6 +360,37 @@ void TTY::writeRaw(const std::string_view sv) {
 	}
 }
 
+size_t TTY::pendingInput() const {
+	int pending = 0;
+
+	if (m_pty_slave.empty()) {
+		// for a real TTY line the bytes not yet transmitted are
+		// queued on our side
+		if (::ioctl(cosmos::to_integral(m_cmd_file.fd().raw()), TIOCOUTQ, &pending) != 0) {
+			cosmos_throw (cosmos::ApiError("ioctl(TIOCOUTQ)"));
+		}
+
+		return static_cast<size_t>(pending);
+	}
+
+	// for a PTY the data is queued on the slave side, the master doesn't
+	// report it. Keeping the slave open would prevent us from noticing
+	// when the child closes it, thus only open it temporarily.
+	const auto fd = ::open(m_pty_slave.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+	if (fd == -1) {
+		cosmos_throw (cosmos::ApiError("opening PTY slave"));
+	}
+
+	cosmos::ResourceGuard<int> fd_guard{fd, [](int fd) { ::close(fd); }};
+
+	if (::ioctl(fd, TIOCINQ, &pending) != 0) {
+		cosmos_throw (cosmos::ApiError("ioctl(TIOCINQ)"));
+	}
+
+	return static_cast<size_t>(pending);
+}
+
 cosmos::TermDimension TTY::toTermDimension(const Extent size) const {
 	const auto &term = m_nst.term();
 	cosmos::TermDimension dim(term.numCols(), term.numRows());
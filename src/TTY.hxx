@@ -1,6 +1,7 @@
 #pragma once
 
 // C++
+#include <string>
 #include <string_view>
 
 // cosmos
@@ -57,6 +58,27 @@ public: // functions
 	 **/
 	void write(const std::string_view sv, const MayEcho echo);
 
+	/// Provide input to the child process as far as possible without blocking.
+	/**
+	 * This works like write(), but only writes as much of `sv` as the
+	 * TTY accepts right now. Only the accepted part is echoed.
+	 *
+	 * \return The number of bytes of `sv` that have been accepted, the
+	 * rest needs to be passed again once the TTY is writable.
+	 **/
+	size_t tryWrite(const std::string_view sv, const MayEcho echo);
+
+	/// Returns the number of input bytes written to the TTY that haven't been consumed yet.
+	/**
+	 * For a PTY this is the input the child process didn't read yet. In
+	 * canonical mode an incomplete trailing line isn't counted, since the
+	 * child can't read it before the line is terminated. For a real TTY
+	 * line this is the number of bytes not yet transmitted.
+	 *
+	 * On error a cosmos::ApiError is thrown.
+	 **/
+	size_t pendingInput() const;
+
 	/// Inform the TTY device (and thus the child process) about a terminal size change.
 	void resize(const Extent size);
 
@@ -100,6 +122,14 @@ protected: // functions
 	void setupIOFile(const std::string &path);
 	/// Forward data unmodified to the child process.
 	void writeRaw(const std::string_view sv);
+	/// Forward data unmodified to the child process, returns the number of bytes written without blocking.
+	size_t tryWriteRaw(const std::string_view sv);
+	/// Writes out a newline left over from a partial CRLF translation in tryWrite().
+	/**
+	 * \return Whether no newline is pending anymore, always true if
+	 * `block` is set.
+	 **/
+	bool flushPendingNewline(const bool block);
 	/// For the PTY case execute the default shell or the program passed on the command line.
 	void executeShell(cosmos::FileDescriptor slave);
 	void doPrintToIoFile(const std::string_view s);
@@ -113,8 +143,10 @@ protected: // data
 	cosmos::File m_cmd_file; ///< master end of pty or real TTY device
 	cosmos::Poller m_cmd_poller; ///< event driven I/O for m_cmd_file
 	cosmos::Terminal m_terminal; ///< wrapper around m_cmd_file for TTY ioctls
+	std::string m_pty_slave; ///< path of the slave end of the PTY, empty for a real TTY
 	char m_buf[BUFSIZ]; ///< holds data read from the TTY not yet forwarded to Term
 	size_t m_buf_bytes = 0; ///< number of unprocessed bytes in m_buf
+	bool m_pending_newline = false; ///< tryWrite() only got the CR of a translated CRLF written
 };
 
 } // end ns
@@ -1,6 +1,7 @@
 // C++
 #include <cassert>
 #include <cstring>
+#include <iostream>
 #include <type_traits>
 
 // cosmos
@@ -8,6 +9,7 @@
 
 // nst
 #include "codecs.hxx"
+#include "HistoryArchive.hxx"
 #include "nst_config.hxx"
 #include "nst.hxx"
 #include "Selection.hxx"
@@ -24,7 +26,6 @@ ColorIndex CursorState::m_def_fg = ColorIndex::INVALID;
 ColorIndex CursorState::m_def_bg = ColorIndex::INVALID;
 
 CursorState::CursorState() {
-	m_attrs.rune = ' ';
 	m_attrs.fg = m_def_fg;
 	m_attrs.bg = m_def_bg;
 }
@@ -42,7 +43,6 @@ void CursorState::resetAttrs() {
 	});
 	m_attrs.fg = m_def_fg;
 	m_attrs.bg = m_def_bg;
-	m_attrs.rune = ' ';
 }
 
 Term::Term(Nst &nst) :
@@ -75,6 +75,30 @@ void Term::init(const Nst &nst) {
 		m_screen.setHistoryLen(*history_len);
 	}
 
+	auto archive_size = config::HISTORY_ARCHIVE_SIZE;
+
+	if (auto size = config_file.asUnsigned("history_archive_size"); size != std::nullopt) {
+		archive_size = *size;
+	}
+
+	if (archive_size != 0 && m_screen.hasScrollBuffer()) {
+		try {
+			m_screen.setArchive(std::make_unique<HistoryArchive>(archive_size * 1024 * 1024));
+		} catch (const std::exception &ex) {
+			nst.logger().error() << "failed to setup history archive: " << ex.what() << "\n";
+		}
+	}
+
+	auto index_size = config::HISTORY_INDEX_SIZE;
+
+	if (auto size = config_file.asUnsigned("history_index_size"); size != std::nullopt) {
+		index_size = *size;
+	}
+
+	if (index_size != 0 && m_screen.hasScrollBuffer()) {
+		m_history_index = std::make_unique<HistoryIndex>(index_size * 1024 * 1024);
+	}
+
 	resize(m_wsys.termWin().getTermDim());
 	reset();
 }
@@ -86,6 +110,8 @@ void Term::themeChanged(const Theme &old_theme, const Theme &new_theme) {
 
 	/* since the new theme might have fewer extended colors than the old
 	 * one we need to adjust Glyph colors throughout the screen buffer.
+	 * Glyph colors are stored in the StyleTable, so it is enough to
+	 * adjust the table entries.
 	 *
 	 * also default colors need to be replaced
 	 *
@@ -124,19 +150,15 @@ void Term::themeChanged(const Theme &old_theme, const Theme &new_theme) {
 			cursor.setBgColor(cursor.attrs().bg);
 			screen->setCachedCursor(cursor);
 		}
+	}
 
-		for (auto &line: screen->rawLines()) {
-			// iterate over raw glyph vector, in case there are
-			// hidden (saved) columns existing
-			for (auto &g: line.raw()) {
-				if (g.isDummy())
-					continue;
+	m_styles.modifyStyles([fixupFgColor, fixupBgColor](GlyphStyle &style) {
+		style.fg = fixupFgColor(style.fg);
+		style.bg = fixupBgColor(style.bg);
+	});
 
-				g.fg = fixupFgColor(g.fg);
-				g.bg = fixupBgColor(g.bg);
-			}
-		}
-	}
+	// the cached StyleIDs no longer match their GlyphStyles
+	resetStyleCache();
 
 	setAllDirty();
 }
@@ -202,13 +224,33 @@ void Term::resize(const TermSize new_size) {
 		}
 
 		m_selection.scroll(0, -shift);
+		// the cursor stays on the same line of content
+		m_cursor.pos.y -= shift;
 	}
 
 	m_screen.saveScrollState();
 
-	// adjust dimensions of internal data structures
-	m_screen.setDimension(new_size, m_cursor.attrs());
-	m_saved_screen.setDimension(new_size, m_saved_screen.getCachedCursor().attrs());
+	// rewrapped lines no longer match the selected area
+	if (new_size.cols != old_size.cols && m_screen.reflowsLines()) {
+		m_selection.reset();
+	}
+
+	// adjust dimensions of internal data structures, this also updates
+	// the cursor positions if lines are rewrapped
+	m_screen.setDimension(new_size, Glyph{' ', cursorStyle()}, m_cursor.pos);
+
+	auto cached_cursor = m_saved_screen.getCachedCursor();
+	m_saved_screen.setDimension(new_size, Glyph{' ', m_styles.intern(cached_cursor.attrs())}, cached_cursor.pos);
+	m_saved_screen.setCachedCursor(cached_cursor);
+
+	if (m_history_index && new_size.cols != old_size.cols) {
+		// rewrapping renumbers the newest history lines, only index
+		// new lines from now on. Older lines are renumbered once
+		// they're rewrapped while scrolling back, the index drops
+		// these by itself, see Screen::stableSeq().
+		const auto &main_screen = onAltScreen() ? m_saved_screen : m_screen;
+		m_history_index->reset(main_screen.screenSeq());
+	}
 
 	// update terminal size (needed by setupTabs() below)
 	m_size = new_size;
@@ -267,6 +309,9 @@ void Term::clearRegion(Range range) {
 
 	range.sanitize();
 	range.clamp(bottomRight());
+	const auto erase_style = eraseStyle();
+	const auto erase_attrs = m_styles[erase_style].mode;
+	const auto full_width = range.begin.x == 0 && range.end.x == m_size.cols - 1;
 
 	for (auto pos = range.begin; pos.y <= range.end.y; pos.y++) {
 		auto &line = m_screen[pos.y];
@@ -279,11 +324,17 @@ void Term::clearRegion(Range range) {
 			line.resize(m_size.cols);
 		}
 
+		if (full_width) {
+			line.setAttrSummary(erase_attrs);
+		} else {
+			line.addAttrs(erase_attrs);
+		}
+
 		for (pos.x = range.begin.x; pos.x <= range.end.x; pos.x++) {
 			if (m_selection.isSelected(pos))
 				m_selection.reset();
 			auto &gp = m_screen[pos];
-			gp.clear(m_cursor.attrs());
+			gp.clear(erase_style);
 		}
 	}
 }
@@ -569,6 +620,9 @@ void Term::scrollUp(int num_lines, std::optional<int> opt_origin) {
 	 * downwards to keep everything in place.
 	 */
 
+	// the oldest history lines are about to be moved around
+	m_screen.makeRoomForHistory(num_lines);
+
 	for (auto i = origin - 1; i >= 0; i--) {
 		std::swap(m_screen[i], m_screen[i+num_lines]);
 	}
@@ -579,6 +633,10 @@ void Term::scrollUp(int num_lines, std::optional<int> opt_origin) {
 
 	m_screen.shiftViewDown(num_lines);
 
+	if (m_history_index && !onAltScreen()) {
+		m_history_index->update(m_screen, m_clusters);
+	}
+
 	clearLines(LineSpan{area.bottom - num_lines + 1, area.bottom});
 	setDirty(LineSpan{origin, area.bottom});
 	m_selection.scroll(origin, -num_lines);
@@ -628,21 +686,38 @@ void Term::dumpLine(const CharPos pos) const {
 	const auto line = m_screen[pos.y];
 
 	for (auto it = line.begin(); left != 0; it++, left--) {
-		utf8::encode(it->rune, enc_rune);
+		enc_rune.clear();
+		m_clusters.encode(*it, enc_rune);
 		m_tty.printToIoFile(enc_rune);
 	}
 	m_tty.printToIoFile("\n");
 }
 
-bool Term::existsBlinkingGlyph() const {
-	// NOTE: this test could probably be cheaper by keeping track of this
-	// attribute when changing glyphs.
+bool Term::lineHasAttr(const Line &line, const Glyph::Attr attr) const {
+	using SummaryState = Line::SummaryState;
+	const auto state = line.summaryState();
 
+	if (state == SummaryState::EXACT || (state == SummaryState::SUPERSET && !line.attrSummary()[attr]))
+		return line.attrSummary()[attr];
+
+	// determine the exact summary, including hidden columns
+	Glyph::AttrBitMask summary;
+
+	for (const auto &glyph: line.raw()) {
+		summary.set(m_styles[glyph.style].mode);
+		if (glyph.isWide()) {
+			summary.set(Attr::WIDE);
+		}
+	}
+
+	line.setAttrSummary(summary);
+	return summary[attr];
+}
+
+bool Term::existsBlinkingGlyph() const {
 	for (auto &line: m_screen) {
-		for (auto &glyph: line) {
-			if (glyph.isBlinking()) {
-				return true;
-			}
+		if (lineHasAttr(line, Attr::BLINK)) {
+			return true;
 		}
 	}
 
@@ -651,18 +726,16 @@ bool Term::existsBlinkingGlyph() const {
 
 void Term::setDirtyByAttr(const Glyph::Attr attr) {
 	for (const auto &line: m_screen) {
-		for (const auto &glyph: line) {
-			if (glyph.mode[attr]) {
-				line.setDirty(true);
-				break;
-			}
+		if (lineHasAttr(line, attr)) {
+			line.setDirty(true);
 		}
 	}
 }
 
-void Term::drawScreen() const {
+size_t Term::drawScreen() const {
 
 	const Range range{topLeft(), bottomRight()};
+	size_t drawn = 0;
 
 	for (int y = range.begin.y; y <= range.end.y; y++) {
 		auto &line = m_screen[y];
@@ -677,8 +750,15 @@ void Term::drawScreen() const {
 				line.begin() + raw_width(Rect{range}.width()),
 				CharPos{range.begin.x, y});
 
+		if (m_screen_share) {
+			m_screen_share->setLine(y, line, m_styles, m_clusters);
+		}
+
 		line.setDirty(false);
+		drawn++;
 	}
+
+	return drawn;
 }
 
 void Term::drawCursor() const {
@@ -726,15 +806,107 @@ void Term::drawCursor() const {
 	}
 }
 
+void Term::prepareShaping() {
+	const auto new_pos = m_screen.shiftedPos(m_cursor.pos);
+
+	if (const auto last_pos = m_screen.shiftedPos(m_last_cursor_pos); last_pos != new_pos) {
+		if (last_pos)
+			setDirty(LineSpan{last_pos->y, last_pos->y});
+		if (new_pos)
+			setDirty(LineSpan{new_pos->y, new_pos->y});
+	}
+
+	m_wsys.setShapingCursor(new_pos);
+}
+
 void Term::draw() {
 	if (!m_wsys.canDraw())
 		return;
 
+	if (m_wsys.shapesText()) {
+		prepareShaping();
+	}
+
+	if (m_screen_share) {
+		m_screen_share->beginUpdate(m_size.cols, m_size.rows);
+	}
+
+#ifdef NST_DRAW_TIMING
+	const auto misses = m_wsys.shapingMisses();
+	const auto start = std::chrono::steady_clock::now();
+	const auto lines = drawScreen();
+	recordDrawTiming(lines, std::chrono::steady_clock::now() - start, m_wsys.shapingMisses() != misses);
+#else
 	drawScreen();
+#endif
 	drawCursor();
+
+	if (m_screen_share) {
+		finishScreenShareUpdate();
+	}
+
 	m_wsys.finishDraw();
 }
 
+#ifdef NST_DRAW_TIMING
+void Term::recordDrawTiming(const size_t lines, const std::chrono::nanoseconds elapsed, const bool cold) {
+	if (lines == 0)
+		// only the cursor changed
+		return;
+
+	auto &current = cold ? m_cold_timing : m_warm_timing;
+	current.frames++;
+	current.lines += lines;
+	current.elapsed += elapsed;
+
+	if (m_cold_timing.frames + m_warm_timing.frames < DRAW_TIMING_FRAMES)
+		return;
+
+	auto report = [](const char *label, const DrawTiming &timing) {
+		const auto usecs = std::chrono::duration<double, std::micro>{timing.elapsed}.count();
+		std::cerr << label << ": " << timing.frames << " frames, " << timing.lines << " lines";
+
+		if (timing.frames != 0) {
+			std::cerr << ", " << usecs / timing.frames << " us/frame, " << usecs / timing.lines << " us/line";
+		}
+	};
+
+	std::cerr << "drawScreen() with shaping " << (m_wsys.shapesText() ? "on" : "off") << ": ";
+	report("cold", m_cold_timing);
+	std::cerr << "; ";
+	report("warm", m_warm_timing);
+	std::cerr << "\n";
+
+	m_cold_timing = DrawTiming{};
+	m_warm_timing = DrawTiming{};
+}
+#endif
+
+const ScreenShare& Term::enableScreenShare() {
+	if (!m_screen_share) {
+		m_screen_share = std::make_unique<ScreenShare>();
+
+		// transfer the complete screen right away, the client will
+		// read it before the next draw(), which might also be deferred
+		// for a long time if the window isn't drawable.
+		m_screen_share->beginUpdate(m_size.cols, m_size.rows);
+
+		for (int y = 0; y < m_size.rows; y++) {
+			m_screen_share->setLine(y, m_screen[y], m_styles, m_clusters);
+		}
+
+		finishScreenShareUpdate();
+	}
+
+	return *m_screen_share;
+}
+
+void Term::finishScreenShareUpdate() {
+	const auto cursor = m_screen.shiftedPos(m_cursor.pos);
+	m_screen_share->setCursor(cursor ? cursor->x : -1, cursor ? cursor->y : -1);
+	m_screen_share->endUpdate();
+}
+
 Rune Term::translateChar(Rune rune) const {
 	// GRAPHIC0 translation table for VT100 "special graphics mode"
 	//
@@ -788,11 +960,15 @@ void Term::setChar(const Rune rune, const CharPos pos) {
 		auto &prev_glyph = m_screen[pos.prevCol()];
 		prev_glyph.rune = ' ';
 		prev_glyph.resetWide();
+		prev_glyph.resetCluster();
 	}
 
-	m_screen[pos.y].setDirty(true);
-	glyph = m_cursor.attrs();
+	auto &line = m_screen[pos.y];
+	line.setDirty(true);
 	glyph.rune = translateChar(rune);
+	glyph.style = cursorStyle();
+	glyph.flags.reset();
+	line.addAttrs(m_styles[glyph.style].mode);
 }
 
 void Term::runDECTest() {
@@ -830,6 +1006,9 @@ void Term::putChar(const Rune rune) {
 	if (m_selection.isSelected(m_cursor.pos))
 		m_selection.reset();
 
+	if (m_mode[Mode::UTF8] && attachToCluster(rinfo))
+		return;
+
 	Glyph *gp = curGlyph();
 
 	// perform automatic line wrap, if necessary
@@ -854,7 +1033,7 @@ void Term::putChar(const Rune rune) {
 	if (m_mode[Mode::INSERT]) {
 		if (const auto to_move = lineSpaceLeft() - req_width; to_move > 0) {
 			std::memmove(gp + req_width, gp, to_move * sizeof(Line::value_type));
-			gp->mode.reset();
+			gp->flags.reset();
 		}
 	}
 
@@ -864,6 +1043,7 @@ void Term::putChar(const Rune rune) {
 
 	if (rinfo.isWide()) {
 		gp->setWide();
+		m_screen[m_cursor.pos.y].addAttrs(Attr::WIDE);
 
 		// if there's only one left character space then we'd be
 		// operating in a miniscule terminal size and cannot
@@ -892,11 +1072,90 @@ void Term::putChar(const Rune rune) {
 	}
 }
 
+std::optional<CharPos> Term::clusterBase() const {
+	auto pos = m_cursor.pos;
+
+	if (m_cursor.needWrapNext()) {
+		// the cursor still rests on the last written cell
+	} else if (pos.x > 0) {
+		pos = pos.prevCol();
+	} else if (pos.y > 0 && m_screen[pos.y - 1].raw().back().isWrapped()) {
+		pos = atEndOfLine(pos.prevLine());
+	} else {
+		return std::nullopt;
+	}
+
+	if (m_screen[pos].isDummy() && pos.x > 0) {
+		pos = pos.prevCol();
+	}
+
+	return pos;
+}
+
+bool Term::attachToCluster(const RuneInfo &rinfo) {
+	constexpr Rune ZWJ = 0x200D;
+	auto isRegionalIndicator = [](const Rune r) {
+		return r >= 0x1F1E6 && r <= 0x1F1FF;
+	};
+
+	const auto rune = rinfo.rune();
+	const bool zero_width = rinfo.width() == 0 && !rinfo.isControlChar();
+
+	if (!zero_width && rune < 0x80)
+		// fast path for plain ASCII
+		return false;
+
+	const auto pos = clusterBase();
+
+	if (!pos)
+		return zero_width;
+
+	auto &glyph = m_screen[*pos];
+	ClusterTable::Sequence seq;
+
+	if (glyph.isCluster()) {
+		seq = m_clusters[glyph.rune];
+	} else {
+		seq.push_back(static_cast<char32_t>(glyph.rune));
+	}
+
+	if (!zero_width) {
+		const bool joined = seq.back() == ZWJ;
+		const bool flag_pair = seq.size() == 1 && isRegionalIndicator(seq.back()) && isRegionalIndicator(rune);
+
+		if (!joined && !flag_pair)
+			return false;
+	}
+
+	if (seq.size() >= ClusterTable::MAX_LENGTH)
+		// drop excess code points
+		return true;
+
+	seq.push_back(static_cast<char32_t>(rune));
+
+	// if the table is exhausted the combining character is dropped
+	if (auto handle = m_clusters.intern(seq); handle) {
+		glyph.rune = *handle;
+		glyph.setCluster();
+		m_screen[pos->y].setDirty(true);
+	}
+
+	return true;
+}
+
 size_t Term::write(const std::string_view data, const ShowCtrlChars show_ctrl) {
 	Rune rune;
 	size_t charsize = 0;
 	const bool use_utf8 = m_mode[Mode::UTF8];
 
+	if (m_styles.needsCollection()) {
+		collectStyles();
+	}
+
+	if (m_clusters.needsCollection()) {
+		collectClusters();
+	}
+
 	// jump back to the current input screen upon entering new data
 	//
 	// if it is non-interactive input then we will return to the
@@ -953,6 +1212,28 @@ size_t Term::write(const std::string_view data, const ShowCtrlChars show_ctrl) {
 	return data.size();
 }
 
+void Term::collectStyles() {
+	std::vector<bool> in_use(m_styles.capacity(), false);
+
+	for (auto screen: {&m_screen, &m_saved_screen}) {
+		screen->markStyles(in_use);
+	}
+
+	m_styles.collect(in_use);
+	// the cached StyleIDs might have been released
+	resetStyleCache();
+}
+
+void Term::collectClusters() {
+	std::vector<bool> in_use(m_clusters.capacity(), false);
+
+	for (auto screen: {&m_screen, &m_saved_screen}) {
+		screen->markClusters(in_use);
+	}
+
+	m_clusters.collect(in_use);
+}
+
 void Term::stopScrolling() {
 	if (m_screen.isScrolled()) {
 		const auto shift = m_screen.stopScrolling();
@@ -2,18 +2,25 @@
 
 // C++
 #include <array>
+#include <chrono>
+#include <memory>
 #include <optional>
+#include <utility>
 #include <vector>
 
 // cosmos
 #include "cosmos/BitMask.hxx"
 
 // nst
+#include "ClusterTable.hxx"
 #include "CursorState.hxx"
 #include "EscapeHandler.hxx"
 #include "fwd.hxx"
 #include "Glyph.hxx"
+#include "HistoryIndex.hxx"
 #include "Screen.hxx"
+#include "ScreenShare.hxx"
+#include "StyleTable.hxx"
 #include "types.hxx"
 
 namespace nst {
@@ -65,6 +72,14 @@ public: // functions
 
 	void init(const Nst &nst);
 
+	/// Adjust colors after the active Theme has been replaced.
+	/**
+	 * Glyph colors are only stored in the StyleTable, thus this only
+	 * needs to patch the table entries and the cursor states and then
+	 * redraw the visible screen. The cost is independent of the size of
+	 * the scrollback history, neither history lines in the ring buffer
+	 * nor archived lines are touched.
+	 **/
 	void themeChanged(const Theme &old_theme, const Theme &new_theme);
 
 	/// Change the terminal dimensions.
@@ -328,6 +343,10 @@ public: // functions
 	void dumpLine(const CharPos pos) const;
 
 	/// Returns whether any glyph currently has the BLINK attribute set.
+	/**
+	 * This only needs to look at the attribute summary of each line in
+	 * the steady state, see lineHasAttr().
+	 **/
 	bool existsBlinkingGlyph() const;
 
 	/// Sets all lines as dirty that have a Glyph matching the given attribute.
@@ -392,12 +411,43 @@ public: // functions
 	auto& screen() const { return m_screen; }
 	const auto& savedScreen() const { return m_saved_screen; }
 
+	/// Returns the table for looking up the GlyphStyle of a Glyph.
+	const StyleTable& styles() const { return m_styles; }
+
+	/// Returns the table for looking up the code points of Glyphs carrying the CLUSTER flag.
+	const ClusterTable& clusters() const { return m_clusters; }
+
+	/// Returns the shared memory view of the screen, creating it on first use.
+	/**
+	 * The view is filled with the current screen contents when it is
+	 * created and kept up to date at draw time afterwards. On error a
+	 * cosmos::ApiError is thrown.
+	 **/
+	const ScreenShare& enableScreenShare();
+
+	/// Returns the trigram index over the scrollback history, if it is enabled.
+	const HistoryIndex* historyIndex() const { return m_history_index.get(); }
+
 	/// Report a focus change on TTY level via escape sequences.
 	void reportFocus(const bool in_focus) { m_esc_handler.reportFocus(in_focus); }
 	/// Report a paste event on TTY level via escape sequences.
 	void reportPaste(const bool started) { m_esc_handler.reportPaste(started); }
 	void stopScrolling();
 
+protected: // types
+
+#ifdef NST_DRAW_TIMING
+	/// Accumulated drawScreen() timings, see recordDrawTiming().
+	struct DrawTiming {
+		size_t frames = 0;
+		size_t lines = 0;
+		std::chrono::nanoseconds elapsed{0};
+	};
+
+	/// Number of frames after which the accumulated draw timings are reported.
+	static constexpr size_t DRAW_TIMING_FRAMES = 200;
+#endif
+
 protected: // functions
 
 	/// Feeds the given single input rune as input.
@@ -407,20 +457,63 @@ protected: // functions
 	 **/
 	void putChar(const Rune rune);
 
+	/// Adds the given Rune to the grapheme cluster of the previously written cell, if applicable.
+	/**
+	 * This applies to zero width characters like combining marks, ZWJ
+	 * and variation selectors, to anything following a ZWJ and to the
+	 * second half of a regional indicator pair (flags). Returns whether
+	 * the Rune has been consumed. Zero width characters without a
+	 * preceding cell are dropped.
+	 **/
+	bool attachToCluster(const RuneInfo &rinfo);
+
+	/// Returns the position of the cell that precedes the cursor for attaching combining characters.
+	std::optional<CharPos> clusterBase() const;
+
 	/// (Re-)Initialize `m_tabs` and setup the default tab positions.
 	void setupTabs();
 
+	/// Returns whether any Glyph in `line` uses the given attribute.
+	/**
+	 * This consults the Line's attribute summary and only scans the
+	 * Glyphs if the summary is unknown or might report a stale
+	 * attribute. The scan result is stored as the new exact summary.
+	 **/
+	bool lineHasAttr(const Line &line, const Glyph::Attr attr) const;
+
 	/// Resets the active scrolling area to use the whole screen.
 	void resetScrollArea() {
 		m_scroll_area = {0, m_size.rows - 1};
 	}
 
 	/// Draws the complete screen area.
-	void drawScreen() const;
+	/**
+	 * \return The number of dirty lines that have been drawn.
+	 **/
+	size_t drawScreen() const;
+
+#ifdef NST_DRAW_TIMING
+	/// Accounts a drawScreen() call and reports the statistics every DRAW_TIMING_FRAMES frames.
+	/**
+	 * Frames that needed to shape text not found in the Shaper's cache
+	 * are accounted as cold, all others as warm.
+	 **/
+	void recordDrawTiming(const size_t lines, const std::chrono::nanoseconds elapsed, const bool cold);
+#endif
 
 	/// Draws the cursor at its current position.
 	void drawCursor() const;
 
+	/// Stores the cursor position in m_screen_share and completes its current update.
+	void finishScreenShareUpdate();
+
+	/// Prepares text shaping for drawing the screen.
+	/**
+	 * Ligatures must not span the cursor cell, thus the lines the cursor
+	 * moves from and to need to be shaped again.
+	 **/
+	void prepareShaping();
+
 	/// Swaps from main to alternative screen and vice versa.
 	void swapScreen();
 
@@ -465,6 +558,38 @@ protected: // functions
 	/// Returns the Glyph the cursor is currently positioned at.
 	Glyph* curGlyph() { return &m_screen[m_cursor.pos]; }
 
+	/// Returns the StyleID for the current cursor attributes.
+	StyleID cursorStyle() {
+		return cachedStyle(m_cursor_style, m_cursor.attrs());
+	}
+
+	/// Returns the StyleID to use for erasing cells with the current cursor attributes.
+	StyleID eraseStyle() {
+		return cachedStyle(m_erase_style, m_cursor.attrs().eraseStyle());
+	}
+
+	/// Returns the StyleID for `style`, avoiding hash lookups if it is the same as in `cache`.
+	StyleID cachedStyle(std::pair<GlyphStyle, StyleID> &cache, const GlyphStyle &style) {
+		if (cache.first != style) {
+			cache = {style, m_styles.intern(style)};
+		}
+
+		return cache.second;
+	}
+
+	/// Drops cached StyleIDs after the StyleTable has been modified.
+	void resetStyleCache() {
+		const auto &def = m_styles[Glyph::DEFAULT_STYLE];
+		m_cursor_style = {def, Glyph::DEFAULT_STYLE};
+		m_erase_style = {def, Glyph::DEFAULT_STYLE};
+	}
+
+	/// Releases StyleTable entries that are no longer referenced by any Glyph.
+	void collectStyles();
+
+	/// Releases ClusterTable entries that are no longer referenced by any Glyph.
+	void collectClusters();
+
 protected: // data
 
 	Selection &m_selection;
@@ -482,6 +607,12 @@ protected: // data
 	size_t m_active_charset = 0;       ///< current charset used from m_charsets
 
 	CursorState m_cursor;             ///< current cursor position and attributes
+	StyleTable m_styles;              ///< interned rendering attributes of all Glyphs
+	std::pair<GlyphStyle, StyleID> m_cursor_style; ///< cached StyleID for the cursor attributes
+	std::pair<GlyphStyle, StyleID> m_erase_style;  ///< cached StyleID for erasing cells
+	ClusterTable m_clusters;          ///< code point sequences of cells displaying grapheme clusters
+	std::unique_ptr<ScreenShare> m_screen_share; ///< optional shared memory view of the screen, see enableScreenShare()
+	std::unique_ptr<HistoryIndex> m_history_index; ///< optional search index over the main screen's history
 
 	bool m_allow_altscreen = false;  ///< whether altscreen support is enabled
 	EscapeHandler m_esc_handler; ///< processes any kinds of terminal escape sequences
@@ -489,6 +620,10 @@ protected: // data
 	Screen m_saved_screen; ///< all the glyphs that make up the saved terminal screen
 	std::vector<bool> m_tabs;                ///< marks horizontal tab positions for all lines
 	bool m_keep_scroll_position = true;
+#ifdef NST_DRAW_TIMING
+	DrawTiming m_cold_timing; ///< frames that needed to shape uncached text runs
+	DrawTiming m_warm_timing; ///< frames that only used cached shaping results, or no shaping at all
+#endif
 };
 
 } // end ns
@@ -1,3 +1,7 @@
+// C++
+#include <algorithm>
+#include <climits>
+
 // cosmos
 #include "cosmos/error/RuntimeError.hxx"
 #include "cosmos/formatting.hxx"
@@ -38,6 +42,7 @@ WindowSystem::WindowSystem(Nst &nst) :
 }
 
 WindowSystem::~WindowSystem() {
+	m_window_draw_ctx.destroy();
 	m_font_draw_ctx.destroy();
 	m_pixmap.destroy();
 	m_graphics_context.destroy();
@@ -93,6 +98,7 @@ void WindowSystem::handleFontUpdate() {
 void WindowSystem::allocPixmap() {
 	m_pixmap = xpp::Pixmap{m_window, m_twin.winExtent()};
 	m_font_draw_ctx.setup(m_display, m_pixmap);
+	m_window_draw_ctx.setup(m_display, static_cast<Drawable>(xpp::to_drawable(m_window)));
 }
 
 void WindowSystem::resize(const TermSize dim) {
@@ -111,6 +117,49 @@ void WindowSystem::clearWindow() {
 void WindowSystem::clearRect(const DrawPos pos1, const DrawPos pos2) {
 	const auto idx = m_twin.activeForegroundColor(m_nst.theme());
 	m_font_draw_ctx.drawRect(m_color_manager.fontColor(idx), pos1, Extent{pos2.x - pos1.x, pos2.y - pos1.y});
+	// this is only used for clearing the complete window
+	m_full_damage = true;
+}
+
+void WindowSystem::addDamage(const DrawPos pos, const Extent ext) {
+	if (m_full_damage || ext.width <= 0 || ext.height <= 0)
+		return;
+
+	if (!m_damage.empty()) {
+		// merge vertically adjacent line bands of the same width,
+		// which is the common case when consecutive lines are dirty
+		auto &last = m_damage.back();
+		if (last.x == pos.x && last.width == ext.width && last.y + last.height == pos.y) {
+			last.height += static_cast<unsigned short>(ext.height);
+			return;
+		}
+	}
+
+	m_damage.push_back(XRectangle{
+		static_cast<short>(pos.x),
+		static_cast<short>(pos.y),
+		static_cast<unsigned short>(ext.width),
+		static_cast<unsigned short>(ext.height)
+	});
+}
+
+void WindowSystem::copyDamage() {
+	if (m_full_damage) {
+		m_window.copyArea(m_graphics_context, m_pixmap, m_twin.winExtent());
+	} else if (!m_damage.empty() && !m_window_draw_ctx.copyAreas(m_font_draw_ctx, m_damage)) {
+		// no XRender pictures available, copy everything instead
+		m_window.copyArea(m_graphics_context, m_pixmap, m_twin.winExtent());
+	}
+
+	m_damage.clear();
+	m_full_damage = false;
+}
+
+void WindowSystem::exposeArea(const DrawPos pos, const Extent ext) {
+	// the back buffer still holds the complete window contents, so there
+	// is no need to render anything again.
+	addDamage(pos, ext);
+	copyDamage();
 }
 
 void WindowSystem::setupWinAttrs() {
@@ -377,11 +426,24 @@ void WindowSystem::applyConfig(TermSize &tsize) {
 	if (auto hide = config_file.asBool("hide_mouse_cursor"); hide != std::nullopt) {
 		m_hide_mouse_cursor = *hide;
 	}
+
+	if (auto box_drawing = config_file.asBool("box_drawing"); box_drawing != std::nullopt) {
+		m_draw_box_chars = *box_drawing;
+	}
+
+	const auto ligatures = config_file.asBool("ligatures").value_or(config::LIGATURES);
+
+	if (ligatures && !Shaper::available()) {
+		m_nst.logger().error() << "ligatures are not supported, nst has been built without HarfBuzz\n";
+	} else {
+		m_shape_text = ligatures;
+	}
 }
 
 void WindowSystem::makeGlyphFontSpecs(const Glyph *glyphs, const size_t count, const CharPos char_pos) {
 	const auto chr = m_twin.chrExtent();
 	const auto start_pos = m_twin.toDrawPos(char_pos);
+	const auto &styles = m_nst.term().styles();
 	Glyph::AttrBitMask prev_mode{Glyph::AttrBitMask::all};
 	DrawPos cur_pos{start_pos};
 	Font *font = nullptr;
@@ -389,6 +451,8 @@ void WindowSystem::makeGlyphFontSpecs(const Glyph *glyphs, const size_t count, c
 	GlyphFontSpec spec;
 
 	m_font_specs.clear();
+	m_cluster_specs.clear();
+	m_cluster_owners.clear();
 
 	for (size_t i = 0; i < count; i++) {
 		const auto &glyph = glyphs[i];
@@ -398,14 +462,61 @@ void WindowSystem::makeGlyphFontSpecs(const Glyph *glyphs, const size_t count, c
 			continue;
 
 		// Determine font for glyph if different from previous glyph.
-		if (const auto mode = glyph.mode; prev_mode != mode) {
+		auto mode = styles[glyph.style].mode;
+		if (glyph.isWide())
+			mode.set(Attr::WIDE);
+
+		if (prev_mode != mode) {
 			prev_mode = mode;
 			font = m_font_manager.fontForMode(mode);
 			runewidth = chr.width * glyph.width();
 			cur_pos.y = start_pos.y + font->ascent();
 		}
 
-		m_font_manager.assignFont(glyph.rune, *font, spec);
+		if (glyph.isCluster()) {
+			makeClusterFontSpecs(glyph, *font, cur_pos);
+			cur_pos.moveRight(runewidth);
+			continue;
+		}
+
+		if (m_shape_text) {
+			// try to shape a run of characters starting here
+			const auto len = shapeableRun(glyphs + i, count - i, char_pos.x + i);
+			const Shaper::ShapedRun *shaped = nullptr;
+
+			if (len > 1) {
+				m_shaping_runes.clear();
+				for (size_t j = i; j < i + len; j++) {
+					m_shaping_runes.push_back(glyphs[j].rune);
+				}
+
+				shaped = m_font_manager.shaper().shape(font->match(), m_shaping_runes.data(), len);
+			}
+
+			if (shaped) {
+				spec.font = font->match();
+
+				for (const auto &shaped_glyph: *shaped) {
+					spec.glyph = shaped_glyph.glyph;
+					spec.setPos(cur_pos.atRight(shaped_glyph.x_offset).atAbove(shaped_glyph.y_offset));
+					m_font_specs.emplace_back(spec);
+					cur_pos.moveRight(runewidth);
+				}
+
+				// skip the glyphs covered by the shaped run
+				i += len - 1;
+				continue;
+			}
+		}
+
+		if (m_draw_box_chars && BoxDrawing::handles(glyph.rune)) {
+			// drawn procedurally in drawGlyphFontSpecs(), no
+			// font lookup is necessary
+			spec.font = nullptr;
+			spec.glyph = glyph.rune;
+		} else {
+			m_font_manager.assignFont(glyph.rune, *font, spec);
+		}
 		spec.setPos(cur_pos);
 
 		m_font_specs.emplace_back(spec);
@@ -415,54 +526,191 @@ void WindowSystem::makeGlyphFontSpecs(const Glyph *glyphs, const size_t count, c
 	m_next_font_spec = m_font_specs.begin();
 }
 
-void WindowSystem::drawGlyphFontSpecs(Glyph base, const size_t count, const CharPos char_pos) {
+void WindowSystem::makeClusterFontSpecs(const Glyph &glyph, Font &font, const DrawPos pos) {
+	const auto &seq = m_nst.term().clusters()[glyph.rune];
+	const auto runes = reinterpret_cast<const Rune*>(seq.data());
+	const auto owner = m_font_specs.size();
+	GlyphFontSpec spec;
+
+	auto addSpec = [this, owner](const GlyphFontSpec &s) {
+		// the first spec represents the cell, the rest is drawn on top of it
+		if (m_font_specs.size() == owner) {
+			m_font_specs.emplace_back(s);
+		} else {
+			m_cluster_specs.emplace_back(s);
+			m_cluster_owners.push_back(owner);
+		}
+	};
+
+	// the base character determines the (possibly fallback) font used
+	// for the complete cluster
+	m_font_manager.assignFont(runes[0], font, spec);
+	spec.setPos(pos);
+
+	if (const auto shaped = m_font_manager.shaper().shapeCluster(spec.font, runes, seq.size()); shaped) {
+		for (const auto &shaped_glyph: *shaped) {
+			spec.glyph = shaped_glyph.glyph;
+			spec.setPos(pos.atRight(shaped_glyph.x_offset).atAbove(shaped_glyph.y_offset));
+			addSpec(spec);
+		}
+
+		return;
+	}
+
+	// without shaping support simply draw all code points on top of each
+	// other, like xterm does.
+	addSpec(spec);
+
+	for (size_t i = 1; i < seq.size(); i++) {
+		m_font_manager.assignFont(runes[i], font, spec);
+		spec.setPos(pos);
+		addSpec(spec);
+	}
+}
+
+size_t WindowSystem::shapeableRun(const Glyph *glyphs, const size_t count, const int col) const {
+	// spaces are not part of shaped runs, ligatures don't cross word
+	// boundaries and short runs result in a better cache hit rate.
+	auto shapeable = [this](const Glyph &g) {
+		return !g.isWide() && !g.isDummy() && !g.isCluster() && g.rune != ' ' &&
+			!(m_draw_box_chars && BoxDrawing::handles(g.rune));
+	};
+
+	const auto &first = glyphs[0];
+
+	if (!shapeable(first))
+		return 0;
+
+	size_t len = 1;
+
+	for (; len < count; len++) {
+		const auto &glyph = glyphs[len];
+		const auto glyph_col = col + static_cast<int>(len);
+
+		if (!shapeable(glyph) || first.featuresDiffer(glyph))
+			break;
+		else if (std::find(m_shaping_breaks.begin(), m_shaping_breaks.end(), glyph_col) != m_shaping_breaks.end())
+			break;
+	}
+
+	return len;
+}
+
+void WindowSystem::drawGlyphFontSpecs(const Glyph base, GlyphStyle style, const size_t count, const CharPos char_pos) {
 	const auto pos = m_twin.toDrawPos(char_pos);
 	const auto chr = m_twin.chrExtent();
 	const int textwidth = count * base.width() * chr.width;
+	const Extent area{textwidth, chr.height};
 
-	cleanupWindowBorders(textwidth, char_pos, pos);
-
-	m_font_manager.sanitize(base);
-	m_color_manager.configureFor(base);
+	m_font_manager.sanitize(style);
+	m_color_manager.configureFor(style);
 
 	// Clean up the region we want to draw to.
-	m_font_draw_ctx.drawRect(m_color_manager.backColor(), pos, Extent{textwidth, chr.height});
-
-	// Set the clip region because Xft is sometimes dirty.
-	m_font_draw_ctx.setClipRectangle(pos, Extent{textwidth, chr.height});
+	m_draw_batch.addBackground(m_color_manager.backColor(), pos, area);
+	// Glyphs are clipped to the union of all drawn areas.
+	m_draw_batch.addClip(pos, area);
 
 	const auto &front_color = m_color_manager.frontColor();
 
 	// Render the glyphs.
-	m_font_draw_ctx.drawSpecs(front_color, m_next_font_spec, m_next_font_spec + count);
+	m_draw_batch.addSpecs(front_color, m_next_font_spec, m_next_font_spec + count);
 
-	// Render underline and strike through.
-	if (base.isUnderlined()) {
-		m_font_draw_ctx.drawRect(front_color, pos.atBelow(m_font_manager.ascent() * config::CH_SCALE + 1), Extent{textwidth, 1});
+	if (!m_cluster_specs.empty()) {
+		// add the additional specs of grapheme clusters in this series
+		const auto first = static_cast<size_t>(m_next_font_spec - m_font_specs.begin());
+		const auto begin = std::lower_bound(m_cluster_owners.begin(), m_cluster_owners.end(), first);
+		const auto end = std::lower_bound(begin, m_cluster_owners.end(), first + count);
+
+		m_draw_batch.addSpecs(front_color,
+				m_cluster_specs.begin() + (begin - m_cluster_owners.begin()),
+				m_cluster_specs.begin() + (end - m_cluster_owners.begin()));
+	}
+
+	if (m_draw_box_chars) {
+		const Extent cell{chr.width * base.width(), chr.height};
+
+		for (auto it = m_next_font_spec; it < m_next_font_spec + count; it++) {
+			if (it->font)
+				continue;
+
+			m_box_drawing.draw(m_draw_batch, it->glyph, DrawPos{it->x, pos.y},
+					cell, front_color, m_color_manager.backColor());
+		}
 	}
 
-	if (base.isStruck()) {
-		m_font_draw_ctx.drawRect(front_color, pos.atBelow(2 * m_font_manager.ascent() * config::CH_SCALE / 3), Extent{textwidth, 1});
+	// Render underline and strike through.
+	if (style.isUnderlined()) {
+		m_draw_batch.addForeground(front_color, pos.atBelow(m_font_manager.ascent() * config::CH_SCALE + 1), Extent{textwidth, 1});
 	}
 
-	m_font_draw_ctx.resetClip();
+	if (style.isStruck()) {
+		m_draw_batch.addForeground(front_color, pos.atBelow(2 * m_font_manager.ascent() * config::CH_SCALE / 3), Extent{textwidth, 1});
+	}
 
 	m_next_font_spec += count;
 }
 
-void WindowSystem::drawGlyph(const Glyph g, const CharPos pos) {
+void WindowSystem::drawGlyph(const Glyph g, const GlyphStyle &style, const CharPos pos) {
+	// the cursor cell may overlap with screen contents drawn in this
+	// frame, so keep the painting order intact.
+	flushDrawing();
 	makeGlyphFontSpecs(&g, 1, pos);
-	drawGlyphFontSpecs(g, 1, pos);
+	drawGlyphFontSpecs(g, style, 1, pos);
+	flushDrawing();
+
+	const auto chr = m_twin.chrExtent();
+	addDamage(m_twin.toDrawPos(pos), Extent{chr.width * g.width(), chr.height});
+}
+
+void WindowSystem::flushDrawing() {
+	if (m_frame_area) {
+		cleanupWindowBorders(m_frame_area->first, m_frame_area->second);
+		m_frame_area.reset();
+	}
+
+	m_draw_batch.flush(m_font_draw_ctx);
 }
 
 void WindowSystem::drawGlyphs(Line::const_iterator it, const Line::const_iterator end, CharPos start_pos) {
 	// NOTE: in C++20 we can use a std::span here to pass in a sub-vector
 	// instead of the more complicated iterator range.
-	const auto &selection = m_nst.selection();
+	// the selection state is determined once for the complete row
+	const auto selected_cols = m_nst.selection().selectedCols(start_pos.y);
+	const auto &styles = m_nst.term().styles();
 	Glyph base = *it;
+	bool base_selected = false;
 	size_t num_specs = 0;
 	CharPos cur_pos{start_pos};
 
+	{
+		// extend the frame area for border cleanup in flushDrawing()
+		const auto chr = m_twin.chrExtent();
+		const auto draw_begin = m_twin.toDrawPos(start_pos);
+		const auto draw_end = draw_begin.atRight(chr.width * (end - it)).atBelow(chr.height);
+
+		addDamage(draw_begin, Extent{draw_end.x - draw_begin.x, draw_end.y - draw_begin.y});
+
+		if (!m_frame_area) {
+			m_frame_area = std::make_pair(draw_begin, draw_end);
+		} else {
+			auto &[area_begin, area_end] = *m_frame_area;
+			area_begin = DrawPos{std::min(area_begin.x, draw_begin.x), std::min(area_begin.y, draw_begin.y)};
+			area_end = DrawPos{std::max(area_end.x, draw_end.x), std::max(area_end.y, draw_end.y)};
+		}
+	}
+
+	if (m_shape_text) {
+		// don't let ligatures span the cursor or selection boundaries,
+		// since these are drawn differently
+		const bool has_cursor = m_shaping_cursor && m_shaping_cursor->y == start_pos.y;
+		m_shaping_breaks = {
+			has_cursor ? m_shaping_cursor->x : -1,
+			has_cursor ? m_shaping_cursor->x + 1 : -1,
+			selected_cols ? selected_cols->left : -1,
+			selected_cols ? std::min(selected_cols->right, INT_MAX - 1) + 1 : -1
+		};
+	}
+
 	makeGlyphFontSpecs(&(*it), end - it, start_pos);
 
 	size_t specs_left = m_font_specs.end() - m_next_font_spec;
@@ -471,23 +719,24 @@ void WindowSystem::drawGlyphs(Line::const_iterator it, const Line::const_iterato
 	// feed them into drawGlyphFontSpecs until we're done with the given
 	// range.
 
-	for (
-			Glyph glyph;
-			it < end && num_specs < specs_left;
-			++it, cur_pos.moveRight()) {
-		// we need to copy, because of the possible mode
-		// flip below
-		glyph = *it;
+	auto drawSeries = [&]() {
+		auto style = styles[base.style];
+		if (base_selected)
+			style.mode.flip(Attr::REVERSE);
+		drawGlyphFontSpecs(base, style, num_specs, start_pos);
+	};
+
+	for (; it < end && num_specs < specs_left; ++it, cur_pos.moveRight()) {
+		const auto &glyph = *it;
 
-		if (glyph.isDummy()) {
+		if (glyph.isDummy())
 			continue;
-		} else if (selection.isSelected(cur_pos)) {
-			glyph.mode.flip(Attr::REVERSE);
-		}
+
+		const bool selected = selected_cols && selected_cols->inRange(cur_pos.x);
 
 		// a change in drawing features occurred, draw the series we collected so far
-		if (num_specs != 0 && base.featuresDiffer(glyph)) {
-			drawGlyphFontSpecs(base, num_specs, start_pos);
+		if (num_specs != 0 && (base.featuresDiffer(glyph) || selected != base_selected)) {
+			drawSeries();
 			specs_left = m_font_specs.end() - m_next_font_spec;
 			num_specs = 0;
 			// a new series started, remember its properties
@@ -497,59 +746,53 @@ void WindowSystem::drawGlyphs(Line::const_iterator it, const Line::const_iterato
 		// for each new series make sure we have the proper reference
 		if (num_specs == 0) {
 			base = glyph;
+			base_selected = selected;
 		}
 
 		num_specs++;
 	}
 
 	if (num_specs != 0) {
-		drawGlyphFontSpecs(base, num_specs, start_pos);
+		drawSeries();
 	}
 }
 
-void WindowSystem::cleanupWindowBorders(const int textwidth, const CharPos char_pos, const DrawPos draw_pos) {
-	const auto chr = m_twin.chrExtent();
+void WindowSystem::cleanupWindowBorders(const DrawPos begin, const DrawPos end) {
 	const auto tty = m_twin.TTYExtent();
 	const auto win = m_twin.winExtent();
-	const bool reaches_bottom_border = draw_pos.y + chr.height >= m_border_pixels + tty.height;
+	const auto &color = m_color_manager.fontColor(m_twin.activeForegroundColor(m_nst.theme()));
+	const bool touches_top_border = begin.y <= m_border_pixels;
+	const bool reaches_bottom_border = end.y >= m_border_pixels + tty.height;
+	const int top = touches_top_border ? 0 : begin.y;
+	const int bottom = reaches_bottom_border ? win.height : end.y;
 
 	// NOTE: it is not fully clear why the window borders should get dirty
 	// in the first place.
 
+	auto clear = [this, &color](const DrawPos pos1, const DrawPos pos2) {
+		const Extent ext{pos2.x - pos1.x, pos2.y - pos1.y};
+		m_draw_batch.addBackground(color, pos1, ext);
+		addDamage(pos1, ext);
+	};
+
 	// left border
-	if (char_pos.x == 0) {
-		const auto pos1 = DrawPos{0, char_pos.y ? draw_pos.y : 0};
-		const auto pos2 = DrawPos{
-			m_border_pixels,
-			char_pos.y + chr.height + (reaches_bottom_border ? win.height : 0)
-		};
-		clearRect(pos1, pos2);
+	if (begin.x <= m_border_pixels) {
+		clear(DrawPos{0, top}, DrawPos{m_border_pixels, bottom});
 	}
 
 	// right border
-	if (draw_pos.x + textwidth >= m_border_pixels + tty.width) {
-		const auto pos1 = DrawPos{
-			draw_pos.x + textwidth,
-			char_pos.y ? draw_pos.y : 0};
-		const auto pos2 = DrawPos{
-			win.width,
-			reaches_bottom_border ? win.height : draw_pos.y + chr.height
-		};
-		clearRect(pos1, pos2);
+	if (end.x >= m_border_pixels + tty.width) {
+		clear(DrawPos{end.x, top}, DrawPos{win.width, bottom});
 	}
 
 	// top border
-	if (char_pos.y == 0) {
-		clearRect(
-				DrawPos{draw_pos.x, 0},
-				DrawPos{draw_pos.x + textwidth, m_border_pixels});
+	if (touches_top_border) {
+		clear(DrawPos{begin.x, 0}, DrawPos{end.x, m_border_pixels});
 	}
 
 	// bottom border
-	if (draw_pos.y + chr.height >= m_border_pixels + tty.height) {
-		clearRect(
-				DrawPos{draw_pos.x, draw_pos.y + chr.height},
-				DrawPos{draw_pos.x + textwidth, win.height});
+	if (reaches_bottom_border) {
+		clear(DrawPos{begin.x, end.y}, DrawPos{end.x, win.height});
 	}
 }
 
@@ -603,17 +846,24 @@ void WindowSystem::invertColors() {
 	m_nst.term().redraw();
 }
 
-void WindowSystem::clearCursor(const CharPos pos, Glyph glyph) {
+void WindowSystem::clearCursor(const CharPos pos, const Glyph glyph) {
+	auto style = m_nst.term().styles()[glyph.style];
 	if (m_nst.selection().isSelected(pos))
-		glyph.mode.flip(Attr::REVERSE);
-	drawGlyph(glyph, pos);
+		style.mode.flip(Attr::REVERSE);
+	drawGlyph(glyph, style, pos);
 }
 
 void WindowSystem::drawCursor(const CharPos pos, Glyph glyph) {
+	// cursor shapes are drawn directly, so nothing from the screen
+	// contents may be pending anymore.
+	flushDrawing();
 
-	auto &color = m_color_manager.applyCursorColor(m_nst.selection().isSelected(pos), glyph);
+	auto style = m_nst.term().styles()[glyph.style];
+	auto &color = m_color_manager.applyCursorColor(m_nst.selection().isSelected(pos), style);
 	const auto chr = m_twin.chrExtent();
 
+	addDamage(m_twin.toDrawPos(pos), chr);
+
 	if (m_twin.hideCursor()) {
 		return;
 	} else if (m_twin.isFocused()) {
@@ -627,12 +877,13 @@ void WindowSystem::drawCursor(const CharPos pos, Glyph glyph) {
 				// over existing text, that the text will no
 				// longer be visible.
 				glyph.rune = 0x2603; // snowman (U+2603)
+				glyph.resetCluster();
 			/* FALLTHROUGH */
 			case CursorStyle::BLINKING_BLOCK:
 			case CursorStyle::BLINKING_BLOCK_DEFAULT:
 			case CursorStyle::STEADY_BLOCK:
 			case CursorStyle::REVERSE_BLOCK:
-				drawGlyph(glyph, pos);
+				drawGlyph(glyph, style, pos);
 				break;
 			case CursorStyle::BLINKING_UNDERLINE:
 			case CursorStyle::STEADY_UNDERLINE: {
@@ -725,10 +976,10 @@ void WindowSystem::popTitle() {
 }
 
 void WindowSystem::finishDraw() {
-	const auto extent = m_twin.winExtent();
 	const auto &color = m_color_manager.fontColor(m_twin.activeForegroundColor(m_nst.theme()));
 
-	m_window.copyArea(m_graphics_context, m_pixmap, extent);
+	flushDrawing();
+	copyDamage();
 	m_graphics_context.setForeground(color.index());
 }
 
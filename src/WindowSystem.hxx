@@ -1,8 +1,12 @@
 #pragma once
 
 // C++
+#include <array>
 #include <deque>
+#include <optional>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 // cosmos
 #include "cosmos/SysString.hxx"
@@ -18,7 +22,9 @@
 #include "xpp/XWindow.hxx"
 
 // nst
+#include "BoxDrawing.hxx"
 #include "color.hxx"
+#include "DrawBatch.hxx"
 #include "font.hxx"
 #include "Input.hxx"
 #include "TermWindow.hxx"
@@ -97,13 +103,28 @@ public: // functions
 	/// Restore the last window title stored via pushTitle().
 	void popTitle();
 
-	void clearCursor(const CharPos pos, Glyph glyph);
+	void clearCursor(const CharPos pos, const Glyph glyph);
 	void drawCursor(const CharPos pos, Glyph glyph);
 	void setCursorStyle(const CursorStyle cursor);
 
 	/// Draw a range of Glyphs from it to end starting at coordinate start_pos
 	void drawGlyphs(Line::const_iterator it, const Line::const_iterator end, CharPos start_pos);
 
+	/// Returns whether text shaping for ligatures is active.
+	bool shapesText() const { return m_shape_text; }
+
+	/// Returns the number of text runs that needed to be shaped so far, see Shaper::misses().
+	size_t shapingMisses() { return m_font_manager.shaper().misses(); }
+
+	/// Sets the cursor position to consider during text shaping.
+	/**
+	 * Ligatures are broken up at the cursor position, so that the cursor
+	 * always covers exactly one character.
+	 **/
+	void setShapingCursor(const std::optional<CharPos> pos) {
+		m_shaping_cursor = pos;
+	}
+
 	/// Change the given WinMode setting.
 	/**
 	 * This is used by escape handling parsers to trigger requested.
@@ -141,6 +162,9 @@ public: // functions
 
 	void clearWindow();
 
+	/// Copy the given window area from the back buffer after an Expose event.
+	void exposeArea(const DrawPos pos, const Extent ext);
+
 	const xpp::XWindow& window() const { return m_window; }
 	xpp::XWindow& window() { return m_window; }
 	auto& selection() { return m_selection; }
@@ -176,14 +200,44 @@ protected: // functions
 	 * \param[in] count The number of Glyphs to draw.
 	 * \param[in] base The template Glyph properties that all `count`
 	 * following glyphs will share.
+	 * \param[in] style The resolved style of `base`, possibly adjusted
+	 * for selection or cursor display.
+	 **/
+	void drawGlyphFontSpecs(const Glyph base, GlyphStyle style, const size_t count, const CharPos char_pos);
+
+	/// Adds the specs for a Glyph carrying the CLUSTER flag at `pos`.
+	/**
+	 * The first spec is added to `m_font_specs` like for any other
+	 * Glyph, any further specs are added to `m_cluster_specs`.
 	 **/
-	void drawGlyphFontSpecs(Glyph base, const size_t count, const CharPos char_pos);
+	void makeClusterFontSpecs(const Glyph &glyph, Font &font, const DrawPos pos);
+
+	/// Returns the number of Glyphs starting at `glyphs` that can be shaped as a single run.
+	/**
+	 * \param[in] col The column of the first Glyph, needed to honor the
+	 * shaping breaks for cursor and selection.
+	 **/
+	size_t shapeableRun(const Glyph *glyphs, const size_t count, const int col) const;
 
 	/// Draw the given single Glyph at position `loc`.
-	void drawGlyph(const Glyph g, const CharPos loc);
+	/**
+	 * This is used for cursor drawing, which needs to be painted on top of
+	 * the screen contents. Pending drawing operations are flushed before
+	 * and after the Glyph is drawn.
+	 **/
+	void drawGlyph(const Glyph g, const GlyphStyle &style, const CharPos loc);
+
+	/// Issue all pending drawing operations of the current frame.
+	void flushDrawing();
+
+	/// Mark the given area of the back buffer to be copied to the window in finishDraw().
+	void addDamage(const DrawPos pos, const Extent ext);
+
+	/// Copy all damaged areas from the back buffer to the window.
+	void copyDamage();
 
-	// Intelligent cleaning up of the borders.
-	void cleanupWindowBorders(const int textwidth, const CharPos char_pos, const DrawPos draw_pos);
+	/// Intelligent cleaning up of the borders adjacent to the given drawing area.
+	void cleanupWindowBorders(const DrawPos begin, const DrawPos end);
 
 	void embeddedFocusChange(const bool in_focus);
 	void focusChange(const bool in_focus);
@@ -211,9 +265,13 @@ protected: // data
 	TermWindow m_twin;
 	FontManager m_font_manager;
 	FontDrawContext m_font_draw_ctx;
+	FontDrawContext m_window_draw_ctx; ///< used for copying damaged areas to the window
 	ColorManager m_color_manager;
 	XSelection m_selection;
+	BoxDrawing m_box_drawing;
 	bool m_blinking_cursor_style = false;
+	bool m_draw_box_chars = config::BOX_DRAWING; ///< whether BoxDrawing is used for supported glyphs
+	bool m_shape_text = false; ///< whether text shaping is used for displaying ligatures
 	int m_border_pixels = 0;
 	int m_cursor_thickness = 1;
 	bool m_initialized = false;
@@ -232,6 +290,24 @@ protected: // data
 	GlyphFontSpecVector m_font_specs;
 	/// To keep track of the remaining font specs to draw in drawGlyphFontSpecs()
 	GlyphFontSpecVector::iterator m_next_font_spec;
+	/// Additional specs for grapheme clusters, drawn on top of the cell's spec in `m_font_specs`.
+	GlyphFontSpecVector m_cluster_specs;
+	/// For each entry in `m_cluster_specs` the index of the cell's spec in `m_font_specs`.
+	std::vector<size_t> m_cluster_owners;
+	/// Cursor position where shaped runs need to be split.
+	std::optional<CharPos> m_shaping_cursor;
+	/// Columns where shaped runs need to be split in the line currently drawn.
+	std::array<int, 4> m_shaping_breaks{-1, -1, -1, -1};
+	/// Buffer for the Runes of a run passed to the Shaper.
+	std::vector<Rune> m_shaping_runes;
+	/// Collects the drawing operations of the current frame.
+	DrawBatch m_draw_batch;
+	/// Bounding box of the screen area drawn in the current frame (for border cleanup).
+	std::optional<std::pair<DrawPos, DrawPos>> m_frame_area;
+	/// Areas of the back buffer that changed since the last finishDraw().
+	std::vector<XRectangle> m_damage;
+	/// Whether the complete back buffer needs to be copied in finishDraw().
+	bool m_full_damage = true;
 
 	static constexpr size_t MAX_TITLE_STACK_SIZE = 10;
 	std::deque<std::string> m_title_stack;
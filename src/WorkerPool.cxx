@@ -0,0 +1,58 @@
+// nst
+#include "WorkerPool.hxx"
+
+namespace nst {
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard guard{m_lock};
+		m_stop = true;
+		m_tasks.clear();
+	}
+
+	m_cond.notify_all();
+
+	for (auto &thread: m_threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+	std::lock_guard guard{m_lock};
+
+	// running tasks might still submit while the pool is destroyed
+	if (m_stop)
+		return;
+
+	m_tasks.push_back(std::move(task));
+
+	if (m_idle == 0 && m_threads.size() < m_max_threads) {
+		m_threads.emplace_back([this]() { run(); });
+	} else {
+		m_cond.notify_one();
+	}
+}
+
+void WorkerPool::run() {
+	std::unique_lock lock{m_lock};
+
+	while (true) {
+		m_idle++;
+		m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+		m_idle--;
+
+		if (m_stop)
+			return;
+
+		auto task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+
+		lock.unlock();
+		task();
+		// release anything owned by the task outside of the lock
+		task = nullptr;
+		lock.lock();
+	}
+}
+
+} // end ns
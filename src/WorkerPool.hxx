@@ -0,0 +1,62 @@
+#pragma once
+
+// C++
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nst {
+
+/// A fixed maximum number of threads processing tasks in FIFO order.
+/**
+ * Expensive IPC replies (see IpcHandler) and the parallel parts of a
+ * HistorySearch share this pool. This way the number of threads working on
+ * behalf of IPC clients stays bounded, no matter how many requests arrive.
+ * Threads are only started once there are tasks for them.
+ *
+ * Tasks must not wait for other tasks queued in the pool, since these might
+ * never get to run if all threads are waiting. Tasks must not throw.
+ **/
+class WorkerPool {
+public: // functions
+
+	/// Creates a pool that runs at most `threads` tasks in parallel.
+	explicit WorkerPool(const size_t threads) :
+			m_max_threads{threads} {}
+
+	/// Discards tasks that haven't been started yet and waits for the running ones.
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/// Returns the maximum number of tasks running in parallel.
+	size_t size() const { return m_max_threads; }
+
+	/// Queues `task` for execution in one of the pool's threads.
+	/**
+	 * Once the pool is being destroyed `task` is silently discarded.
+	 **/
+	void submit(std::function<void()> task);
+
+protected: // functions
+
+	/// The main function of the pool's threads.
+	void run();
+
+protected: // data
+
+	size_t m_max_threads = 0;
+	std::mutex m_lock; ///< protects the members below
+	std::condition_variable m_cond; ///< signals new tasks or m_stop to idle threads
+	std::deque<std::function<void()>> m_tasks; ///< tasks not yet started, oldest first
+	std::vector<std::thread> m_threads;
+	size_t m_idle = 0; ///< the number of threads waiting for tasks
+	bool m_stop = false; ///< set when the pool is destroyed
+};
+
+} // end ns
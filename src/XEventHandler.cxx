@@ -295,7 +295,10 @@ void XEventHandler::process() {
 }
 
 void XEventHandler::expose() {
-	m_nst.term().redraw();
+	// the back buffer pixmap is always complete, so only copy the exposed
+	// area instead of rendering everything again.
+	const auto &ev = m_event.raw().xexpose;
+	m_wsys.exposeArea(DrawPos{ev.x, ev.y}, Extent{ev.width, ev.height});
 }
 
 void XEventHandler::visibilityChange(const xpp::VisibilityEvent &ev) {
@@ -43,6 +43,7 @@ protected: // functions
 	/// Processes the currently set X11 event.
 	void process();
 
+	/// Restores the exposed window area from the back buffer.
 	void expose();
 	void visibilityChange(const xpp::VisibilityEvent &);
 	void unmap();
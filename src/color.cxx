@@ -162,7 +162,7 @@ bool ColorManager::setColorName(const ColorIndex idx, const cosmos::SysString na
 	}
 }
 
-void ColorManager::configureFor(const Glyph base) {
+void ColorManager::configureFor(const GlyphStyle &base) {
 	auto assignBaseColor = [this](FontColor &out, const ColorIndex color) {
 		if (is_true_color(color)) {
 			out.load(RenderColor{color});
@@ -214,35 +214,35 @@ void ColorManager::applyReverseMode() {
 	}
 }
 
-const FontColor& ColorManager::applyCursorColor(const bool is_selected, Glyph &glyph) const {
+const FontColor& ColorManager::applyCursorColor(const bool is_selected, GlyphStyle &style) const {
 	// Select the right color for the right mode.
-	glyph.mode.limit({Attr::BOLD, Attr::ITALIC, Attr::UNDERLINE, Attr::STRUCK, Attr::WIDE});
+	style.mode.limit({Attr::BOLD, Attr::ITALIC, Attr::UNDERLINE, Attr::STRUCK});
 
 	if (m_twin.inReverseMode()) {
-		glyph.setReverseColor();
-		glyph.bg = m_theme.fg;
+		style.setReverseColor();
+		style.bg = m_theme.fg;
 		if (is_selected) {
-			glyph.fg = m_theme.reverse_cursor_color;
+			style.fg = m_theme.reverse_cursor_color;
 			return fontColor(m_theme.cursor_color);
 		} else {
-			glyph.fg = m_theme.cursor_color;
+			style.fg = m_theme.cursor_color;
 			return fontColor(m_theme.reverse_cursor_color);
 		}
 	} else {
 		if (is_selected) {
-			glyph.fg = m_theme.fg;
-			glyph.bg = m_theme.reverse_cursor_color;
+			style.fg = m_theme.fg;
+			style.bg = m_theme.reverse_cursor_color;
 		} else {
 			if (m_twin.getCursorStyle() == CursorStyle::REVERSE_BLOCK) {
-				glyph.setReverseColor();
+				style.setReverseColor();
 				return fontColor(m_theme.cursor_color);
 			} else {
-				glyph.fg = m_theme.bg;
-				glyph.bg = m_theme.cursor_color;
+				style.fg = m_theme.bg;
+				style.bg = m_theme.cursor_color;
 			}
 		}
 
-		return fontColor(glyph.bg);
+		return fontColor(style.bg);
 	}
 }
 
@@ -162,13 +162,13 @@ public: // functions
 
 	void init();
 
-	/// Adjust the current fb/bg color to the given Glyph's settings.
-	void configureFor(const Glyph base);
+	/// Adjust the current fb/bg color to the given GlyphStyle's settings.
+	void configureFor(const GlyphStyle &base);
 
 	const FontColor& frontColor() { return m_front_color; }
 	const FontColor& backColor() { return m_back_color; }
-	/// Applies cursor color settings to `glyph` and returns the FontColor to be used.
-	const FontColor& applyCursorColor(const bool is_selected, Glyph &glyph) const;
+	/// Applies cursor color settings to `style` and returns the FontColor to be used.
+	const FontColor& applyCursorColor(const bool is_selected, GlyphStyle &style) const;
 
 protected: // functions
 
@@ -1,4 +1,5 @@
 // C++
+#include <algorithm>
 #include <iostream>
 
 // cosmos
@@ -255,6 +256,8 @@ void FontManager::clearCache() {
 }
 
 void FontManager::unloadFonts() {
+	// Shaping data refers to the loaded fonts.
+	m_shaper.clear();
 	// Free the loaded fonts in the font cache.
 	clearCache();
 
@@ -409,15 +412,15 @@ std::tuple<XftFont*, FT_UInt> FontManager::lookupFontEntry(const Rune rune, Font
 	return std::make_tuple(new_font, glyphidx);
 }
 
-void FontManager::sanitize(Glyph &g) const {
+void FontManager::sanitize(GlyphStyle &style) const {
 	// Fallback on color display for attributes not supported by the font
-	if (g.mode[Attr::ITALIC] && g.mode[Attr::BOLD]) {
+	if (style.mode[Attr::ITALIC] && style.mode[Attr::BOLD]) {
 		if (m_italic_bold_font.hasBadSlant() || m_italic_bold_font.hasBadWeight()) {
-			g.fg = config::DEFAULT_ATTR;
+			style.fg = config::DEFAULT_ATTR;
 		}
-	} else if ((g.mode[Attr::ITALIC] && m_italic_font.hasBadSlant()) ||
-			(g.mode[Attr::BOLD] && m_bold_font.hasBadWeight())) {
-		g.fg = config::DEFAULT_ATTR;
+	} else if ((style.mode[Attr::ITALIC] && m_italic_font.hasBadSlant()) ||
+			(style.mode[Attr::BOLD] && m_bold_font.hasBadWeight())) {
+		style.fg = config::DEFAULT_ATTR;
 	}
 }
 
@@ -429,10 +432,14 @@ void FontDrawContext::destroy() {
 }
 
 void FontDrawContext::setup(xpp::XDisplay &disp, xpp::Pixmap &pixmap) {
+	setup(disp, xpp::raw_pixmap(pixmap));
+}
+
+void FontDrawContext::setup(xpp::XDisplay &disp, const Drawable drawable) {
 	if (m_ctx) {
-		::XftDrawChange(m_ctx, xpp::raw_pixmap(pixmap));
+		::XftDrawChange(m_ctx, drawable);
 	} else {
-		m_ctx = ::XftDrawCreate(disp, xpp::raw_pixmap(pixmap), xpp::visual, xpp::raw_cmap(xpp::colormap));
+		m_ctx = ::XftDrawCreate(disp, drawable, xpp::visual, xpp::raw_cmap(xpp::colormap));
 	}
 }
 
@@ -440,14 +447,61 @@ void FontDrawContext::drawRect(const FontColor &color, const DrawPos start, cons
 	::XftDrawRect(m_ctx, &color, start.x, start.y, ext.width, ext.height);
 }
 
-void FontDrawContext::drawSpecs(
-		const FontColor &color, GlyphFontSpecVector::iterator start, GlyphFontSpecVector::iterator end) {
-	::XftDrawGlyphFontSpec(m_ctx, &color, &(*start), end - start);
+void FontDrawContext::fillRects(const XftColor &color, const std::vector<XRectangle> &rects) {
+	if (rects.empty())
+		return;
+
+	if (auto picture = ::XftDrawPicture(m_ctx); picture != 0) {
+		::XRenderFillRectangles(
+				::XftDrawDisplay(m_ctx), PictOpSrc, picture, &color.color,
+				rects.data(), static_cast<int>(rects.size()));
+	} else {
+		// core X drawing fallback, Xft handles this internally
+		for (const auto &rect: rects) {
+			::XftDrawRect(m_ctx, &color, rect.x, rect.y, rect.width, rect.height);
+		}
+	}
 }
 
-void FontDrawContext::setClipRectangle(const DrawPos pos, const Extent ext) {
-	XRectangle r{0, 0, static_cast<unsigned short>(ext.width), static_cast<unsigned short>(ext.height)};
-	::XftDrawSetClipRectangles(m_ctx, pos.x, pos.y, &r, /*n_rects=*/1);
+void FontDrawContext::drawSpecs(const XftColor &color, const GlyphFontSpecVector &specs) {
+	if (specs.empty())
+		return;
+
+	::XftDrawGlyphFontSpec(m_ctx, &color, specs.data(), static_cast<int>(specs.size()));
+}
+
+void FontDrawContext::setClipRectangles(const std::vector<XRectangle> &rects) {
+	::XftDrawSetClipRectangles(m_ctx, 0, 0, rects.data(), static_cast<int>(rects.size()));
+}
+
+bool FontDrawContext::copyAreas(FontDrawContext &src, const std::vector<XRectangle> &rects) {
+	const auto src_pict = ::XftDrawPicture(src.m_ctx);
+	const auto dst_pict = ::XftDrawPicture(m_ctx);
+
+	if (!src_pict || !dst_pict)
+		return false;
+	else if (rects.empty())
+		return true;
+
+	// determine the bounding box of all areas, the clip region takes care
+	// of not touching anything in between.
+	int x1 = rects.front().x, y1 = rects.front().y;
+	int x2 = x1, y2 = y1;
+
+	for (const auto &rect: rects) {
+		x1 = std::min(x1, static_cast<int>(rect.x));
+		y1 = std::min(y1, static_cast<int>(rect.y));
+		x2 = std::max(x2, rect.x + rect.width);
+		y2 = std::max(y2, rect.y + rect.height);
+	}
+
+	setClipRectangles(rects);
+	::XRenderComposite(
+			::XftDrawDisplay(m_ctx), PictOpSrc, src_pict, None, dst_pict,
+			x1, y1, 0, 0, x1, y1, x2 - x1, y2 - y1);
+	resetClip();
+
+	return true;
 }
 
 void FontDrawContext::resetClip() {
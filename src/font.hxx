@@ -17,6 +17,7 @@
 // nst
 #include "fwd.hxx"
 #include "Glyph.hxx"
+#include "Shaper.hxx"
 
 /**
  * @file
@@ -190,14 +191,17 @@ public: // functions
 	void resetZoom();
 	/// Returns the proper font to be used for the given Glyph mode.
 	Font* fontForMode(const Glyph::AttrBitMask mode);
-	/// Drops Glyph attributes in case no proper font is available for them.
-	void sanitize(Glyph &g) const;
+	/// Drops GlyphStyle attributes in case no proper font is available for them.
+	void sanitize(GlyphStyle &style) const;
 
 	void assignFont(const Rune rune, Font &font, GlyphFontSpec &spec);
 
 	auto& normalFont() { return m_normal_font; }
 	auto ascent() { return normalFont().ascent(); }
 
+	/// Returns the text Shaper operating on the currently loaded fonts.
+	auto& shaper() { return m_shaper; }
+
 protected: // types
 
 	/// Structure used for caching font lookups.
@@ -223,6 +227,7 @@ protected: // data
 	std::optional<double> m_used_font_size; ///< may differ from default size due to zooming
 	std::optional<double> m_default_font_size;
 	std::vector<FontCache> m_font_cache;
+	Shaper m_shaper; ///< caches data related to the loaded fonts
 };
 
 /// Context used for drawing rects using font colors.
@@ -239,13 +244,28 @@ public: // functions
 
 	void setup(xpp::XDisplay &disp, xpp::Pixmap &pixmap);
 
+	/// Setup the context for an arbitrary drawable like the terminal window.
+	void setup(xpp::XDisplay &disp, const Drawable drawable);
+
 	/// Draw a rectangular font area using a starting point and extent.
 	void drawRect(const FontColor &color, const DrawPos start, const Extent ext);
 
-	/// Draw a range of GlyphFontSpec entries from a vector.
-	void drawSpecs(const FontColor &color, GlyphFontSpecVector::iterator start, GlyphFontSpecVector::iterator end);
+	/// Fill a list of rectangles in the given color using a single request.
+	void fillRects(const XftColor &color, const std::vector<XRectangle> &rects);
+
+	/// Draw a list of GlyphFontSpec entries in the given color.
+	void drawSpecs(const XftColor &color, const GlyphFontSpecVector &specs);
 
-	void setClipRectangle(const DrawPos pos, const Extent ext);
+	/// Restrict drawing to the union of the given rectangles.
+	void setClipRectangles(const std::vector<XRectangle> &rects);
+
+	/// Copy the given rectangles from `src` into the drawable of this context.
+	/**
+	 * The copy is performed using a single XRender composite request that
+	 * is clipped to `rects`. If XRender pictures are not available for
+	 * either context then nothing is copied and `false` is returned.
+	 **/
+	bool copyAreas(FontDrawContext &src, const std::vector<XRectangle> &rects);
 
 	void resetClip();
 
@@ -1,8 +1,24 @@
 // C++
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <clocale>
+#include <cstdint>
+#include <cstring>
+#include <cuchar>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <optional>
 #include <set>
 #include <sstream>
+#include <stdexcept>
+
+// Linux
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // TCLAP
 #include "tclap/CmdLine.h"
@@ -11,12 +27,15 @@
 #include "cosmos/cosmos.hxx"
 #include "cosmos/error/ApiError.hxx"
 #include "cosmos/error/FileError.hxx"
+#include "cosmos/io/Poller.hxx"
 #include "cosmos/main.hxx"
 #include "cosmos/net/UnixClientSocket.hxx"
 #include "cosmos/proc/process.hxx"
+#include "cosmos/utils.hxx"
 
 // nst
 #include "IpcHandler.hxx"
+#include "ScreenShare.hxx"
 
 namespace nst {
 
@@ -35,7 +54,22 @@ public: // data
 	TCLAP::SwitchArg get_global_history;
 	TCLAP::SwitchArg test_connection;
 	TCLAP::SwitchArg get_cwds;
+	TCLAP::SwitchArg get_history_usage;
 	TCLAP::ValueArg<std::string> set_theme;
+	TCLAP::ValueArg<uint64_t> get_tail;
+	TCLAP::ValueArg<std::string> get_range;
+	TCLAP::ValueArg<uint64_t> get_since;
+	TCLAP::SwitchArg follow;
+	TCLAP::SwitchArg get_screen;
+	TCLAP::ValueArg<std::string> search;
+	TCLAP::SwitchArg ignore_case;
+	TCLAP::SwitchArg fixed_strings;
+	TCLAP::ValueArg<uint32_t> max_count;
+	TCLAP::ValueArg<std::string> send_input;
+	TCLAP::SwitchArg paste;
+	TCLAP::SwitchArg wait_consumed;
+	TCLAP::ValueArg<unsigned> timeout;
+	TCLAP::SwitchArg interleave;
 	TCLAP::ValueArg<std::string> instance;
 
 protected: // data
@@ -51,7 +85,22 @@ Cmdline::Cmdline() :
 		get_global_history{"D", "get-global-history", "print (dump) the current history of all available NST terminals to stdout"},
 		test_connection   {"t", "test", "only test the connection to the nst terminal, returns zero on success, non-zero otherwise"},
 		get_cwds          {"",  "cwds", "retrieve the current working directories of all available NST terminals one per line to stdout"},
+		get_history_usage {"",  "history-usage", "print statistics about the memory used for the scrollback history to stdout"},
 		set_theme         {"",  "theme", "change the active theme", false, "", "theme name"},
+		get_tail          {"",  "tail", "print the last N lines of the current history data to stdout", false, 0, "N"},
+		get_range         {"",  "range", "print the lines with sequence numbers in the range [A, B) to stdout", false, "", "A:B"},
+		get_since         {"",  "since", "print the lines starting at sequence number X to stdout, the sequence number for the next query is printed to stderr", false, 0, "X"},
+		follow            {"f", "follow", "print new lines to stdout as they are output by the terminal, until the terminal exits"},
+		get_screen        {"",  "screen", "print the currently visible screen contents to stdout, read via the shared memory view of the screen"},
+		search            {"",  "search", "search the current history for a regular expression, prints SEQ:COLUMN:LINE for each match to stdout", false, "", "pattern"},
+		ignore_case       {"i", "ignore-case", "for --search: match case insensitively", *this},
+		fixed_strings     {"F", "fixed-strings", "for --search: interpret the pattern as a literal string", *this},
+		max_count         {"m", "max-count", "for --search: stop after N matches, 0 for no limit", false, 1000, "N", *this},
+		send_input        {"",  "send", "write DATA to the terminal's child process as if it was typed, '-' reads the data from stdin", false, "", "DATA"},
+		paste             {"",  "paste", "for --send: wrap the data in bracketed paste markers, if the application enabled bracketed paste mode", *this},
+		wait_consumed     {"w", "wait", "for --send: only return once the child process read the data", *this},
+		timeout           {"",  "timeout", "for -D and --cwds: give up on an instance that didn't send anything for this many milliseconds, 0 to wait indefinitely", false, 5000, "ms", *this},
+		interleave        {"",  "interleave", "for -D: print complete lines of all instances as they arrive, instead of the history of one instance after the other", *this},
 		instance          {"p", "pid", "target the NST instance running at the given PID, ignores the NST_IPC_ADDR environment variable", false, "", "process ID", *this} {
 	m_xor_group.add(save_snapshot);
 	m_xor_group.add(get_snapshot);
@@ -59,7 +108,15 @@ Cmdline::Cmdline() :
 	m_xor_group.add(get_global_history);
 	m_xor_group.add(test_connection);
 	m_xor_group.add(get_cwds);
+	m_xor_group.add(get_history_usage);
 	m_xor_group.add(set_theme);
+	m_xor_group.add(get_tail);
+	m_xor_group.add(get_range);
+	m_xor_group.add(get_since);
+	m_xor_group.add(follow);
+	m_xor_group.add(get_screen);
+	m_xor_group.add(search);
+	m_xor_group.add(send_input);
 	this->add(m_xor_group);
 }
 
@@ -73,6 +130,30 @@ class IpcClient :
 protected: // types
 
 	using Message = IpcHandler::Message;
+	using Clock = std::chrono::steady_clock;
+
+	/// The progress of a request against one of the instances addressed by doGlobalRequest().
+	enum class InstanceState {
+		CONNECTING, ///< the instance's listen backlog is full, connecting needs to be retried
+		RECEIVING, ///< the request has been sent, the reply is being received
+		DONE ///< the reply has been received completely, or the request failed
+	};
+
+	/// Per-instance state of a global request.
+	struct Instance {
+		explicit Instance(const std::string &_addr) :
+			addr{_addr},
+			socket{cosmos::SocketFlags{cosmos::SocketFlag::CLOEXEC, cosmos::SocketFlag::NONBLOCK}} {}
+
+		std::string addr;
+		cosmos::UnixSeqPacketClientSocket socket; ///< used for connecting, connect attempts may need to be repeated
+		std::optional<cosmos::UnixConnection> connection; ///< non-blocking connection to the instance, once established
+		InstanceState state = InstanceState::CONNECTING;
+		bool paused = false; ///< the connection isn't monitored since too much output is buffered
+		std::optional<cosmos::ExitStatus> status; ///< the request status, once received
+		std::string output; ///< received data that hasn't been written out yet
+		Clock::time_point deadline; ///< when to give up on the instance
+	};
 
 protected: // functions
 
@@ -81,16 +162,65 @@ protected: // functions
 	/// Perform a request against the NST instances found in the environment.
 	void doSingleInstanceRequest();
 
-	/// Perform a request against the given specific NST instance.
-	void doInstanceRequest(const std::string_view addr);
-
-	void doInstanceRequest(cosmos::UnixConnection &connection);
+	/// Perform a request against all NST instances found on the system in parallel.
+	/**
+	 * All instances are connected to in non-blocking mode and their
+	 * replies are received multiplexed via a cosmos::Poller, so the total
+	 * time approaches that of the slowest instance. Instances that don't
+	 * reply within the configured timeout are given up on.
+	 *
+	 * When the output is written one instance after the other then
+	 * instances that have to wait for their turn are only received from
+	 * until MAX_BUFFERED bytes are buffered.
+	 **/
+	void doGlobalRequest();
+
+	/// Attempts to connect to `instance` and to send the request.
+	/**
+	 * If the instance can't accept the connection right now then the
+	 * instance stays in CONNECTING state.
+	 **/
+	void connectInstance(Instance &instance, const Message request, cosmos::Poller &poller);
+
+	/// Receives data available from `instance` until at least `limit` bytes of output are buffered.
+	void receiveFromInstance(Instance &instance, const size_t limit);
+
+	/// Marks `instance` as done and processes its remaining output.
+	void finishInstance(Instance &instance, const Message request);
+
+	/// Writes the output of instances received so far to stdout.
+	void writeGlobalOutput(std::list<Instance> &instances);
 
 	cosmos::UnixConnection connectSingleInstance();
 
 	/// Receives the request status result (initial reply data)..
 	cosmos::ExitStatus receiveStatus(cosmos::UnixConnection &connection);
 
+	/// Sends the parameters for ranged history requests.
+	void sendRangeParameters(const Message request, cosmos::UnixConnection &connection);
+
+	/// Sends the parameters for the SEARCH request.
+	void sendSearchParameters(cosmos::UnixConnection &connection);
+
+	/// Sends the parameters and data for the SEND_INPUT request.
+	/**
+	 * nst stops receiving while it still has too much data pending, thus
+	 * this blocks until nst caught up.
+	 **/
+	void sendInput(cosmos::UnixConnection &connection);
+
+	/// Receives the SeqRange that precedes the data of ranged history requests.
+	IpcHandler::SeqRange receiveSeqRange(cosmos::UnixConnection &connection);
+
+	/// Receives the continuous data stream of a SUBSCRIBE_OUTPUT request.
+	void followOutput(cosmos::UnixConnection &connection);
+
+	/// Receives the status of a GET_SCREEN_SHARE request along with the passed file descriptor.
+	cosmos::ExitStatus receiveStatusWithFD(cosmos::UnixConnection &connection, int &fd);
+
+	/// Prints the screen contents found in the ScreenShare memory referred to by `fd`.
+	void printScreen(const int fd);
+
 	/// Receives data after a request has been dispatched.
 	void receiveData(const Message request, cosmos::UnixConnection &connection, std::ostream &out = std::cout);
 
@@ -112,15 +242,16 @@ protected: // data
 	static constexpr cosmos::ExitStatus CONN_ERR{2};
 	static constexpr cosmos::ExitStatus RPC_ERR{3};
 	static constexpr cosmos::ExitStatus INT_ERR{5};
+
+	/// Maximum number of bytes buffered for an instance waiting for its turn in doGlobalRequest().
+	static constexpr size_t MAX_BUFFERED = 1024 * 1024 * 4;
 };
 
 cosmos::ExitStatus IpcClient::main(const int argc, const char **argv) {
 	m_cmdline.parse(argc, argv);
 
 	if (m_cmdline.get_global_history.isSet() || m_cmdline.get_cwds.isSet()) {
-		for (const auto &addr: gatherGlobalInstances()) {
-			doInstanceRequest(addr);
-		}
+		doGlobalRequest();
 
 		if (m_cmdline.get_cwds.isSet()) {
 			for (const auto &cwd: m_cwds) {
@@ -147,6 +278,22 @@ void IpcClient::doSingleInstanceRequest() {
 			return Message::PING;
 		else if (m_cmdline.set_theme.isSet())
 			return Message::SET_THEME;
+		else if (m_cmdline.get_history_usage.isSet())
+			return Message::GET_HISTORY_USAGE;
+		else if (m_cmdline.get_tail.isSet())
+			return Message::GET_HISTORY_TAIL;
+		else if (m_cmdline.get_range.isSet())
+			return Message::GET_HISTORY_RANGE;
+		else if (m_cmdline.get_since.isSet())
+			return Message::GET_HISTORY_SINCE;
+		else if (m_cmdline.follow.isSet())
+			return Message::SUBSCRIBE_OUTPUT;
+		else if (m_cmdline.get_screen.isSet())
+			return Message::GET_SCREEN_SHARE;
+		else if (m_cmdline.search.isSet())
+			return Message::SEARCH;
+		else if (m_cmdline.send_input.isSet())
+			return Message::SEND_INPUT;
 		else {
 			throw INT_ERR;
 		}
@@ -155,18 +302,190 @@ void IpcClient::doSingleInstanceRequest() {
 	auto connection = connectSingleInstance();
 	connection.send(&request, sizeof(request));
 
+	const bool ranged = cosmos::in_list(request,
+			{Message::GET_HISTORY_TAIL, Message::GET_HISTORY_RANGE, Message::GET_HISTORY_SINCE});
+
 	if (request == Message::SET_THEME) {
 		const auto &theme = m_cmdline.set_theme.getValue();
 		connection.send(theme.c_str(), theme.size() + 1);
+	} else if (ranged || request == Message::SUBSCRIBE_OUTPUT) {
+		sendRangeParameters(request, connection);
+	} else if (request == Message::SEARCH) {
+		sendSearchParameters(connection);
+	} else if (request == Message::SEND_INPUT) {
+		sendInput(connection);
+	} else if (request == Message::GET_SCREEN_SHARE) {
+		int fd = -1;
+
+		if (receiveStatusWithFD(connection, fd) != cosmos::ExitStatus::SUCCESS || fd == -1) {
+			m_status = RPC_ERR;
+			receiveData(request, connection, std::cerr);
+		} else {
+			printScreen(fd);
+		}
+
+		if (fd != -1) {
+			::close(fd);
+		}
+		return;
 	}
 
 	if (receiveStatus(connection) != cosmos::ExitStatus::SUCCESS) {
 		m_status = RPC_ERR;
+	} else if (request == Message::SUBSCRIBE_OUTPUT) {
+		followOutput(connection);
+		return;
+	} else if (ranged) {
+		const auto range = receiveSeqRange(connection);
+		receiveData(request, connection, std::cout);
+
+		if (request == Message::GET_HISTORY_SINCE) {
+			// print the high-water mark for the next query
+			std::cout.flush();
+			std::cerr << range.end << "\n";
+		}
+		return;
 	}
 
 	receiveData(request, connection, m_status == cosmos::ExitStatus::SUCCESS ? std::cout : std::cerr);
 }
 
+void IpcClient::sendRangeParameters(const Message request, cosmos::UnixConnection &connection) {
+	IpcHandler::SeqRange param;
+
+	switch (request) {
+		case Message::GET_HISTORY_TAIL:
+			param.begin = m_cmdline.get_tail.getValue();
+			break;
+		case Message::GET_HISTORY_SINCE:
+			param.begin = m_cmdline.get_since.getValue();
+			break;
+		case Message::SUBSCRIBE_OUTPUT:
+			param.begin = IpcHandler::FOLLOW_NEW_OUTPUT;
+			break;
+		case Message::GET_HISTORY_RANGE:
+		default: {
+			const auto &range = m_cmdline.get_range.getValue();
+			const auto sep = range.find(':');
+
+			try {
+				if (sep == range.npos)
+					throw std::invalid_argument{range};
+				param.begin = std::stoull(range.substr(0, sep));
+				param.end = std::stoull(range.substr(sep + 1));
+			} catch (const std::logic_error &) {
+				std::cerr << "invalid range '" << range << "', expected A:B\n";
+				throw INT_ERR;
+			}
+
+			connection.send(&param, sizeof(param));
+			return;
+		}
+	}
+
+	connection.send(&param.begin, sizeof(param.begin));
+}
+
+void IpcClient::sendSearchParameters(cosmos::UnixConnection &connection) {
+	using SearchParams = IpcHandler::SearchParams;
+	const auto &pattern = m_cmdline.search.getValue();
+
+	if (pattern.empty() || pattern.size() > IpcHandler::MAX_SEARCH_PATTERN) {
+		std::cerr << "invalid search pattern length\n";
+		throw INT_ERR;
+	}
+
+	SearchParams params;
+	params.limit = m_cmdline.max_count.getValue();
+
+	if (m_cmdline.ignore_case.isSet())
+		params.flags |= SearchParams::IGNORE_CASE;
+	if (m_cmdline.fixed_strings.isSet())
+		params.flags |= SearchParams::FIXED_STRING;
+
+	std::string data;
+	data.resize(sizeof(params));
+	std::memcpy(data.data(), &params, sizeof(params));
+	data.append(pattern);
+
+	connection.send(data.data(), data.size());
+}
+
+void IpcClient::sendInput(cosmos::UnixConnection &connection) {
+	using SendInputParams = IpcHandler::SendInputParams;
+	std::string data = m_cmdline.send_input.getValue();
+
+	if (data == "-") {
+		// the size needs to be known upfront, so read everything
+		std::ostringstream ss;
+		ss << std::cin.rdbuf();
+		data = ss.str();
+	}
+
+	SendInputParams params;
+	params.size = data.size();
+
+	if (m_cmdline.paste.isSet())
+		params.flags |= SendInputParams::BRACKETED_PASTE;
+	if (m_cmdline.wait_consumed.isSet())
+		params.flags |= SendInputParams::WAIT_CONSUMED;
+
+	connection.send(&params, sizeof(params));
+
+	for (size_t pos = 0; pos < data.size(); pos += IpcHandler::MAX_CHUNK_SIZE) {
+		const auto len = std::min(data.size() - pos, IpcHandler::MAX_CHUNK_SIZE);
+		connection.send(data.data() + pos, len);
+	}
+}
+
+IpcHandler::SeqRange IpcClient::receiveSeqRange(cosmos::UnixConnection &connection) {
+	IpcHandler::SeqRange range;
+
+	const auto len = connection.receive(&range, sizeof(range), cosmos::MessageFlags{cosmos::MessageFlag::TRUNCATE});
+
+	if (len != sizeof(range)) {
+		std::cerr << "received bad sequence range message length\n";
+		throw INT_ERR;
+	}
+
+	return range;
+}
+
+void IpcClient::followOutput(cosmos::UnixConnection &connection) {
+	std::string buffer;
+	std::optional<uint64_t> next_seq;
+	IpcHandler::SeqRange range;
+
+	while (true) {
+		buffer.resize(IpcHandler::MAX_CHUNK_SIZE);
+		const auto len = connection.receive(buffer.data(), buffer.size(), cosmos::MessageFlags{cosmos::MessageFlag::TRUNCATE});
+
+		if (len == 0) {
+			// the terminal exited
+			return;
+		} else if (len < sizeof(range) || len > buffer.size()) {
+			std::cerr << "received bad output packet length\n";
+			throw INT_ERR;
+		}
+
+		std::memcpy(&range, buffer.data(), sizeof(range));
+
+		if (next_seq && range.begin > *next_seq) {
+			std::cout.flush();
+			std::cerr << "nst-msg: " << (range.begin - *next_seq) << " lines dropped\n";
+		} else if (next_seq && range.begin < *next_seq) {
+			// should not happen, sequence numbers only increase. don't
+			// let this turn into a bogus number of dropped lines.
+			std::cout.flush();
+			std::cerr << "nst-msg: " << (*next_seq - range.begin) << " lines repeated\n";
+		}
+
+		std::cout.write(buffer.data() + sizeof(range), len - sizeof(range));
+		std::cout.flush();
+		next_seq = next_seq ? std::max(*next_seq, range.end) : range.end;
+	}
+}
+
 std::string_view IpcClient::activeInstanceAddr() const {
 	constexpr auto envvar = "NST_IPC_ADDR";
 
@@ -240,74 +559,251 @@ std::set<std::string> IpcClient::gatherGlobalInstances() const {
 	return ret;
 }
 
-void IpcClient::doInstanceRequest(const std::string_view addr) {
-	std::optional<cosmos::UnixConnection> conn;
+void IpcClient::doGlobalRequest() {
+	const auto request = m_cmdline.get_cwds.isSet() ? Message::GET_CWD : Message::GET_HISTORY;
+	const auto timeout = std::chrono::milliseconds{m_cmdline.timeout.getValue()};
+	// interval for retrying connections to instances with a full backlog
+	constexpr auto RETRY_INTERVAL = std::chrono::milliseconds{10};
+	// whether output is written as it arrives, see writeGlobalOutput()
+	const bool unordered = m_cmdline.interleave.isSet() || request == Message::GET_CWD;
+
+	cosmos::Poller poller;
+	poller.create();
+
+	// the order of the set determines the order of the output
+	std::list<Instance> instances;
+
+	for (const auto &addr: gatherGlobalInstances()) {
+		auto &instance = instances.emplace_back(addr);
+		instance.deadline = Clock::now() + timeout;
+		connectInstance(instance, request, poller);
+	}
+
+	auto pending = [&instances]() {
+		return std::count_if(instances.begin(), instances.end(), [](const Instance &instance) {
+			return instance.state != InstanceState::DONE;
+		});
+	};
 
+	while (pending() != 0) {
+		std::optional<Clock::duration> wait_time;
+
+		for (const auto &instance: instances) {
+			if (instance.state == InstanceState::CONNECTING) {
+				wait_time = std::min(wait_time.value_or(RETRY_INTERVAL), Clock::duration{RETRY_INTERVAL});
+			}
+			if (instance.state != InstanceState::DONE && !instance.paused && timeout.count() != 0) {
+				const auto left = std::max(instance.deadline - Clock::now(), Clock::duration{0});
+				wait_time = std::min(wait_time.value_or(left), left);
+			}
+		}
+
+		std::optional<cosmos::IntervalTime> wait_timeout;
+
+		if (wait_time) {
+			wait_timeout = cosmos::IntervalTime{std::chrono::ceil<std::chrono::milliseconds>(*wait_time)};
+		}
+
+		// the instance whose output is currently written out
+		const auto head = std::find_if(instances.begin(), instances.end(), [](const Instance &instance) {
+			return instance.state != InstanceState::DONE;
+		});
+
+		for (const auto &event: poller.wait(wait_timeout)) {
+			auto it = std::find_if(instances.begin(), instances.end(), [&event](const Instance &instance) {
+				return instance.connection && instance.connection->fd() == event.fd();
+			});
+
+			if (it == instances.end() || it->state != InstanceState::RECEIVING || it->paused)
+				continue;
+
+			auto &instance = *it;
+			const auto limit = unordered || it == head ? SIZE_MAX : MAX_BUFFERED;
+			receiveFromInstance(instance, limit);
+
+			if (instance.state == InstanceState::RECEIVING && instance.output.size() >= limit) {
+				// continue once it's the instance's turn
+				poller.delFD(instance.connection->fd());
+				instance.paused = true;
+			}
+		}
+
+		const auto now = Clock::now();
+
+		for (auto &instance: instances) {
+			if (instance.state == InstanceState::CONNECTING) {
+				connectInstance(instance, request, poller);
+			}
+
+			if (instance.state != InstanceState::DONE && !instance.paused &&
+					timeout.count() != 0 && now >= instance.deadline) {
+				std::cout.flush();
+				std::cerr << "timeout talking to " << instance.addr << "\n";
+				m_status = CONN_ERR;
+				instance.state = InstanceState::DONE;
+			}
+
+			if (instance.state == InstanceState::DONE && instance.connection) {
+				finishInstance(instance, request);
+			}
+		}
+
+		writeGlobalOutput(instances);
+
+		for (auto &instance: instances) {
+			// only the head instance's output is written out, so it
+			// is the one to resume
+			if (instance.paused && instance.output.empty()) {
+				poller.addFD(instance.connection->fd(), {cosmos::Poller::MonitorFlag::INPUT});
+				instance.paused = false;
+				instance.deadline = Clock::now() + timeout;
+			}
+		}
+	}
+}
+
+void IpcClient::connectInstance(Instance &instance, const Message request, cosmos::Poller &poller) {
 	try {
-		cosmos::UnixSeqPacketClientSocket sock;
-		conn = sock.connect(cosmos::UnixAddress{addr, cosmos::UnixAddress::Abstract{true}});
+		instance.connection = instance.socket.connect(cosmos::UnixAddress{instance.addr, cosmos::UnixAddress::Abstract{true}});
 	} catch (const cosmos::ApiError &error) {
-
-		// ignore errors that are to be expected:
-		// - the socket belongs to another user and we lack access
-		// - the socket disappeared meanwhile
 		switch (error.errnum()) {
+			case cosmos::Errno::AGAIN:
+				// the listen backlog is full, try again later
+				return;
+			// ignore errors that are to be expected:
+			// - the socket belongs to another user and we lack access
+			// - the socket disappeared meanwhile
 			case cosmos::Errno::PERMISSION:
 			case cosmos::Errno::ACCESS:
 			case cosmos::Errno::CONN_REFUSED:
-				return;
+				break;
 			default:
-				std::cerr << "failed to connect to " << addr << ": " << error.what() << "\n";
-				return;
+				std::cerr << "failed to connect to " << instance.addr << ": " << error.what() << "\n";
+				break;
 		}
+
+		instance.state = InstanceState::DONE;
+		return;
 	}
 
 	try {
-		return doInstanceRequest(*conn);
+		// a single small packet always fits into the fresh socket buffer
+		instance.connection->send(&request, sizeof(request), cosmos::MessageFlags{cosmos::MessageFlag::NO_SIGNAL});
 	} catch (const cosmos::ApiError &error) {
-		std::cerr << "error talking to " << addr << ": " << error.what() << "\n";
+		std::cerr << "error talking to " << instance.addr << ": " << error.what() << "\n";
+		instance.state = InstanceState::DONE;
+		return;
 	}
+
+	poller.addFD(instance.connection->fd(), {cosmos::Poller::MonitorFlag::INPUT});
+	instance.state = InstanceState::RECEIVING;
 }
 
-void IpcClient::doInstanceRequest(cosmos::UnixConnection &connection) {
-	const auto request = [this]() -> Message {
-		if (m_cmdline.get_global_history.isSet())
-			return Message::GET_HISTORY;
-		else if (m_cmdline.get_cwds.isSet())
-			return Message::GET_CWD;
-		else {
-			throw INT_ERR;
+void IpcClient::receiveFromInstance(Instance &instance, const size_t limit) {
+	std::string buffer;
+
+	while (instance.output.size() < limit) {
+		buffer.resize(IpcHandler::MAX_CHUNK_SIZE);
+		size_t len = 0;
+
+		try {
+			len = instance.connection->receive(buffer.data(), buffer.size(), cosmos::MessageFlags{cosmos::MessageFlag::TRUNCATE});
+		} catch (const cosmos::ApiError &error) {
+			if (error.errnum() == cosmos::Errno::AGAIN) {
+				// everything available has been received
+				return;
+			} else if (error.errnum() != cosmos::Errno::CONN_RESET) {
+				// CONN_RESET means the socket belongs to a
+				// different user and the other nst rejected
+				// access - ignore.
+				std::cerr << "error talking to " << instance.addr << ": " << error.what() << "\n";
+			}
+
+			instance.state = InstanceState::DONE;
+			return;
 		}
-	}();
 
-	connection.send(&request, sizeof(request));
+		if (len == 0) {
+			instance.state = InstanceState::DONE;
+			return;
+		} else if (len > buffer.size()) {
+			std::cerr << "IPC packet from " << instance.addr << " was truncated from " << len << " to " << buffer.size() << "!\n";
+			len = buffer.size();
+		}
 
-	if (receiveStatus(connection) != cosmos::ExitStatus::SUCCESS) {
-		m_status = RPC_ERR;
-		// an error message might follow
-		receiveData(request, connection, std::cerr);
+		// any data counts as progress
+		instance.deadline = Clock::now() + std::chrono::milliseconds{m_cmdline.timeout.getValue()};
+
+		if (!instance.status) {
+			if (len != sizeof(cosmos::ExitStatus)) {
+				std::cerr << "received bad status code message length from " << instance.addr << "\n";
+				instance.state = InstanceState::DONE;
+				return;
+			}
+
+			instance.status = cosmos::ExitStatus{};
+			std::memcpy(&*instance.status, buffer.data(), sizeof(cosmos::ExitStatus));
+
+			if (*instance.status != cosmos::ExitStatus::SUCCESS) {
+				m_status = RPC_ERR;
+			}
+			continue;
+		}
+
+		instance.output.append(buffer.data(), len);
+	}
+}
+
+void IpcClient::finishInstance(Instance &instance, const Message request) {
+	// closing also removes the connection from the poller
+	instance.connection->close();
+	instance.connection.reset();
+
+	if (instance.status && *instance.status != cosmos::ExitStatus::SUCCESS) {
+		// an error message might have been sent
+		std::cout.flush();
+		std::cerr << instance.output;
+		instance.output.clear();
+	} else if (request == Message::GET_CWD) {
+		if (!instance.output.empty()) {
+			m_cwds.insert(instance.output);
+		}
+		instance.output.clear();
+	}
+}
+
+void IpcClient::writeGlobalOutput(std::list<Instance> &instances) {
+	if (m_cmdline.get_cwds.isSet()) {
+		// collected in finishInstance()
 		return;
 	}
 
-	try {
-		if (request == Message::GET_CWD) {
-			std::stringstream ss;
-			receiveData(request, connection, ss);
-			auto cwd = ss.str();
-			if (!cwd.empty()) {
-				m_cwds.insert(ss.str());
+	if (m_cmdline.interleave.isSet()) {
+		for (auto &instance: instances) {
+			// only write complete lines to avoid mixing up lines
+			// of different instances
+			const auto end = instance.state == InstanceState::DONE ?
+				instance.output.size() : instance.output.rfind('\n') + 1;
+
+			// rfind() yields npos if there's no newline, thus `end` is zero
+			if (end != 0) {
+				std::cout.write(instance.output.data(), static_cast<std::streamsize>(end));
+				instance.output.erase(0, end);
 			}
-		} else {
-			receiveData(request, connection, std::cout);
 		}
-	} catch (const cosmos::ApiError &error) {
-		if (error.errnum() == cosmos::Errno::CONN_RESET)
-			// this means the socket belongs to a different user
-			// and the other nst rejected access - ignore.
-			return;
-
-		throw;
+	} else {
+		// write the output of the first unfinished instance as it
+		// arrives, the others need to wait for their turn
+		for (auto &instance: instances) {
+			std::cout << instance.output;
+			instance.output.clear();
+
+			if (instance.state != InstanceState::DONE)
+				break;
+		}
 	}
+
+	std::cout.flush();
 }
 
 cosmos::ExitStatus IpcClient::receiveStatus(cosmos::UnixConnection &connection) {
@@ -323,6 +819,108 @@ cosmos::ExitStatus IpcClient::receiveStatus(cosmos::UnixConnection &connection)
 	return status;
 }
 
+cosmos::ExitStatus IpcClient::receiveStatusWithFD(cosmos::UnixConnection &connection, int &fd) {
+	cosmos::ExitStatus status;
+	struct iovec iov{&status, sizeof(status)};
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control{};
+
+	struct msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	const auto len = ::recvmsg(cosmos::to_integral(connection.fd().raw()), &msg, MSG_CMSG_CLOEXEC);
+
+	if (len < 0) {
+		cosmos_throw (cosmos::ApiError("recvmsg()"));
+	}
+
+	if (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg &&
+			cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+		std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	if (len != sizeof(status)) {
+		std::cerr << "received bad status code message length\n";
+		throw INT_ERR;
+	}
+
+	return status;
+}
+
+void IpcClient::printScreen(const int fd) {
+	ScreenShare::Contents contents;
+
+	while (true) {
+		struct stat st;
+
+		if (::fstat(fd, &st) != 0) {
+			cosmos_throw (cosmos::ApiError("fstat()"));
+		}
+
+		const auto map_size = static_cast<size_t>(st.st_size);
+		const auto map = ::mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (map == MAP_FAILED) {
+			cosmos_throw (cosmos::ApiError("mmap()"));
+		}
+
+		const auto header = static_cast<const ScreenShare::Header*>(map);
+
+		if (map_size < sizeof(*header) || header->magic != ScreenShare::MAGIC || header->version != ScreenShare::VERSION) {
+			::munmap(map, map_size);
+			std::cerr << "unsupported screen share format\n";
+			throw INT_ERR;
+		}
+
+		const auto result = ScreenShare::read(map, map_size, contents);
+		::munmap(map, map_size);
+
+		if (result == ScreenShare::ReadResult::OK) {
+			break;
+		} else if (result == ScreenShare::ReadResult::TIMEOUT) {
+			std::cerr << "timed out waiting for a consistent screen state\n";
+			throw INT_ERR;
+		}
+
+		// the terminal grew meanwhile, map it again
+	}
+
+	std::setlocale(LC_CTYPE, "");
+	std::mbstate_t state{};
+	char encoded[MB_LEN_MAX];
+	std::string line;
+
+	for (size_t row = 0; row < contents.rows; row++) {
+		line.clear();
+
+		for (size_t col = 0; col < contents.cols; col++) {
+			const auto &cell = contents.cells[row * contents.cols + col];
+
+			if (cell.attrs & ScreenShare::ATTR_WDUMMY)
+				continue;
+
+			const char32_t rune = cell.rune ? cell.rune : U' ';
+
+			if (const auto len = std::c32rtomb(encoded, rune, &state); len != static_cast<size_t>(-1)) {
+				line.append(encoded, len);
+			} else {
+				// not representable in the current locale
+				line.push_back('?');
+				state = std::mbstate_t{};
+			}
+		}
+
+		line.erase(line.find_last_not_of(' ') + 1);
+		std::cout << line << "\n";
+	}
+}
+
 void IpcClient::receiveData(const Message request, cosmos::UnixConnection &connection, std::ostream &out) {
 	std::string buffer;
 
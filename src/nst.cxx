@@ -277,6 +277,8 @@ void Nst::mainLoop() {
 	}
 
 	std::unique_ptr<IpcHandler> ipc_handler;
+	// whether the TTY is monitored for writability, for IPC input injection
+	bool tty_writable = false;
 
 	if constexpr (config::ENABLE_IPC) {
 		ipc_handler.reset(new IpcHandler{*this, poller});
@@ -291,6 +293,7 @@ void Nst::mainLoop() {
 		auto events = poller.wait(timeout);
 
 		bool draw_event = false;
+		bool tty_output = false;
 		bool timedout = events.empty();
 
 		for (const auto &event: events) {
@@ -304,17 +307,51 @@ void Nst::mainLoop() {
 				}
 				return;
 			} else if (fd == ttyfd) {
+				using Event = cosmos::Poller::Event;
+				const auto tty_events = event.getEvents();
+
+				if ((tty_events & Event::HANGUP_OCCURED) || (tty_events & Event::ERROR_OCCURED)) {
+					// the input can't be delivered anymore,
+					// read() below detects the EOF
+					if (ipc_handler)
+						ipc_handler->dropInput();
+				} else if (tty_events & Event::OUTPUT_READY) {
+					// the echo of the input may change the screen
+					ipc_handler->writeInput();
+					draw_event = true;
+					tty_output = true;
+
+					if (!(tty_events & Event::INPUT_READY))
+						continue;
+				}
+
 				if (m_tty.read() == 0)
 					// EOF condition
 					return;
 				draw_event = true;
+				tty_output = true;
 			} else if (fd == display.connectionNumber()) {
 				// handled below
 			} else if (ipc_handler) {
-				draw_event = ipc_handler->checkEvent(event);
+				draw_event |= ipc_handler->checkEvent(event);
 			}
 		}
 
+		if (tty_output && ipc_handler) {
+			ipc_handler->publishOutput();
+		}
+
+		if (ipc_handler && ipc_handler->hasPendingInput() != tty_writable) {
+			// only monitor writability while there's input to inject,
+			// otherwise the poller would report it all the time
+			tty_writable = !tty_writable;
+
+			if (tty_writable)
+				poller.modFD(ttyfd, {cosmos::Poller::MonitorFlag::INPUT, cosmos::Poller::MonitorFlag::OUTPUT});
+			else
+				poller.modFD(ttyfd, {cosmos::Poller::MonitorFlag::INPUT});
+		}
+
 		draw_event |= m_event_handler.checkEvents();
 
 		// To reduce flicker and tearing, when new content or an event
@@ -384,7 +421,7 @@ void Nst::pipeBufferToExternalCommand() {
 	auto child = cloner.run();
 	pipe.closeReadEnd();
 
-	const auto text = m_term.screen().asText(m_term.cursor());
+	const auto text = m_term.screen().asText(m_term.cursor(), m_term.clusters());
 	cosmos::File io{pipe.writeEnd(), cosmos::AutoCloseFD{false}};
 
 	try {
@@ -156,6 +156,23 @@ constexpr unsigned int COLS = 80;
 constexpr unsigned int ROWS = 24;
 /// Number of lines kept in the scrollback buffer.
 constexpr size_t HISTORY_LEN = 10000;
+/// Size of the on-disk history archive in MiB.
+/**
+ * If non-zero then scrollback lines that drop out of the HISTORY_LEN
+ * ring buffer are moved into a compressed archive file instead of being
+ * discarded. The file is created in $XDG_RUNTIME_DIR without a name in
+ * the file system. Once the given size is exhausted the oldest archived
+ * lines are discarded.
+ **/
+constexpr size_t HISTORY_ARCHIVE_SIZE = 0;
+/// Memory budget in MiB for the trigram index over the scrollback history.
+/**
+ * If non-zero then lines entering the scrollback history are added to a
+ * trigram index which speeds up history searches via IPC (`nst-msg
+ * --search`). Once the budget is exhausted the oldest lines are removed from
+ * the index, they are still found by searching them linearly.
+ **/
+constexpr size_t HISTORY_INDEX_SIZE = 0;
 /// Whether nst should keep a selected scrollback position even when new TTY data comes in.
 /**
  * When the terminal history is displayed then the question arises what to do
@@ -192,6 +209,19 @@ constexpr ColorIndex MOUSE_FG{7};
 constexpr ColorIndex MOUSE_BG{0};
 /// If set then the mouse cursor in will be hidden from the terminal window when typing.
 constexpr bool HIDE_MOUSE_CURSOR = true;
+/// Whether box drawing, block element, braille and Powerline glyphs are drawn by nst itself.
+/**
+ * If enabled then these glyphs are not taken from fonts but are drawn
+ * procedurally, fitting exactly into the terminal cells. This avoids gaps
+ * between adjacent cells and costly fallback font lookups.
+ **/
+constexpr bool BOX_DRAWING = true;
+
+/// Whether text is shaped to display programming ligatures of suitable fonts.
+/**
+ * This only has an effect if nst has been built with HarfBuzz support.
+ **/
+constexpr bool LIGATURES = false;
 
 /// Fallback color to use if no matching font is found.
 /**
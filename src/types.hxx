@@ -333,6 +333,11 @@ public: // functions
 struct ColSpan {
 	int left = 0;
 	int right = 0;
+
+	/// returns whether the given column is within this ColSpan range
+	bool inRange(const int x) const {
+		return left <= x && x <= right;
+	}
 };
 
 /// A two-dimensional extent in pixels e.g. for character bounding box, window dimensions etc.